@@ -0,0 +1,394 @@
+/*
+ * FogLAMP notification service binary readings decoder.
+ *
+ * Copyright (c) 2019 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Massimiliano Pinto
+ */
+#include <binary_readings.h>
+#include <endian.h>
+#include <string.h>
+#include <sys/time.h>
+#include <algorithm>
+
+using namespace std;
+
+/**
+ * Constructor for binary readings decoder
+ *
+ * Data is not copied: the buffer must be available
+ * while decoding.
+ *
+ * @param    data	Binary readings data
+ * @param    length	Data length in bytes
+ */
+BinaryReadingsDecoder::BinaryReadingsDecoder(const char* data,
+					     size_t length) :
+					     m_data(data),
+					     m_length(length),
+					     m_offset(0)
+{
+}
+
+/**
+ * Check data header and get the number of encoded readings
+ *
+ * @param    count	Output number of readings
+ * @return		True on success, false on invalid header
+ */
+bool BinaryReadingsDecoder::getCount(uint32_t& count)
+{
+	uint8_t version;
+	size_t magicLen = strlen(BINARY_READINGS_MAGIC);
+
+	if (m_length < magicLen ||
+	    memcmp(m_data, BINARY_READINGS_MAGIC, magicLen) != 0)
+	{
+		return false;
+	}
+	m_offset = magicLen;
+
+	return getUint8(version) &&
+	       version == BINARY_READINGS_VERSION &&
+	       getUint32(count);
+}
+
+/**
+ * Get the asset name of next reading.
+ *
+ * This must be followed by getReading or skipReading.
+ *
+ * @param    assetName	Output asset name
+ * @return		True on success, false on truncated data
+ */
+bool BinaryReadingsDecoder::getAssetName(string& assetName)
+{
+	uint16_t length;
+	return getUint16(length) && getString(length, assetName);
+}
+
+/**
+ * Create a Reading object from current reading data
+ *
+ * Datapoints not in the given names are skipped without
+ * creating objects.
+ *
+ * @param    assetName	The asset name returned by getAssetName
+ * @param    datapoints	The datapoint names to decode,
+ *			empty means all datapoints
+ * @return		New Reading object or NULL on invalid data
+ */
+Reading* BinaryReadingsDecoder::getReading(const string& assetName,
+					   const vector<string>& datapoints)
+{
+	uint64_t userTs;
+	uint64_t ts;
+	uint16_t count;
+
+	if (!getUint64(userTs) ||
+	    !getUint64(ts) ||
+	    !getUint16(count))
+	{
+		return NULL;
+	}
+
+	vector<Datapoint *> values;
+	values.reserve(count);
+	for (uint16_t i = 0; i < count; i++)
+	{
+		uint16_t nameLength;
+		string name;
+		Datapoint* d = NULL;
+
+		if (getUint16(nameLength) &&
+		    getString(nameLength, name))
+		{
+			if (datapoints.empty() ||
+			    find(datapoints.begin(), datapoints.end(), name) != datapoints.end())
+			{
+				d = getDatapointValue(name);
+			}
+			else if (skipDatapointValue())
+			{
+				// Datapoint not needed
+				continue;
+			}
+		}
+
+		if (!d)
+		{
+			for (auto v = values.begin(); v != values.end(); ++v)
+			{
+				delete *v;
+			}
+			return NULL;
+		}
+		values.push_back(d);
+	}
+
+	Reading* reading = new Reading(assetName, values);
+
+	struct timeval tv;
+	if (userTs)
+	{
+		tv.tv_sec = userTs / 1000000;
+		tv.tv_usec = userTs % 1000000;
+		reading->setUserTimestamp(tv);
+	}
+	if (ts)
+	{
+		tv.tv_sec = ts / 1000000;
+		tv.tv_usec = ts % 1000000;
+		reading->setTimestamp(tv);
+	}
+
+	return reading;
+}
+
+/**
+ * Skip current reading data without creating objects
+ *
+ * @return	True on success, false on invalid data
+ */
+bool BinaryReadingsDecoder::skipReading()
+{
+	uint16_t count;
+	if (!skip(2 * sizeof(uint64_t)) ||
+	    !getUint16(count))
+	{
+		return false;
+	}
+
+	for (uint16_t i = 0; i < count; i++)
+	{
+		if (!skipDatapoint())
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Create a Datapoint object from current datapoint value data
+ *
+ * @param    name	The datapoint name
+ * @return		New Datapoint object or NULL on invalid data
+ */
+Datapoint* BinaryReadingsDecoder::getDatapointValue(const string& name)
+{
+	uint8_t type;
+
+	if (!getUint8(type))
+	{
+		return NULL;
+	}
+
+	switch (type)
+	{
+		case BINARY_DP_INTEGER:
+		{
+			uint64_t value;
+			if (!getUint64(value))
+			{
+				return NULL;
+			}
+			DatapointValue dpv((long)(int64_t)value);
+			return new Datapoint(name, dpv);
+		}
+		case BINARY_DP_FLOAT:
+		{
+			double value;
+			if (!getDouble(value))
+			{
+				return NULL;
+			}
+			DatapointValue dpv(value);
+			return new Datapoint(name, dpv);
+		}
+		case BINARY_DP_STRING:
+		{
+			uint32_t length;
+			string value;
+			if (!getUint32(length) ||
+			    !getString(length, value))
+			{
+				return NULL;
+			}
+			DatapointValue dpv(value);
+			return new Datapoint(name, dpv);
+		}
+		case BINARY_DP_FLOAT_ARRAY:
+		{
+			uint32_t count;
+			if (!getUint32(count) ||
+			    count > (m_length - m_offset) / sizeof(double))
+			{
+				return NULL;
+			}
+			vector<double> values(count);
+			for (uint32_t i = 0; i < count; i++)
+			{
+				getDouble(values[i]);
+			}
+			DatapointValue dpv(values);
+			return new Datapoint(name, dpv);
+		}
+		default:
+			return NULL;
+	}
+}
+
+/**
+ * Skip current datapoint data
+ *
+ * @return	True on success, false on invalid data
+ */
+bool BinaryReadingsDecoder::skipDatapoint()
+{
+	uint16_t nameLength;
+
+	return getUint16(nameLength) &&
+	       skip(nameLength) &&
+	       skipDatapointValue();
+}
+
+/**
+ * Skip current datapoint value data
+ *
+ * @return	True on success, false on invalid data
+ */
+bool BinaryReadingsDecoder::skipDatapointValue()
+{
+	uint8_t type;
+	uint32_t length;
+
+	if (!getUint8(type))
+	{
+		return false;
+	}
+
+	switch (type)
+	{
+		case BINARY_DP_INTEGER:
+		case BINARY_DP_FLOAT:
+			return skip(sizeof(uint64_t));
+		case BINARY_DP_STRING:
+			return getUint32(length) && skip(length);
+		case BINARY_DP_FLOAT_ARRAY:
+			return getUint32(length) &&
+			       length <= (m_length - m_offset) / sizeof(double) &&
+			       skip(length * sizeof(double));
+		default:
+			return false;
+	}
+}
+
+/**
+ * Advance current position
+ *
+ * @param    length	Number of bytes to skip
+ * @return		True on success, false on truncated data
+ */
+bool BinaryReadingsDecoder::skip(size_t length)
+{
+	if (m_length - m_offset < length)
+	{
+		return false;
+	}
+	m_offset += length;
+	return true;
+}
+
+/**
+ * Read a string
+ *
+ * @param    length	String length in bytes
+ * @param    value	Output string
+ * @return		True on success, false on truncated data
+ */
+bool BinaryReadingsDecoder::getString(size_t length, string& value)
+{
+	if (m_length - m_offset < length)
+	{
+		return false;
+	}
+	value.assign(m_data + m_offset, length);
+	m_offset += length;
+	return true;
+}
+
+/**
+ * Read an unsigned 8 bits value
+ */
+bool BinaryReadingsDecoder::getUint8(uint8_t& value)
+{
+	if (m_length - m_offset < sizeof(value))
+	{
+		return false;
+	}
+	value = (uint8_t)m_data[m_offset];
+	m_offset += sizeof(value);
+	return true;
+}
+
+/**
+ * Read a little endian unsigned 16 bits value
+ */
+bool BinaryReadingsDecoder::getUint16(uint16_t& value)
+{
+	if (m_length - m_offset < sizeof(value))
+	{
+		return false;
+	}
+	memcpy(&value, m_data + m_offset, sizeof(value));
+	value = le16toh(value);
+	m_offset += sizeof(value);
+	return true;
+}
+
+/**
+ * Read a little endian unsigned 32 bits value
+ */
+bool BinaryReadingsDecoder::getUint32(uint32_t& value)
+{
+	if (m_length - m_offset < sizeof(value))
+	{
+		return false;
+	}
+	memcpy(&value, m_data + m_offset, sizeof(value));
+	value = le32toh(value);
+	m_offset += sizeof(value);
+	return true;
+}
+
+/**
+ * Read a little endian unsigned 64 bits value
+ */
+bool BinaryReadingsDecoder::getUint64(uint64_t& value)
+{
+	if (m_length - m_offset < sizeof(value))
+	{
+		return false;
+	}
+	memcpy(&value, m_data + m_offset, sizeof(value));
+	value = le64toh(value);
+	m_offset += sizeof(value);
+	return true;
+}
+
+/**
+ * Read a little endian IEEE 754 double value
+ */
+bool BinaryReadingsDecoder::getDouble(double& value)
+{
+	uint64_t bits;
+	if (!getUint64(bits))
+	{
+		return false;
+	}
+	memcpy(&value, &bits, sizeof(value));
+	return true;
+}
@@ -79,6 +79,9 @@ DeliveryQueueElement::DeliveryQueueElement(DeliveryDataElement* data)
 	// Get instances
 	NotificationManager* instances = NotificationManager::getInstance();
 
+	// The found instance is not deleted meanwhile
+	unsigned long epoch = instances->addInstancesUser();
+
 	// Find instance for this rule
 	NotificationInstance* instance =
 		instances->getNotificationInstance(data->getNotificationName());
@@ -93,6 +96,8 @@ DeliveryQueueElement::DeliveryQueueElement(DeliveryDataElement* data)
 		m_plugin = NULL;
 	}
 
+	instances->removeInstancesUser(epoch);
+
 	// Check whether the DeliveryDataElement is signalling the end of received deliveries
 	if (data->m_instance == NULL)
 	{
@@ -410,6 +415,10 @@ void DeliveryQueue::processDelivery(DeliveryQueueElement* elem)
 	// Get instances
 	NotificationManager* instances = NotificationManager::getInstance();
 
+	// The found instance and its delivery plugin
+	// are not deleted while delivering
+	unsigned long epoch = instances->addInstancesUser();
+
 	// Find instance for this rule
 	NotificationInstance* instance =
 	instances->getNotificationInstance(elem->getData()->getNotificationName());
@@ -443,4 +452,6 @@ void DeliveryQueue::processDelivery(DeliveryQueueElement* elem)
 				elem->m_time);
 	}
 #endif
+
+	instances->removeInstancesUser(epoch);
 }
@@ -0,0 +1,128 @@
+/*
+ * FogLAMP notification queue ring buffer.
+ *
+ * Copyright (c) 2020 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Massimiliano Pinto
+ */
+#include <element_ring.h>
+#include <stdint.h>
+
+using namespace std;
+
+/**
+ * Constructor for the ElementRing class
+ *
+ * @param    size	Number of ring cells,
+ *			rounded up to a power of two
+ */
+ElementRing::ElementRing(size_t size) : m_tail(0), m_head(0)
+{
+	size_t cells = 2;
+	while (cells < size)
+	{
+		cells <<= 1;
+	}
+	m_mask = cells - 1;
+
+	m_cells = new Cell[cells];
+	for (size_t i = 0; i < cells; i++)
+	{
+		m_cells[i].m_sequence.store(i, memory_order_relaxed);
+		m_cells[i].m_element = NULL;
+	}
+}
+
+/**
+ * ElementRing destructor
+ *
+ * Elements still in the ring are not deleted.
+ */
+ElementRing::~ElementRing()
+{
+	delete[] m_cells;
+}
+
+/**
+ * Add an element to the ring, called by producers
+ *
+ * @param    element	The element to add
+ * @return		True on success, false if the ring is full
+ */
+bool ElementRing::push(NotificationQueueElement* element)
+{
+	Cell* cell;
+	size_t pos = m_tail.load(memory_order_relaxed);
+
+	while (true)
+	{
+		cell = &m_cells[pos & m_mask];
+		size_t sequence = cell->m_sequence.load(memory_order_acquire);
+		intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+		if (diff == 0)
+		{
+			// Cell is free: claim it
+			if (m_tail.compare_exchange_weak(pos,
+							 pos + 1,
+							 memory_order_relaxed))
+			{
+				break;
+			}
+		}
+		else if (diff < 0)
+		{
+			// Cell not read yet by the consumer: ring is full
+			return false;
+		}
+		else
+		{
+			// Cell claimed by another producer
+			pos = m_tail.load(memory_order_relaxed);
+		}
+	}
+
+	cell->m_element = element;
+	// Publish the element to the consumer
+	cell->m_sequence.store(pos + 1, memory_order_release);
+
+	return true;
+}
+
+/**
+ * Remove the oldest element from the ring, called by the consumer
+ *
+ * @param    element	Output element
+ * @return		True on success, false if the ring is empty
+ */
+bool ElementRing::pop(NotificationQueueElement*& element)
+{
+	Cell* cell = &m_cells[m_head & m_mask];
+	size_t sequence = cell->m_sequence.load(memory_order_acquire);
+	if ((intptr_t)sequence - (intptr_t)(m_head + 1) < 0)
+	{
+		// No element published yet
+		return false;
+	}
+
+	element = cell->m_element;
+	// Give the cell back to producers, for next ring cycle
+	cell->m_sequence.store(m_head + m_mask + 1, memory_order_release);
+	m_head++;
+
+	return true;
+}
+
+/**
+ * Check whether the ring has no element to read,
+ * called by the consumer
+ *
+ * @return	True if the ring is empty
+ */
+bool ElementRing::empty() const
+{
+	const Cell* cell = &m_cells[m_head & m_mask];
+	size_t sequence = cell->m_sequence.load(memory_order_acquire);
+	return (intptr_t)sequence - (intptr_t)(m_head + 1) < 0;
+}
@@ -0,0 +1,211 @@
+/*
+ * FogLAMP notification rule evaluation pool.
+ *
+ * Copyright (c) 2020 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Massimiliano Pinto
+ */
+#include <evaluation_pool.h>
+
+using namespace std;
+
+/**
+ * Evaluation pool worker thread entry point
+ *
+ * @param    pool	Pointer to EvaluationPool instance
+ */
+static void worker(EvaluationPool* pool)
+{
+	pool->process();
+}
+
+/**
+ * Constructor for the EvaluationPool class
+ *
+ * @param    numWorkers		Number of pool threads,
+ *				0 means tasks are run by the caller
+ */
+EvaluationPool::EvaluationPool(unsigned long numWorkers) : m_running(true)
+{
+	m_logger = Logger::getLogger();
+
+	for (unsigned long i = 0; i < numWorkers; ++i)
+	{
+		m_workers.push_back(new thread(worker, this));
+	}
+
+	m_logger->info("Notification evaluation pool has %lu worker threads.",
+		       m_workers.size());
+}
+
+/**
+ * EvaluationPool destructor
+ */
+EvaluationPool::~EvaluationPool()
+{
+	this->stop();
+	for (auto w = m_workers.begin(); w != m_workers.end(); ++w)
+	{
+		delete *w;
+	}
+}
+
+/**
+ * Stop the pool threads
+ *
+ * Tasks already queued are completed.
+ */
+void EvaluationPool::stop()
+{
+	{
+		lock_guard<mutex> guard(m_mutex);
+		m_running = false;
+	}
+	m_taskCv.notify_all();
+
+	for (auto w = m_workers.begin(); w != m_workers.end(); ++w)
+	{
+		if ((*w)->joinable())
+		{
+			(*w)->join();
+		}
+	}
+}
+
+/**
+ * Run a set of tasks and wait for all of them to complete
+ *
+ * @param    tasks	The tasks to run, in submission order
+ */
+void EvaluationPool::run(vector<function<void()>>& tasks)
+{
+	if (tasks.empty())
+	{
+		return;
+	}
+
+	unique_lock<mutex> lock(m_mutex);
+	if (!m_running ||
+	    m_workers.empty() ||
+	    tasks.size() == 1)
+	{
+		lock.unlock();
+		// Run all tasks in the calling thread
+		for (auto t = tasks.begin(); t != tasks.end(); ++t)
+		{
+			this->runTask(*t);
+		}
+		return;
+	}
+
+	TaskBatch batch(tasks.size());
+	// First task is run by the calling thread
+	for (auto t = tasks.begin() + 1; t != tasks.end(); ++t)
+	{
+		m_tasks.push_back(Task(&(*t), &batch));
+	}
+	lock.unlock();
+	m_taskCv.notify_all();
+
+	this->runTask(tasks.front());
+
+	lock.lock();
+	batch.m_pending--;
+	while (batch.m_pending)
+	{
+		// Run a task of this batch not yet taken by the pool threads
+		auto t = m_tasks.begin();
+		while (t != m_tasks.end() && (*t).m_batch != &batch)
+		{
+			++t;
+		}
+
+		if (t != m_tasks.end())
+		{
+			function<void()>* fn = (*t).m_fn;
+			m_tasks.erase(t);
+			lock.unlock();
+			this->runTask(*fn);
+			lock.lock();
+			batch.m_pending--;
+		}
+		else
+		{
+			// Wait for tasks run by the pool threads
+			batch.m_doneCv.wait(lock);
+		}
+	}
+}
+
+/**
+ * Run queued tasks, pool thread loop
+ */
+void EvaluationPool::process()
+{
+	unique_lock<mutex> lock(m_mutex);
+	while (true)
+	{
+		while (m_tasks.empty() && m_running)
+		{
+			m_taskCv.wait(lock);
+		}
+
+		if (m_tasks.empty())
+		{
+			// Not running and no tasks
+			break;
+		}
+
+		Task task = m_tasks.front();
+		m_tasks.pop_front();
+
+		lock.unlock();
+		this->runTask(*task.m_fn);
+		lock.lock();
+
+		this->complete(task.m_batch);
+	}
+}
+
+/**
+ * Run a task
+ *
+ * A task failure is logged and the task is completed anyway:
+ * the batch is waited for by its run() caller.
+ *
+ * @param    task	The task to run
+ */
+void EvaluationPool::runTask(function<void()>& task)
+{
+	try
+	{
+		task();
+	}
+	catch (exception& ex)
+	{
+		m_logger->error("Notification evaluation task failed: %s",
+				ex.what());
+	}
+	catch (...)
+	{
+		m_logger->error("Notification evaluation task failed "
+				"with an unknown exception");
+	}
+}
+
+/**
+ * Mark a task of a batch as completed
+ *
+ * The caller must hold the pool lock.
+ *
+ * @param    batch	The batch of the completed task
+ */
+void EvaluationPool::complete(TaskBatch* batch)
+{
+	if (--batch->m_pending == 0)
+	{
+		batch->m_doneCv.notify_all();
+	}
+}
@@ -0,0 +1,78 @@
+#ifndef _BINARY_READINGS_H
+#define _BINARY_READINGS_H
+/*
+ * FogLAMP notification service binary readings decoder.
+ *
+ * Copyright (c) 2019 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Massimiliano Pinto
+ */
+#include <reading.h>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// Content-Type of binary encoded readings data
+#define BINARY_READINGS_CONTENT_TYPE	"application/vnd.foglamp.readings"
+
+// Binary layout version and magic
+#define BINARY_READINGS_MAGIC		"FLRB"
+#define BINARY_READINGS_VERSION		1
+
+/**
+ * Datapoint value types in binary readings data
+ */
+typedef enum {
+	BINARY_DP_INTEGER = 0,	// int64
+	BINARY_DP_FLOAT,	// IEEE 754 double
+	BINARY_DP_STRING,	// uint32 length, bytes
+	BINARY_DP_FLOAT_ARRAY	// uint32 count, doubles
+} BinaryDatapointType;
+
+/**
+ * Decoder of binary encoded readings data.
+ *
+ * Readings are decoded straight into Reading/Datapoint objects,
+ * without any intermediate representation.
+ *
+ * All numbers are little endian, strings are not NULL terminated:
+ *
+ *   header:	"FLRB", uint8 version, uint32 readings count
+ *   reading:	uint16 asset name length, asset name,
+ *		uint64 user timestamp (microseconds since epoch),
+ *		uint64 timestamp (microseconds since epoch),
+ *		uint16 datapoints count, datapoints
+ *   datapoint:	uint16 name length, name,
+ *		uint8 BinaryDatapointType, value
+ */
+class BinaryReadingsDecoder
+{
+	public:
+		BinaryReadingsDecoder(const char* data, size_t length);
+		bool		getCount(uint32_t& count);
+		bool		getAssetName(std::string& assetName);
+		Reading*	getReading(const std::string& assetName,
+					   const std::vector<std::string>& datapoints);
+		bool		skipReading();
+
+	private:
+		bool		getUint8(uint8_t& value);
+		bool		getUint16(uint16_t& value);
+		bool		getUint32(uint32_t& value);
+		bool		getUint64(uint64_t& value);
+		bool		getDouble(double& value);
+		bool		getString(size_t length, std::string& value);
+		bool		skip(size_t length);
+		Datapoint*	getDatapointValue(const std::string& name);
+		bool		skipDatapointValue();
+		bool		skipDatapoint();
+
+	private:
+		const char*	m_data;
+		size_t		m_length;
+		size_t		m_offset;
+};
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef _ELEMENT_RING_H
+#define _ELEMENT_RING_H
+/*
+ * FogLAMP notification queue ring buffer.
+ *
+ * Copyright (c) 2020 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Massimiliano Pinto
+ */
+
+#include <atomic>
+#include <cstddef>
+
+class NotificationQueueElement;
+
+/**
+ * Bounded lock-free multi producer, single consumer ring
+ * of NotificationQueueElement pointers.
+ *
+ * Each cell has a sequence number telling whether it can be
+ * written by producers or read by the consumer: producers claim
+ * a cell with a compare and swap of the ring tail,
+ * the consumer owns the ring head.
+ */
+class ElementRing
+{
+	public:
+		ElementRing(size_t size);
+		~ElementRing();
+
+		bool			push(NotificationQueueElement* element);
+		bool			pop(NotificationQueueElement*& element);
+		bool			empty() const;
+		size_t			getSize() const { return m_mask + 1; };
+
+	private:
+		class Cell
+		{
+			public:
+				std::atomic<size_t>		m_sequence;
+				NotificationQueueElement*	m_element;
+		};
+
+		Cell*			m_cells;
+		size_t			m_mask;
+		// Next cell to write, shared by producers
+		std::atomic<size_t>	m_tail;
+		// Next cell to read, used by the consumer only
+		size_t			m_head;
+};
+
+#endif
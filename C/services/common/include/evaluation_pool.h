@@ -0,0 +1,82 @@
+#ifndef _EVALUATION_POOL_H
+#define _EVALUATION_POOL_H
+/*
+ * FogLAMP notification rule evaluation pool.
+ *
+ * Copyright (c) 2020 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Massimiliano Pinto
+ */
+
+#include <logger.h>
+#include <deque>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/**
+ * The EvaluationPool class.
+ *
+ * A pool of threads running the independent rule evaluations
+ * of a notification queue element.
+ *
+ * The caller of run() waits for all the tasks it has submitted
+ * and meanwhile runs its own tasks not yet taken by the pool threads,
+ * so a batch always completes even with all pool threads busy.
+ */
+class EvaluationPool
+{
+	public:
+		EvaluationPool(unsigned long numWorkers);
+		~EvaluationPool();
+
+		void			run(std::vector<std::function<void()>>& tasks);
+		void			process();
+		void			stop();
+		unsigned long		getWorkers() const { return m_workers.size(); };
+
+	private:
+		/**
+		 * The tasks submitted by one run() call
+		 */
+		class TaskBatch
+		{
+			public:
+				TaskBatch(unsigned long count) : m_pending(count) {};
+
+				// Tasks not completed yet, protected by pool mutex
+				unsigned long		m_pending;
+				std::condition_variable	m_doneCv;
+		};
+
+		/**
+		 * A queued task
+		 */
+		class Task
+		{
+			public:
+				Task(std::function<void()>* fn,
+				     TaskBatch* batch) : m_fn(fn), m_batch(batch) {};
+
+				std::function<void()>*	m_fn;
+				TaskBatch*		m_batch;
+		};
+
+		void			runTask(std::function<void()>& task);
+		void			complete(TaskBatch* batch);
+
+	private:
+		bool			m_running;
+		std::vector<std::thread *>
+					m_workers;
+		std::deque<Task>	m_tasks;
+		std::mutex		m_mutex;
+		std::condition_variable	m_taskCv;
+		Logger*			m_logger;
+};
+
+#endif
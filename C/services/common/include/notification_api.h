@@ -12,6 +12,9 @@
 
 #include "logger.h"
 #include <server_http.hpp>
+#include <reading_set.h>
+#include <mutex>
+#include <condition_variable>
 
 using namespace std;
 using HttpServer = SimpleWeb::Server<SimpleWeb::HTTP>;
@@ -21,9 +24,11 @@ using HttpServer = SimpleWeb::Server<SimpleWeb::HTTP>;
  */
 #define ESCAPE_SPECIAL_CHARS		"\\{\\}\\\"\\(\\)\\!\\[\\]\\^\\$\\.\\|\\?\\*\\+\\-"
 #define RECEIVE_NOTIFICATION		"^/notification/reading/asset/([A-Za-z][a-zA-Z0-9_%\\-]*)$"
+#define RECEIVE_NOTIFICATIONS		"^/notification/reading$"
 #define GET_NOTIFICATION_INSTANCES	"^/notification$"
 #define GET_NOTIFICATION_DELIVERY	"^/notification/delivery$"
 #define GET_NOTIFICATION_RULES		"^/notification/rules$"
+#define GET_NOTIFICATION_BUFFERS	"^/notification/buffers$"
 #define POST_NOTIFICATION_NAME		"^/notification/([A-Za-z][a-zA-Z0-9_%'~" ESCAPE_SPECIAL_CHARS "]*)$"
 #define POST_NOTIFICATION_RULE_NAME	"^/notification/([A-Za-z][a-zA-Z0-9_%'~" ESCAPE_SPECIAL_CHARS "]*)/rule" \
 					"/([A-Za-z][a-zA-Z0-9_%'~" ESCAPE_SPECIAL_CHARS "]*)$"
@@ -34,6 +39,48 @@ using HttpServer = SimpleWeb::Server<SimpleWeb::HTTP>;
 #define RULE_NAME_COMPONENT		2
 #define DELIVERY_NAME_COMPONENT		2
 
+// Seconds a client should wait before resending rejected data
+#define RETRY_AFTER_SECONDS		1
+// Handoff name of multi asset callbacks, not a valid asset name
+#define BATCH_HANDOFF_NAME		""
+
+/**
+ * Per asset ordered handoff of parsed readings into the notification queue.
+ *
+ * Reading callbacks are parsed concurrently by the API threads:
+ * each callback takes a ticket for its asset names and adds parsed data
+ * into the queue only when all earlier tickets of the same assets are done.
+ */
+class AssetHandoff
+{
+	public:
+		void		enter(const std::vector<std::string>& assets,
+				      std::vector<unsigned long>& tickets);
+		void		wait(const std::vector<std::string>& assets,
+				     const std::vector<unsigned long>& tickets);
+		void		leave(const std::vector<std::string>& assets);
+
+	private:
+		// Per asset next ticket and ticket being served
+		std::map<std::string, std::pair<unsigned long, unsigned long>>
+				m_tickets;
+		std::mutex	m_mutex;
+		std::condition_variable
+				m_cv;
+};
+
+/**
+ * Per asset filter of received readings data
+ */
+class AssetFilter
+{
+	public:
+		// Asset has enabled notifications
+		bool				active;
+		// Datapoints needed by the rules, empty means all datapoints
+		std::vector<std::string>	datapoints;
+};
+
 /**
  * NotificationApi is the entry point for:
  * - Service API
@@ -48,6 +95,7 @@ class NotificationApi
 			ObjNone,
 			ObjGetRulesAll,
 			ObjGetDeliveryAll,
+			ObjGetBuffersAll,
 			ObjGetNotificationsAll,
 			ObjGetNotificationName,
 			ObjCreateNotification,
@@ -67,8 +115,11 @@ class NotificationApi
 		void		stop();
 		void		stopServer();
 		unsigned short	getListenerPort();
+		void		setThreads(unsigned int threads);
 		void		processCallback(shared_ptr<HttpServer::Response> response,
 						shared_ptr<HttpServer::Request> request);
+		void		processBatchCallback(shared_ptr<HttpServer::Response> response,
+						     shared_ptr<HttpServer::Request> request);
 		void		getNotificationObject(NOTIFICATION_OBJECT object,
 						      shared_ptr<HttpServer::Response> response,
 						      shared_ptr<HttpServer::Request> request);
@@ -84,6 +135,18 @@ class NotificationApi
 		// Add asset name and data to the Readings process queue
 		bool		queueNotification(const string& assetName,
 						  const string& payload);
+		bool		queueNotification(const string& assetName,
+						  char* payload,
+						  size_t length = 0,
+						  bool binary = false,
+						  bool* full = NULL);
+		// Split multi asset readings data and add it to the process queue
+		bool		queueNotifications(char* payload,
+						   size_t length,
+						   bool binary,
+						   unsigned long& queued,
+						   unsigned long& discarded,
+						   bool* full = NULL);
 
 		void		defaultResource(shared_ptr<HttpServer::Response> response,
                                         shared_ptr<HttpServer::Request> request);
@@ -97,7 +160,26 @@ class NotificationApi
 		void		respond(shared_ptr<HttpServer::Response>,
 					SimpleWeb::StatusCode,
 				const string&);
+		void		overloaded(shared_ptr<HttpServer::Response>);
+		bool		isOverloaded();
 		bool		ishex(const char c);
+		ReadingSet*	parseReadings(char* payload,
+					      const std::vector<std::string>& datapoints);
+		ReadingSet*	decodeReadings(const std::string& assetName,
+					       const char* data,
+					       size_t length,
+					       const std::vector<std::string>& datapoints);
+		bool		parseAssetReadings(char* payload,
+						   std::map<std::string, std::vector<Reading *>>& assetReadings,
+						   std::map<std::string, AssetFilter>& filters);
+		bool		decodeAssetReadings(const char* data,
+						    size_t length,
+						    std::map<std::string, std::vector<Reading *>>& assetReadings,
+						    std::map<std::string, AssetFilter>& filters);
+		bool		isBinary(shared_ptr<HttpServer::Request> request);
+		char*		getContent(shared_ptr<HttpServer::Request> request,
+					   size_t& length,
+					   string& copy);
 
 	private:
 		static NotificationApi*		m_instance;
@@ -107,6 +189,7 @@ class NotificationApi
 		thread*				m_thread;
 		std::string			m_callBackURL;
 		Logger*				m_logger;
+		AssetHandoff			m_handoff;
 };
 
 #endif
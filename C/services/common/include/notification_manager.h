@@ -16,9 +16,18 @@
 #include <delivery_plugin.h>
 #include <notification_service.h>
 #include <notification_stats.h>
+#include <symbol_table.h>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <cmath>
 
 // Notification type repeat time
 #define DEFAULT_RETRIGGER_TIME 60
+#define DEFAULT_MAX_QUEUE_AGE 0
+#define DEFAULT_MAX_READING_AGE 0
+#define DEFAULT_BUFFER_MAX_BYTES 0
+#define DEFAULT_BUFFER_SPILL_BYTES 0
 
 /**
  * The EvaluationType class represents
@@ -40,19 +49,23 @@ class EvaluationType
 			Maximum
 		} EVAL_TYPE;
 
-		EvaluationType(EVAL_TYPE type, time_t interval)
+		// Interval in seconds, fractions allow sub-second windows
+		EvaluationType(EVAL_TYPE type, double interval)
 		{
 			m_type = type;
-			m_interval = interval;
+			m_interval = (time_t)interval;
+			m_intervalUs = (uint64_t)llround(interval * 1000000.0);
 		};
 		~EvaluationType() {};
 
 		EVAL_TYPE		getType() const { return m_type; };
 		time_t			getInterval() const { return m_interval; };
+		uint64_t		getIntervalUs() const { return m_intervalUs; };
 
 	private:
 		EVAL_TYPE		m_type;
 		time_t		m_interval;
+		uint64_t	m_intervalUs;
 		
 };
 
@@ -70,13 +83,19 @@ class NotificationDetail
 
 		const std::string&	getAssetName() const{ return m_asset; };
 		const std::string&	getRuleName() const { return m_rule; };
+		SYMBOL_ID		getAssetId() const { return m_assetId; };
+		SYMBOL_ID		getRuleId() const { return m_ruleId; };
 		const EvaluationType::EVAL_TYPE
 					getType() const { return m_value.getType(); };
 		const time_t		getInterval() const { return m_value.getInterval(); };
+		const uint64_t		getIntervalUs() const { return m_value.getIntervalUs(); };
 
 	private:
 		std::string		m_asset;
 		std::string		m_rule;
+		// Interned names
+		SYMBOL_ID		m_assetId;
+		SYMBOL_ID		m_ruleId;
 		EvaluationType		m_value;
 };
 
@@ -119,17 +138,33 @@ class NotificationRule : public NotificationElement
 		// Get all asset names
 		std::vector<NotificationDetail>&
 					getAssets() { return m_assets; };
+		// Get a copy of all asset names, safe with concurrent changes
+		void			copyAssets(std::vector<NotificationDetail>& assets)
+		{
+			std::lock_guard<std::mutex> guard(m_assetsMutex);
+			assets = m_assets;
+		};
 		// Add an asset name
 		void			addAsset(NotificationDetail& info)
 		{
+			std::lock_guard<std::mutex> guard(m_assetsMutex);
 			m_assets.push_back(info);
 		};
+		// Remove an asset name
+		std::vector<NotificationDetail>::iterator
+					removeAsset(std::vector<NotificationDetail>::iterator asset)
+		{
+			std::lock_guard<std::mutex> guard(m_assetsMutex);
+			return m_assets.erase(asset);
+		};
 		std::string		toJSON();
 
 	private:
 		RulePlugin*		m_plugin;
 		std::vector<NotificationDetail>
 					m_assets;
+		// Protects changes to m_assets read by queue workers
+		std::mutex		m_assetsMutex;
 };
 
 /**
@@ -163,10 +198,28 @@ class NotificationInstance
 {
 	public:
 		enum eNotificationType { None, OneShot, Retriggered, Toggled };
+		// Data of higher priority notifications is processed first
+		enum eNotificationPriority { PriorityHigh, PriorityNormal, PriorityLow };
+		// Rule buffers data removed above the memory budget
+		enum eBufferEviction { EvictDropOldest, EvictDownsample };
 		struct NotificationType
 		{
 			eNotificationType type;
 			long retriggerTime;
+			// Stale data policy: drop data queued for more than
+			// maxQueueAge seconds and readings older than
+			// maxReadingAge seconds, 0 means no limit
+			bool dropStale;
+			long maxQueueAge;
+			long maxReadingAge;
+			eNotificationPriority priority;
+			// Memory budget of the rule buffers in bytes,
+			// 0 means no limit
+			unsigned long bufferMaxBytes;
+			eBufferEviction bufferEviction;
+			// Size of the buffered data of an asset
+			// above which older data is spilled, 0 means no spill
+			unsigned long bufferSpillBytes;
 		};
 		enum NotificationState {StateTriggered, StateCleared };
 		NotificationInstance(const std::string& name,
@@ -191,6 +244,7 @@ class NotificationInstance
 		std::string		toJSON();
 		bool			isEnabled() const { return m_enable; };
 		NotificationType	getType() const { return m_type; };
+		eNotificationPriority	getPriority() const { return m_type.priority; };
 		std::string		getTypeString(NotificationType type);
 		bool			handleState(bool evalRet);
 		bool			reconfigure(const std::string& name,
@@ -216,18 +270,22 @@ class NotificationInstance
 
 	private:
 		const std::string	m_name;
-		bool			m_enable;
+		std::atomic<bool>	m_enable;
 		NotificationType	m_type;
 		NotificationRule*	m_rule;
 		NotificationDelivery*	m_delivery;
 		time_t			m_lastSent;
 		NotificationState	m_state;
-		bool			m_zombie;
+		std::atomic<bool>	m_zombie;
 };
 
 typedef NotificationInstance::NotificationType NOTIFICATION_TYPE;
 typedef NotificationInstance::eNotificationType E_NOTIFICATION_TYPE;
+typedef NotificationInstance::eNotificationPriority E_NOTIFICATION_PRIORITY;
+typedef NotificationInstance::eBufferEviction E_BUFFER_EVICTION;
 typedef std::function<RulePlugin*(const std::string&)> BUILTIN_RULE_FN;
+// Published copy of the instances map, never modified
+typedef std::unordered_map<std::string, NotificationInstance *> INSTANCES_TABLE;
 
 class NotificationManager
 {
@@ -245,6 +303,11 @@ class NotificationManager
 		std::map<std::string, NotificationInstance *>&
 					getInstances() { return m_instances; };
 		NotificationInstance*	getNotificationInstance(const std::string& instanceName) const;
+		std::shared_ptr<const INSTANCES_TABLE>
+					getInstancesTable() const
+		{
+			return std::atomic_load(&m_instancesTable);
+		};
 		E_NOTIFICATION_TYPE	parseType(const std::string& type);
 		std::string		getJSONRules();
 		std::string		getJSONDelivery();
@@ -259,6 +322,11 @@ class NotificationManager
 		bool			setupInstance(const string& name,
 						      const ConfigCategory& config);
 		bool			removeInstance(const string& instanceName);
+		void			addInstance(const std::string& instanceName,
+						    bool enable,
+						    NOTIFICATION_TYPE type,
+						    NotificationRule* rule,
+						    NotificationDelivery* delivery);
 		void			lockInstances() { m_instancesMutex.lock(); };
 		void			unlockInstances() { m_instancesMutex.unlock(); };
 		bool			getConfigurationItems(const ConfigCategory& config,
@@ -270,8 +338,49 @@ class NotificationManager
 		bool			auditNotification(const std::string& notification,
 							  const std::string& reason);
 		bool			APIdeleteInstance(const string& instanceName);
+		const NotificationStats&
+					getStats() const { return m_stats; };
 		void			updateSentStats() { m_stats.sent++; };
-		void			collectZombies();
+		void			updateDiscardedStats(unsigned int num = 1) { m_stats.discarded += num; };
+		void			updateRejectedStats() { m_stats.rejected++; };
+		void			addBufferStats(unsigned long readings, unsigned long bytes)
+		{
+			m_stats.bufferedReadings += readings;
+			m_stats.bufferedBytes += bytes;
+		};
+		void			removeBufferStats(unsigned long readings, unsigned long bytes)
+		{
+			m_stats.bufferedReadings -= readings;
+			m_stats.bufferedBytes -= bytes;
+		};
+		void			updateDroppedStats(const std::string& assetName,
+							   unsigned long readings)
+		{
+			m_stats.addDropped(assetName, readings);
+		};
+		void			updateLatencyStats(unsigned int lane,
+							   unsigned long latency)
+		{
+			m_stats.addLatency(lane, latency);
+		};
+		void			updateEvictedStats(unsigned long readings, unsigned long bytes)
+		{
+			m_stats.evictedReadings += readings;
+			m_stats.evictedBytes += bytes;
+		};
+		void			updateSpilledStats(unsigned long readings)
+		{
+			m_stats.spilledReadings += readings;
+		};
+		void			updateCoalescingStats(unsigned long elements)
+		{
+			m_stats.processedElements += elements;
+			m_stats.processedBatches++;
+		};
+		// Instances found by a reader are not deleted
+		// until it leaves the returned epoch
+		unsigned long		addInstancesUser();
+		void			removeInstancesUser(unsigned long epoch);
 
 	private:
 		PLUGIN_HANDLE		loadRulePlugin(const std::string& rulePluginName);
@@ -279,13 +388,11 @@ class NotificationManager
 		RulePlugin*		findBuiltinRule(const std::string& rulePluginName);
 		template<typename T> void
 					registerBuiltinRule(const std::string& ruleName);
-		void			addInstance(const std::string& instanceName,
-						    bool enable,
-						    NOTIFICATION_TYPE type,
-						    NotificationRule* rule,
-						    NotificationDelivery* delivery);
 		RulePlugin*		createRulePlugin(const std::string& rulePluginName);
 		DeliveryPlugin*		createDeliveryPlugin(const std::string& deliveryPluginName);
+		void			publishInstances();
+		void			retireInstance(NotificationInstance* instance);
+		void			reclaimInstances();
 
 	public:
 		std::mutex		m_instancesMutex;
@@ -297,10 +404,25 @@ class NotificationManager
 		ManagementClient* 	m_managerClient;
 		std::map<std::string, NotificationInstance *>
 					m_instances;
+		// Copy of m_instances for lock free lookups,
+		// replaced on each m_instances change
+		std::shared_ptr<const INSTANCES_TABLE>
+					m_instancesTable;
 		std::map<std::string, BUILTIN_RULE_FN>
 					m_builtinRules;
 		NotificationService*	m_service;
 		Logger*			m_logger;
 		NotificationStats	m_stats;
+		// Reclamation epoch and number of readers per epoch parity
+		std::atomic<unsigned long>
+					m_epoch;
+		std::atomic<unsigned long>
+					m_epochUsers[2];
+		// Removed instances and their retire epoch, not deleted yet
+		std::mutex		m_retiredMutex;
+		std::vector<std::pair<unsigned long, NotificationInstance *>>
+					m_retired;
+		std::atomic<unsigned long>
+					m_retiredCount;
 };
 #endif
@@ -11,36 +11,213 @@
  */
 
 #include <logger.h>
-#include <queue>
+#include <deque>
+#include <atomic>
+#include <memory>
 #include <condition_variable>
 #include <rule_plugin.h>
 #include <delivery_plugin.h>
 #include <reading_set.h>
 #include <notification_subscription.h>
+#include <evaluation_pool.h>
+#include <element_ring.h>
+#include <slab_pool.h>
+#include <symbol_table.h>
+#include <window_columns.h>
+#include <window_spill.h>
+#include <unordered_map>
+
+// Number of elements in the ring of a queue shard
+#define QUEUE_SHARD_RING_SIZE	4096
+// Times a lane with data can be skipped for higher priority lanes
+#define QUEUE_LANE_MAX_SKIPS	16
+// Interval of the check of windows of quiet assets, in milliseconds
+#define QUEUE_WINDOW_FLUSH_MS	1000
 
 class ResultData;
 class AssetData;
 
+/**
+ * Immutable readings shared by the per rule buffers.
+ *
+ * All the rule buffers fed with the same data hold the same object:
+ * readings are deleted when the last buffer element using them is removed.
+ * A view holds a subset of the readings of its owner, without copies.
+ */
+class SharedReadings
+{
+	public:
+		SharedReadings(const std::vector<Reading *>& readings);
+		SharedReadings(const std::vector<Reading *>& readings,
+			       const std::shared_ptr<const SharedReadings>& owner);
+		~SharedReadings();
+		const std::vector<Reading *>&
+					getReadings() const { return m_readings; };
+
+	private:
+		const std::vector<Reading *>
+					m_readings;
+		// Owner of the readings of a view, empty if readings are owned
+		const std::shared_ptr<const SharedReadings>
+					m_owner;
+		// Estimated memory size of owned readings data
+		unsigned long		m_size;
+};
+
 /**
  * Class that represents the notification data stored in the per rule buffers.
  */
 class NotificationDataElement
 {
 	public:
-		NotificationDataElement(const std::string& asset,
-					const std::string& rule,
-					ReadingSet* data);
+		NotificationDataElement(SYMBOL_ID rule,
+					SYMBOL_ID asset,
+					const std::shared_ptr<const SharedReadings>& data);
 		~NotificationDataElement();
-		const std::string&	getAssetName() { return m_asset; };
-		const std::string&	getRuleName() { return m_ruleName; };
-		ReadingSet*		getData() { return m_data; };
+		// Elements are allocated from a slab pool
+		static void*		operator new(size_t size);
+		static void		operator delete(void* p, size_t size);
+		static SlabPool&	getPool();
+		SYMBOL_ID		getAssetId() { return m_asset; };
+		SYMBOL_ID		getRuleId() { return m_rule; };
+		const std::string&	getAssetName()
+		{
+			return SymbolTable::getInstance()->getName(m_asset);
+		};
+		const std::string&	getRuleName()
+		{
+			return SymbolTable::getInstance()->getName(m_rule);
+		};
+		// Readings must not be modified: they are shared
+		ReadingSet*		getData() { return &m_data; };
+		const std::shared_ptr<const SharedReadings>&
+					getShared() { return m_shared; };
 		time_t			getTime() { return m_time; };
+		// Oldest and newest reading user timestamps in microseconds
+		uint64_t		getFirstTime() { return m_firstTime; };
+		uint64_t		getLastTime() { return m_lastTime; };
+		// Estimated size of the readings data
+		unsigned long		getSize() { return m_size; };
 
 	private:
-		const std::string	m_asset;
-		const std::string	m_ruleName;
-		ReadingSet*		m_data;
+		const SYMBOL_ID		m_asset;
+		const SYMBOL_ID		m_rule;
+		// Not owned readings of m_shared
+		ReadingSet		m_data;
+		std::shared_ptr<const SharedReadings>
+					m_shared;
 		time_t			m_time;
+		uint64_t		m_firstTime;
+		uint64_t		m_lastTime;
+		unsigned long		m_size;
+};
+
+// Buffered data of an asset, oldest first:
+// appends don't move elements and trimming the front is constant time
+typedef std::deque<NotificationDataElement *> RULE_BUFFER_DATA;
+
+/**
+ * This class represents the per rule data container.
+ * Notification data stored in a deque, per asset identifier.
+ *
+ * The size of buffered data is accounted per asset
+ * and for all the rule buffers.
+ *
+ * The rule mutex protects the rule data
+ * while it is fed and processed.
+ */
+class NotificationDataBuffer
+{
+	public:
+		NotificationDataBuffer() : m_bytes(0) {};
+		~NotificationDataBuffer();
+
+		// Add data into m_assetData[asset], in first reading time order
+		void	append(SYMBOL_ID asset,
+			       NotificationDataElement* data);
+		// Add back a part of removed m_assetData[asset] data,
+		// its readings must already be in the asset columns
+		void	reinsert(SYMBOL_ID asset,
+				 NotificationDataElement* data);
+		// Newest reading time of the asset data
+		uint64_t	getLastTime(SYMBOL_ID asset);
+		// Time the asset data was last appended
+		uint64_t	getArrivalTime(SYMBOL_ID asset);
+		// Return m_assetData[asset] data,
+		// elements must be added and removed with the methods above and below
+		RULE_BUFFER_DATA&
+			getData(SYMBOL_ID asset)
+		{
+			return m_assetData[asset];
+		};
+		// Delete oldest m_assetData[asset] data, keeping num elements
+		unsigned long	keep(SYMBOL_ID asset,
+				     unsigned long num);
+		// Remove data until the rule buffer and all the rule buffers
+		// are within the given sizes, 0 means no limit
+		bool		evict(unsigned long maxBytes,
+				      unsigned long maxTotalBytes,
+				      unsigned long added,
+				      E_BUFFER_EVICTION policy,
+				      unsigned long& readings,
+				      unsigned long& bytes);
+		// Size of buffered data
+		unsigned long	getBytes() const { return m_bytes; };
+		unsigned long	getAssetBytes(SYMBOL_ID asset);
+		static unsigned long
+				getTotalBytes() { return m_totalBytes; };
+		// Assets with buffered data
+		void		getAssets(std::vector<SYMBOL_ID>& assets);
+		// Keep or drop numeric datapoint columns of an asset
+		// with running aggregates of windows of the given interval
+		void		setColumns(SYMBOL_ID asset,
+					   bool enable,
+					   uint64_t intervalUs);
+		// Return valid columns of an asset or NULL
+		WindowColumns*	getColumns(SYMBOL_ID asset);
+		// Remove column data not newer than time
+		void		trimColumns(SYMBOL_ID asset, uint64_t time);
+		// Move the oldest data of an asset above the given size
+		// into spill files
+		unsigned long	spill(SYMBOL_ID asset, unsigned long maxBytes);
+		// Return the spilled data of an asset or NULL
+		WindowSpill*	getSpill(SYMBOL_ID asset);
+		// Remove spilled data not newer than time
+		void		trimSpill(SYMBOL_ID asset, uint64_t time);
+		// Return the rule mutex
+		std::mutex&	getMutex() { return m_ruleMutex; };
+
+	private:
+		void		insert(SYMBOL_ID asset,
+				       NotificationDataElement* data);
+		void		setLastTime(SYMBOL_ID asset);
+		unsigned long	release(SYMBOL_ID asset,
+					NotificationDataElement* data);
+		unsigned long	downsample(SYMBOL_ID asset);
+		void		buildColumns(SYMBOL_ID asset);
+
+	private:
+		std::mutex	m_ruleMutex;
+		std::unordered_map<SYMBOL_ID, RULE_BUFFER_DATA>
+			m_assetData;
+		std::unordered_map<SYMBOL_ID, unsigned long>
+			m_assetBytes;
+		// Newest reading time of the buffered and spilled asset data
+		std::unordered_map<SYMBOL_ID, uint64_t>
+			m_assetLastTime;
+		// Time the asset data was last appended
+		std::unordered_map<SYMBOL_ID, uint64_t>
+			m_assetArrival;
+		// Columns of the assets evaluated by windows
+		std::unordered_map<SYMBOL_ID, WindowColumns>
+			m_columns;
+		// Oldest data of the assets in long windows
+		std::unordered_map<SYMBOL_ID, WindowSpill *>
+			m_spills;
+		unsigned long	m_bytes;
+		// Size of data in all the rule buffers
+		static std::atomic<unsigned long>
+			m_totalBytes;
 };
 
 /**
@@ -56,79 +233,144 @@ class NotificationQueueElement
 
 		const std::string&	getAssetName() { return m_assetName; };
 		ReadingSet*		getAssetData() { return m_readings; };
-		void			queuedTimeCheck()
-					{
-						time_t now = time(0);
-						if (now - m_qTime > 5)
-						{
-							Logger::getLogger()->info("Notification data queued for %d seconds", now - m_qTime);
-						}
-						if (m_readings->getCount() > 0)
-						{
-							time_t readingT = (*m_readings)[0]->getUserTimestamp();
-							if (now - readingT > 10)
-							{
-								Logger::getLogger()->info("Notification data oldest reading is %d seconds old", now - readingT);
-							}
-						}
-					};
+		unsigned long		getSize() const { return m_size; };
+		time_t			getQueuedTime() const { return m_qTime; };
+		// Queued time of the newest merged element
+		time_t			getNewestQueuedTime() const { return m_newestQTime; };
+		// Queued time of each reading, empty if no element is merged
+		std::vector<time_t>&	getQueuedTimes() { return m_queuedTimes; };
+		// Monotonic queued time in microseconds
+		uint64_t		getQueuedTimeUs() const { return m_qTimeUs; };
+		unsigned int		getLane() const { return m_lane; };
+		void			setLane(unsigned int lane) { m_lane = lane; };
+		// Move the readings of a newer element of the same asset
+		void			merge(NotificationQueueElement* element);
+		unsigned long		getMerged() const { return m_merged; };
+		// Datapoints kept when readings were received,
+		// empty means all datapoints
+		const std::vector<std::string>&
+					getDatapoints() const { return m_datapoints; };
+		void			setDatapoints(const std::vector<std::string>& datapoints)
+		{
+			m_datapoints = datapoints;
+		};
+		static unsigned long	getReadingSize(Reading* reading);
 
 	private:
 		std::string		m_assetName;
 		ReadingSet*		m_readings;
 		time_t			m_qTime;
+		time_t			m_newestQTime;
+		std::vector<time_t>	m_queuedTimes;
+		uint64_t		m_qTimeUs;
+		// Priority lane of the queue shard
+		unsigned int		m_lane;
+		// Estimated memory size of readings data
+		unsigned long		m_size;
+		// Number of merged elements
+		unsigned long		m_merged;
+		std::vector<std::string>
+					m_datapoints;
 };
 
 /**
  * The NotificationQueue class.
  *
  * This class handles the notification items received,
- * storing data into a std::queue and the processing them.
+ * storing data into per worker lock-free rings and the processing them.
+ *
+ * Each worker thread owns a shard of the queue: data of an asset
+ * always goes to the same shard, so it is processed in order.
+ * Rules with assets in different shards are serialized
+ * by the per rule buffer lock.
+ *
+ * Each shard has one lane per notification priority: data of
+ * an asset goes to the lane of its highest priority notification.
+ * Lanes are served by priority, a lane with data is served
+ * after being skipped QUEUE_LANE_MAX_SKIPS times.
+ *
+ * The rules of an asset are evaluated concurrently
+ * by the evaluation pool threads.
  */
 class NotificationQueue
 {
 	public:
-		NotificationQueue(const std::string& serviceName);
+		NotificationQueue(const std::string& serviceName,
+				  unsigned long numWorkers = 1,
+				  unsigned long numEvalWorkers = 0);
 		~NotificationQueue();
 
 		static NotificationQueue*
 					getInstance() { return m_instance; };
 		const std::string&	getName() const { return m_name; };
-		bool			addElement(NotificationQueueElement* element);
-		void			process();
+		bool			addElement(NotificationQueueElement* element,
+						   bool* full = NULL);
+		bool			addElements(std::vector<NotificationQueueElement *>& elements,
+						    bool* full = NULL);
+		void			process(unsigned long shard);
 		bool			isRunning() const { return m_running; };
 		void			stop();
+		void			setLimits(unsigned long maxReadings,
+						  unsigned long maxBytes);
+		void			setBufferBudget(unsigned long maxBytes);
+		void			setSpillDirectory(const std::string& directory);
+		std::string		getJSONBuffers();
+		bool			isFull();
 		void			clearBufferData(const std::string& ruleName,
 							const std::string& assetName);
+		NotificationDataBuffer*	getRuleBuffer(const std::string& ruleName);
+		NotificationDataBuffer*	getRuleBuffer(SYMBOL_ID rule);
 
 	private:
+		class QueueShard;
+		QueueShard*		getShard(const std::string& assetName);
+		bool			push(NotificationQueueElement* element);
+		bool			takeElements(QueueShard* shard);
+		void			takeRing(QueueShard* shard);
+		void			flushWindows(QueueShard* shard);
+		unsigned int		getLane(const SubscriptionRoutes& routes,
+						const std::string& assetName);
+		unsigned int		selectLane(QueueShard* shard);
 		void			processDataSet(NotificationQueueElement* data);
-		bool			feedAllDataBuffers(NotificationQueueElement* data);
-		void			processAllDataBuffers(const std::string& assetName);
-		bool			feedDataBuffer(const std::string& ruleName,
-						       const std::string& assetName,
-						       ReadingSet* assetData);
+		void			coalesce(NotificationQueueElement* data);
+		bool			feedAllDataBuffers(NotificationQueueElement* data,
+							   const std::vector<SubscriptionRoute>& routes);
+		void			processAllDataBuffers(const std::string& assetName,
+							      const std::vector<SubscriptionRoute>& routes);
+		void			processSubscription(const std::string& assetName,
+							    const SubscriptionRoute& route);
+		NotificationDataBuffer*	getRouteBuffer(const SubscriptionRoute& route);
+		bool			feedDataBuffer(NotificationDataBuffer* buffer,
+						       const SubscriptionRoute& route,
+						       const std::shared_ptr<const SharedReadings>& readings,
+						       const NOTIFICATION_TYPE& type);
 		bool			processDataBuffer(std::map<std::string, AssetData>&,
-							  const std::string&ruleName,
-							  const std::string& assetName,
+							  NotificationDataBuffer* buffer,
 							  NotificationDetail& element);
-		std::vector<NotificationDataElement*>&
-					getBufferData(const std::string& ruleName,
-						      const std::string& assetName);
-		void 			keepBufferData(const std::string& ruleName,
-						       const std::string& assetName,
+		void			clearRuleBufferData(SYMBOL_ID rule,
+							    SYMBOL_ID asset);
+		void 			keepBufferData(SYMBOL_ID rule,
+						       SYMBOL_ID asset,
 						       unsigned long num);
 		bool			processAllReadings(NotificationDetail& info,
-							   std::vector<NotificationDataElement *>& readingsData,
+							   NotificationDataBuffer* buffer,
+							   RULE_BUFFER_DATA& readingsData,
 							   std::map<std::string, AssetData>& results);
 		void			evalRule(std::map<std::string, AssetData>& results,
-						 NotificationRule* rule);
+						 NotificationInstance* instance);
 		std::string		processLastBuffer(NotificationDataElement* data);
 		void			sendNotification(std::map<std::string, AssetData>& results,
-							 SubscriptionElement& subscription);
-		void			processAllBuffers(std::vector<NotificationDataElement *>& readingsData,
+							 NotificationInstance* instance);
+		bool			windowComplete(NotificationDataBuffer* buffer,
+						       RULE_BUFFER_DATA& readingsData,
+						       uint64_t intervalUs,
+						       uint64_t& endTime);
+		bool			windowsReady(NotificationDataBuffer* buffer,
+						     const std::vector<NotificationDetail>& assets);
+		void			processAllBuffers(NotificationDataBuffer* buffer,
+							  RULE_BUFFER_DATA& readingsData,
 							  EvaluationType::EVAL_TYPE type,
-							  unsigned long timeInterval,
+							  uint64_t intervalUs,
 							  std::map<std::string, std::string>& result);
 		void			setValue(std::map<std::string, ResultData>& result,
 						 Datapoint* d,
@@ -142,57 +384,112 @@ class NotificationQueue
 		void			setSumValues(std::map<std::string, ResultData>& result,
 						    const std::string& key,
 						    DatapointValue& val);
-		void			aggregateData(std::vector<NotificationDataElement *>& readingsData,
+		void			aggregateData(RULE_BUFFER_DATA& readingsData,
 						      unsigned long size,
+						      uint64_t endTime,
 						      EvaluationType::EVAL_TYPE type,
+						      const WindowSpill* spill,
 						      std::map<std::string, std::string>& result);
-		void			setSingleItemData(vector<NotificationDataElement *>& readingsData,
+		void			setSingleItemData(RULE_BUFFER_DATA& readingsData,
 							  map<string, AssetData>& results);
 
 	private:
 		/**
-		 * This class represents the per rule data container.
-		 * Notification data stored ias vector, per asset name.
+		 * This class represents a queue shard, processed by one worker thread.
+		 *
+		 * Producers add elements to the ring without locks: the mutex
+		 * and condition variable are only used to wake up the worker
+		 * thread when it is waiting for data.
 		 */
-		class NotificationDataBuffer
+		class QueueShard
 		{
 			public:
-				NotificationDataBuffer() {};
-				~NotificationDataBuffer() {};
-
-				// Append data into m_assetData[assetName]
-				void append(const std::string& assetName,
-					NotificationDataElement* data)
+				QueueShard() : m_thread(NULL),
+					       m_ring(QUEUE_SHARD_RING_SIZE),
+					       m_sleeping(false),
+					       m_flushed(0)
+				{
+					for (int i = 0; i < NOTIFICATION_PRIORITIES; i++)
+					{
+						m_skipped[i] = 0;
+					}
+				};
+				~QueueShard()
 				{
-					m_assetData[assetName].push_back(data);
+					delete m_thread;
+					// Remove data not processed
+					NotificationQueueElement* element;
+					while (m_ring.pop(element))
+					{
+						delete element;
+					}
+					for (int i = 0; i < NOTIFICATION_PRIORITIES; i++)
+					{
+						for (auto e = m_lanes[i].begin(); e != m_lanes[i].end(); ++e)
+						{
+							delete *e;
+						}
+					}
 				};
-				// Return m_assetData[assetName] data
-				std::vector<NotificationDataElement*>&
-					getData(const std::string& assetName)
+				// Number of elements in all the lanes
+				unsigned long		getSize() const
 				{
-					return m_assetData[assetName];
+					unsigned long size = 0;
+					for (int i = 0; i < NOTIFICATION_PRIORITIES; i++)
+					{
+						size += m_lanes[i].size();
+					}
+					return size;
 				};
 
-			private:
-				std::map<std::string, std::vector<NotificationDataElement*>>
-					m_assetData;
+				std::thread*		m_thread;
+				// Received notifications
+				ElementRing		m_ring;
+				// Set while the worker thread waits for data
+				std::atomic<bool>	m_sleeping;
+				std::mutex		m_qMutex;
+				std::condition_variable	m_processCv;
+				// Notifications taken from the ring, per priority
+				// lane, used by the worker thread only
+				std::deque<NotificationQueueElement *>
+							m_lanes[NOTIFICATION_PRIORITIES];
+				// Times each lane with data was not served
+				unsigned int		m_skipped[NOTIFICATION_PRIORITIES];
+				// Element of each asset in the lanes,
+				// newer data of the asset is merged into it
+				std::unordered_map<std::string, NotificationQueueElement *>
+							m_queued;
+				// Time of the last check of windows of quiet assets
+				uint64_t		m_flushed;
 		};
 
 		const std::string	m_name;
 		static NotificationQueue*
 					m_instance;
-		bool			m_running;
-		std::thread*		m_queue_thread;
-		std::mutex		m_qMutex;
-		std::condition_variable	m_processCv;
-		// Queue for received notifications
-		std::queue<NotificationQueueElement *>
-                                        m_queue;
-		// Per rule priocess buffers
-		std::map<std::string, NotificationDataBuffer>
+		std::atomic<bool>	m_running;
+		// Queue shards, one per worker thread
+		std::vector<QueueShard *>
+					m_shards;
+		// Rule evaluation threads
+		EvaluationPool*		m_evaluations;
+		// Per rule process buffers, by interned rule name:
+		// buffers never move
+		std::unordered_map<SYMBOL_ID, NotificationDataBuffer>
 					m_ruleBuffers;
 		Logger*                 m_logger;
 		std::mutex		m_bufferMutex;
+		// Queued data in all shards and high-water marks (0 means no limit)
+		std::atomic<unsigned long>
+					m_queuedReadings;
+		std::atomic<unsigned long>
+					m_queuedBytes;
+		std::atomic<unsigned long>
+					m_maxReadings;
+		std::atomic<unsigned long>
+					m_maxBytes;
+		// Memory budget of all the rule buffers (0 means no limit)
+		std::atomic<unsigned long>
+					m_bufferMaxBytes;
 };
 
 /**
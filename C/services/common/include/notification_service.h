@@ -21,6 +21,13 @@
 #define SERVICE_TYPE			"Notification"
 #define NOTIFICATION_CATEGORY		"NOTIFICATION"
 #define DEFAULT_DELIVERY_WORKER_THREADS 2
+#define DEFAULT_API_THREADS		2
+#define DEFAULT_QUEUE_WORKER_THREADS	2
+#define DEFAULT_EVALUATION_WORKER_THREADS 2
+// Notification queue high-water marks, 0 means no limit
+#define DEFAULT_QUEUE_MAX_READINGS	100000
+#define DEFAULT_QUEUE_MAX_BYTES		(100 * 1024 * 1024)
+#define DEFAULT_BUFFERS_MAX_BYTES	(256 * 1024 * 1024)
 /**
  * The NotificationService class.
  */
@@ -37,6 +44,7 @@ class NotificationService : public ServiceHandler
 		void			configChange(const std::string&,
 						     const std::string&);
 		void			registerCategory(const std::string& categoryName);
+		void			setQueueLimits(ConfigCategory& category);
 		void			ingestReading(Reading& reading)
 					{
 						m_storage->readingAppend(reading);
@@ -55,5 +63,10 @@ class NotificationService : public ServiceHandler
 		std::map<std::string, bool>
 					m_registerCategories;
 		unsigned long		m_delivery_threads;
+		unsigned long		m_queue_threads;
+		unsigned long		m_evaluation_threads;
+		unsigned long		m_queue_max_readings;
+		unsigned long		m_queue_max_bytes;
+		unsigned long		m_buffers_max_bytes;
 };
 #endif
@@ -13,6 +13,12 @@
 #include <json_provider.h>
 #include <string>
 #include <sstream>
+#include <atomic>
+#include <map>
+#include <mutex>
+
+// Notification priorities, one notification queue lane each
+#define NOTIFICATION_PRIORITIES	3
 
 class NotificationStats : public JSONProvider {
 	public:
@@ -23,26 +29,148 @@ class NotificationStats : public JSONProvider {
 			removed = 0;
 			total = 0;
 			sent = 0;
+			discarded = 0;
+			rejected = 0;
+			bufferedReadings = 0;
+			bufferedBytes = 0;
+			evictedReadings = 0;
+			evictedBytes = 0;
+			spilledReadings = 0;
+			processedElements = 0;
+			processedBatches = 0;
+			for (int i = 0; i < NOTIFICATION_PRIORITIES; i++)
+			{
+				laneElements[i] = 0;
+				laneLatency[i] = 0;
+				laneMaxLatency[i] = 0;
+			}
+		};
+		// Count the queue latency of an element of a priority lane
+		void	addLatency(unsigned int lane,
+				   unsigned long latency)
+		{
+			laneElements[lane]++;
+			laneLatency[lane] += latency;
+			unsigned long max = laneMaxLatency[lane];
+			while (latency > max &&
+			       !laneMaxLatency[lane].compare_exchange_weak(max, latency));
+		};
+		// Count stale readings dropped for an asset
+		void	addDropped(const std::string& assetName,
+				   unsigned long readings)
+		{
+			std::lock_guard<std::mutex> guard(m_droppedMutex);
+			m_dropped[assetName] += readings;
+		};
+		// Stale readings dropped for an asset
+		unsigned long	getDropped(const std::string& assetName) const
+		{
+			std::lock_guard<std::mutex> guard(m_droppedMutex);
+			auto d = m_dropped.find(assetName);
+			return d != m_dropped.end() ? (*d).second : 0;
 		};
 		void	asJSON(std::string& json) const
 		{
 			std::ostringstream convert;
 
-			convert << "{ \"sentNotifications\" : " << sent << ", ";
+			convert << "{ \"sentNotifications\" : " << sent.load() << ", ";
 			convert << "\"loadedInstances\" : " << loaded << ", ";
 			convert << "\"createdInstances\" : " << created << ", ";
 			convert << "\"removedInstances\" : " << removed << ", ";
-			convert << "\"totalInstances\" : " << total << " }";
+			convert << "\"totalInstances\" : " << total << ", ";
+			convert << "\"discardedCallbacks\" : " << discarded.load() << ", ";
+			convert << "\"rejectedCallbacks\" : " << rejected.load() << ", ";
+			unsigned long readings = bufferedReadings.load();
+			unsigned long bytes = bufferedBytes.load();
+			convert << "\"bufferedReadings\" : " << readings << ", ";
+			convert << "\"bufferedBytes\" : " << bytes << ", ";
+			convert << "\"bytesPerBufferedReading\" : " << (readings ? bytes / readings : 0) << ", ";
+			convert << "\"evictedReadings\" : " << evictedReadings.load() << ", ";
+			convert << "\"evictedBytes\" : " << evictedBytes.load() << ", ";
+			convert << "\"spilledReadings\" : " << spilledReadings.load() << ", ";
+			unsigned long batches = processedBatches.load();
+			convert << "\"coalescingRatio\" : " <<
+				(batches ? (double)processedElements.load() / batches : 0) << ", ";
+
+			static const char* lanes[NOTIFICATION_PRIORITIES] = { "high", "normal", "low" };
+			convert << "\"queueLatency\" : { ";
+			for (int i = 0; i < NOTIFICATION_PRIORITIES; i++)
+			{
+				unsigned long elements = laneElements[i].load();
+				convert << "\"" << lanes[i] << "\" : { ";
+				convert << "\"elements\" : " << elements << ", ";
+				convert << "\"averageUs\" : " <<
+					(elements ? laneLatency[i].load() / elements : 0) << ", ";
+				convert << "\"maxUs\" : " << laneMaxLatency[i].load() << " }";
+				convert << (i < NOTIFICATION_PRIORITIES - 1 ? ", " : " }, ");
+			}
+
+			std::lock_guard<std::mutex> guard(m_droppedMutex);
+			unsigned long total = 0;
+			std::ostringstream assets;
+			for (auto d = m_dropped.begin(); d != m_dropped.end(); ++d)
+			{
+				if (d != m_dropped.begin())
+				{
+					assets << ", ";
+				}
+				assets << "\"" << (*d).first << "\" : " << (*d).second;
+				total += (*d).second;
+			}
+			convert << "\"droppedReadings\" : " << total << ", ";
+			convert << "\"droppedAssetReadings\" : { " << assets.str() << " } }";
 
 			json = convert.str();
 		};
 
 	public:
-		unsigned int	sent;		// Sent notifications
+		std::atomic<unsigned int>
+				sent;		// Sent notifications,
+						// updated by all the evaluation threads
 		unsigned int	created;	// Created instances via API
 		unsigned int	removed;	// Removed instances via API
 		unsigned int	loaded;		// Loaded instances
 						// found in Notifications category
 		unsigned int	total;		// Total instances
+		// Reading callbacks counters, updated by all the API threads
+		std::atomic<unsigned int>
+				discarded;	// Reading callbacks dropped for assets
+						// without enabled notifications
+		std::atomic<unsigned int>
+				rejected;	// Reading callbacks rejected
+						// with notification queue full
+		// Readings data in the per rule buffers
+		std::atomic<unsigned long>
+				bufferedReadings;
+		std::atomic<unsigned long>
+				bufferedBytes;
+		// Rule buffers data removed above the memory budgets
+		std::atomic<unsigned long>
+				evictedReadings;
+		std::atomic<unsigned long>
+				evictedBytes;
+		// Rule buffers data moved into spill files
+		std::atomic<unsigned long>
+				spilledReadings;
+		// Queue elements merged into processed batches
+		std::atomic<unsigned long>
+				processedElements;
+		std::atomic<unsigned long>
+				processedBatches;
+		// Per priority lane queue elements and queue latency
+		// in microseconds, updated by all the queue workers
+		std::atomic<unsigned long>
+				laneElements[NOTIFICATION_PRIORITIES];
+		std::atomic<unsigned long>
+				laneLatency[NOTIFICATION_PRIORITIES];
+		std::atomic<unsigned long>
+				laneMaxLatency[NOTIFICATION_PRIORITIES];
+
+	private:
+		// Per asset stale readings dropped
+		std::map<std::string, unsigned long>
+				m_dropped;
+		mutable std::mutex
+				m_droppedMutex;
 };
 #endif
@@ -14,6 +14,10 @@
 #include <management_client.h>
 #include <storage_client.h>
 #include <notification_manager.h>
+#include <unordered_map>
+#include <memory>
+
+class NotificationDataBuffer;
 
 /**
  * The SubscriptionElement class handles the notification registration to
@@ -45,11 +49,58 @@ class SubscriptionElement
 				return NULL;
 		};
 		NotificationInstance*	getInstance() { return m_notification; };
+		// Datapoints needed by the rule, empty means all datapoints
+		const std::vector<std::string>&
+					getDatapoints() const { return m_datapoints; };
+		void			setDatapoints(const std::vector<std::string>& datapoints)
+		{
+			m_datapoints = datapoints;
+		};
 
 	private:
 		std::string	m_asset;
 		std::string	m_name;
 		NotificationInstance*	m_notification;
+		std::vector<std::string>
+				m_datapoints;
+};
+
+/**
+ * A pre-resolved subscription of an asset:
+ * notification instance, rule name, rule data buffers
+ * and datapoints needed by the rule.
+ */
+class SubscriptionRoute
+{
+	public:
+		std::string		notificationName;
+		NotificationInstance*	instance;
+		std::string		ruleName;
+		// Interned asset and rule names
+		SYMBOL_ID		assetId;
+		SYMBOL_ID		ruleId;
+		// NULL if the queue did not exist when routes were built
+		NotificationDataBuffer*	buffer;
+		// Datapoints needed by the rule, empty means all datapoints
+		std::vector<std::string>
+					datapoints;
+		// The rule evaluates the asset by time windows
+		bool			window;
+};
+
+/**
+ * Immutable routing table of subscriptions, per asset name.
+ *
+ * A new table is built and published when subscriptions
+ * or notification instances change: readers use the table
+ * they have loaded without locks.
+ */
+class SubscriptionRoutes
+{
+	public:
+		unsigned long		version;
+		std::unordered_map<std::string, std::vector<SubscriptionRoute>>
+					assets;
 };
 
 /**
@@ -72,11 +123,15 @@ class NotificationSubscription
 		const std::string&	getNotificationName() { return m_name; };
 		std::map<std::string, std::vector<SubscriptionElement>>&
 					getAllSubscriptions() { return m_subscriptions; };
-		std::vector<SubscriptionElement>&
-					getSubscription(const std::string& assetName)
+		std::shared_ptr<const SubscriptionRoutes>
+					getRoutes()
 		{
-			return m_subscriptions[assetName];
+			return std::atomic_load(&m_routes);
 		};
+		void			updateRoutes();
+		bool			hasActiveSubscription(const std::string& assetName);
+		void			getDatapointsMask(const std::string& assetName,
+							  std::vector<std::string>& datapoints);
 		bool 			addSubscription(const std::string& assetName,
 							SubscriptionElement& element);
 		void			unregisterSubscription(const std::string& assetName);
@@ -88,6 +143,7 @@ class NotificationSubscription
 
 	private:
 		EvaluationType		getEvalType(const Value& value);
+		void			buildRoutes();
 
 	private:
 		const std::string	m_name;
@@ -99,6 +155,10 @@ class NotificationSubscription
 					m_subscriptions;
 		Logger*			m_logger;
 		std::mutex		m_subscriptionMutex;
+		// Published routing table and its version
+		std::shared_ptr<const SubscriptionRoutes>
+					m_routes;
+		unsigned long		m_routesVersion;
 };
 
 #endif
@@ -0,0 +1,110 @@
+#ifndef _SLAB_POOL_H
+#define _SLAB_POOL_H
+/*
+ * FogLAMP notification buffered data pools.
+ *
+ * Copyright (c) 2020 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Massimiliano Pinto
+ */
+
+#include <cstddef>
+#include <new>
+#include <vector>
+#include <mutex>
+
+// Number of items allocated at once by a slab pool
+#define SLAB_POOL_ITEMS		256
+
+/**
+ * Pool of fixed size memory items.
+ *
+ * Items are allocated from slabs of SLAB_POOL_ITEMS items
+ * and released items are reused: the heap is used once per slab
+ * instead of once per item.
+ * Slabs are kept until the pool is destroyed.
+ */
+class SlabPool
+{
+	public:
+		SlabPool(size_t size, size_t items = SLAB_POOL_ITEMS);
+		~SlabPool();
+
+		void*			allocate();
+		void			release(void* item);
+		// Items allocated from the pool
+		unsigned long		getAllocations();
+		// Heap allocations done by the pool
+		unsigned long		getSlabs();
+		// Items in use
+		unsigned long		getUsed();
+
+	private:
+		/**
+		 * A free item, linked to the next free one
+		 */
+		class FreeItem
+		{
+			public:
+				FreeItem*	m_next;
+		};
+
+		size_t			m_size;
+		size_t			m_items;
+		std::mutex		m_mutex;
+		FreeItem*		m_free;
+		std::vector<char *>	m_slabs;
+		unsigned long		m_allocations;
+		unsigned long		m_used;
+};
+
+/**
+ * Allocator of single objects from a slab pool per type,
+ * arrays are allocated from the heap.
+ *
+ * Used with std::allocate_shared: the object and the shared pointer
+ * control block are allocated together from the pool.
+ */
+template<class T> class PoolAllocator
+{
+	public:
+		typedef T value_type;
+
+		PoolAllocator() {};
+		template<class U> PoolAllocator(const PoolAllocator<U>&) {};
+
+		T*			allocate(size_t n)
+		{
+			if (n == 1)
+			{
+				return static_cast<T *>(getPool().allocate());
+			}
+			return static_cast<T *>(::operator new(n * sizeof(T)));
+		};
+		void			deallocate(T* p, size_t n)
+		{
+			if (n == 1)
+			{
+				getPool().release(p);
+			}
+			else
+			{
+				::operator delete(p);
+			}
+		};
+		// The pool is not deleted: items may be released at exit
+		static SlabPool&	getPool()
+		{
+			static SlabPool* pool = new SlabPool(sizeof(T));
+			return *pool;
+		};
+};
+
+template<class T, class U>
+bool operator==(const PoolAllocator<T>&, const PoolAllocator<U>&) { return true; }
+template<class T, class U>
+bool operator!=(const PoolAllocator<T>&, const PoolAllocator<U>&) { return false; }
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef _SYMBOL_TABLE_H
+#define _SYMBOL_TABLE_H
+/*
+ * FogLAMP notification asset and rule names table.
+ *
+ * Copyright (c) 2020 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Massimiliano Pinto
+ */
+
+#include <string>
+#include <unordered_map>
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+
+// Dense integer identifier of an interned name
+typedef uint32_t SYMBOL_ID;
+
+// Names per chunk of the names table and maximum number of chunks
+#define SYMBOL_CHUNK_SIZE	1024
+#define SYMBOL_MAX_CHUNKS	4096
+
+/**
+ * Table of interned asset and rule names.
+ *
+ * Names are interned when configuration is loaded and get
+ * dense identifiers, starting from 0: data is then indexed by
+ * identifier instead of hashing and copying names.
+ *
+ * Names are never removed. Getting the name of an identifier
+ * doesn't lock: names are stored in chunks which never move.
+ */
+class SymbolTable
+{
+	public:
+		static SymbolTable*	getInstance();
+
+		SYMBOL_ID		intern(const std::string& name);
+		bool			find(const std::string& name,
+					     SYMBOL_ID& id);
+		const std::string&	getName(SYMBOL_ID id) const;
+		unsigned long		getSize() const { return m_size; };
+
+	private:
+		SymbolTable();
+		~SymbolTable();
+
+	private:
+		std::mutex		m_mutex;
+		std::unordered_map<std::string, SYMBOL_ID>
+					m_ids;
+		std::atomic<std::string *>
+					m_chunks[SYMBOL_MAX_CHUNKS];
+		std::atomic<unsigned long>
+					m_size;
+};
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef _WINDOW_COLUMNS_H
+#define _WINDOW_COLUMNS_H
+/*
+ * FogLAMP notification window columns.
+ *
+ * Copyright (c) 2020 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Massimiliano Pinto
+ */
+
+#include <reading.h>
+#include <notification_manager.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <stdint.h>
+
+/**
+ * Contiguous timestamps and values of a numeric datapoint,
+ * oldest first.
+ *
+ * Removed values are skipped by the head index,
+ * storage is compacted when half of it is not used.
+ * Minimum, maximum and sum of the values in the current window
+ * are updated as values are appended.
+ */
+class WindowColumn
+{
+	public:
+		WindowColumn() : m_integer(false), m_head(0) { resetWindow(); };
+		WindowColumn(bool integer) : m_integer(integer), m_head(0) { resetWindow(); };
+
+		bool			isInteger() const { return m_integer; };
+		void			append(uint64_t time, long value, bool window);
+		void			append(uint64_t time, double value, bool window);
+		void			trim(uint64_t time);
+		bool			aggregate(uint64_t time,
+						  EvaluationType::EVAL_TYPE type,
+						  long& intValue,
+						  double& doubleValue) const;
+		void			resetWindow();
+		void			openWindow(uint64_t end);
+		bool			getWindow(EvaluationType::EVAL_TYPE type,
+						  long& intValue,
+						  double& doubleValue) const;
+
+	private:
+		void			addWindow(long value);
+		void			addWindow(double value);
+
+	private:
+		bool			m_integer;
+		std::vector<uint64_t>	m_times;
+		std::vector<long>	m_ints;
+		std::vector<double>	m_doubles;
+		size_t			m_head;
+		// Running aggregates of the current window
+		size_t			m_windowValues;
+		long			m_intMin;
+		long			m_intMax;
+		long			m_intSum;
+		double			m_doubleMin;
+		double			m_doubleMax;
+		double			m_doubleSum;
+};
+
+/**
+ * Columnar store of the numeric datapoints of the
+ * buffered readings of an asset, for Minimum, Maximum and Average
+ * window evaluations: windows are aggregated and trimmed
+ * with linear scans of contiguous values.
+ *
+ * Readings must be appended in user timestamp order
+ * with the same numeric type per datapoint:
+ * otherwise the store is not valid and must be rebuilt.
+ *
+ * With a window interval the current window starts at the oldest
+ * reading: its aggregates are kept up to date by append and trim,
+ * so aggregating it does not scan the values.
+ */
+class WindowColumns
+{
+	public:
+		WindowColumns() : m_valid(true),
+				  m_head(0),
+				  m_intervalUs(0),
+				  m_windowOpen(false),
+				  m_windowEnd(0),
+				  m_windowReadings(0) {};
+
+		bool			isValid() const { return m_valid; };
+		void			setInterval(uint64_t intervalUs);
+		uint64_t		getInterval() const { return m_intervalUs; };
+		void			append(const std::vector<Reading *>& readings);
+		void			trim(uint64_t time);
+		void			clear();
+		void			aggregate(uint64_t time,
+						  EvaluationType::EVAL_TYPE type,
+						  std::map<std::string, std::string>& result) const;
+
+	private:
+		void			invalidate();
+		void			openWindow();
+
+	private:
+		bool			m_valid;
+		// Timestamps of all the readings, to count them
+		std::vector<uint64_t>	m_times;
+		size_t			m_head;
+		// Current window, 0 interval means no running aggregates
+		uint64_t		m_intervalUs;
+		bool			m_windowOpen;
+		uint64_t		m_windowEnd;
+		size_t			m_windowReadings;
+		std::map<std::string, WindowColumn>
+					m_columns;
+};
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef _WINDOW_SPILL_H
+#define _WINDOW_SPILL_H
+/*
+ * FogLAMP notification window spill files.
+ *
+ * Copyright (c) 2020 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Massimiliano Pinto
+ */
+
+#include <reading.h>
+#include <datapoint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <stdint.h>
+
+// Size of a spill file: header and records
+#define SPILL_SEGMENT_BYTES	(64 * 1024 * 1024)
+// Header with the datapoint names and types
+#define SPILL_HEADER_BYTES	4096
+#define SPILL_MAGIC		0x4c50534e
+#define SPILL_VERSION		1
+
+/**
+ * Spill file header, followed by the datapoint names:
+ * a type character, 'i' for integer or 'd' for float,
+ * and the NUL terminated name for each datapoint.
+ */
+struct SpillHeader
+{
+	uint32_t	magic;
+	uint32_t	version;
+	uint32_t	datapoints;
+	uint32_t	recordSize;
+	uint64_t	records;
+};
+
+/**
+ * Memory mapped file with the readings of an asset
+ * with the same numeric datapoints, in any order, oldest first.
+ *
+ * Each record has the reading user timestamp in microseconds
+ * and a 64 bits integer or float value per datapoint.
+ * The file is unlinked once mapped: it is removed
+ * when the segment is deleted or the service exits.
+ */
+class WindowSpillSegment
+{
+	public:
+		WindowSpillSegment();
+		~WindowSpillSegment();
+
+		bool			create(const std::string& directory,
+					       Reading* reading);
+		bool			matches(Reading* reading,
+						std::vector<size_t>& columns) const;
+		bool			isFull() const { return m_records == m_capacity; };
+		void			append(Reading* reading,
+					       uint64_t time,
+					       const std::vector<size_t>& columns);
+		void			truncate(size_t records);
+		bool			read(uint64_t time,
+					     const std::function<void(const std::vector<Datapoint *>&)>& callback);
+		void			trim(uint64_t time);
+		bool			empty() const { return m_head == m_records; };
+		size_t			getRecords() const { return m_records; };
+		size_t			getReadings() const { return m_records - m_head; };
+		size_t			getBytes() const { return (m_records - m_head) * m_recordSize; };
+		uint64_t		getFirstTime() const { return getTime(m_head); };
+		uint64_t		getLastTime() const { return getTime(m_records - 1); };
+		size_t			getMappedBytes() const { return m_mappedBytes; };
+
+	private:
+		uint64_t*		getRecord(size_t i) const
+					{
+						return (uint64_t *)(m_base + SPILL_HEADER_BYTES + i * m_recordSize);
+					};
+		uint64_t		getTime(size_t i) const { return getRecord(i)[0]; };
+
+	private:
+		char*			m_base;
+		size_t			m_mappedBytes;
+		size_t			m_recordSize;
+		size_t			m_capacity;
+		size_t			m_records;
+		size_t			m_head;
+		std::vector<std::string>
+					m_names;
+		std::vector<bool>	m_integer;
+		// Datapoints set from a record for each read callback
+		std::vector<Datapoint *>
+					m_datapoints;
+};
+
+/**
+ * Spill storage of the oldest buffered readings of an asset
+ * for long Minimum, Maximum, Average and All windows.
+ *
+ * Readings with numeric datapoints are moved from the rule buffer
+ * into memory mapped files in a compact binary layout:
+ * the kernel pages them in for aggregation and out under memory pressure.
+ * Readings with other datapoints than the newest spill file
+ * are not spilled: they are kept in memory.
+ */
+class WindowSpill
+{
+	public:
+		WindowSpill() {};
+		~WindowSpill();
+
+		bool			append(const std::vector<Reading *>& readings);
+		void			read(uint64_t time,
+					     const std::function<void(const std::vector<Datapoint *>&)>& callback) const;
+		void			trim(uint64_t time);
+		void			clear();
+		bool			empty() const { return m_segments.empty(); };
+		uint64_t		getFirstTime() const;
+		uint64_t		getLastTime() const;
+		unsigned long		getReadings() const;
+		unsigned long		getBytes() const;
+		static void		setDirectory(const std::string& directory);
+		static unsigned long	getTotalBytes() { return m_totalBytes; };
+
+	private:
+		bool			spillable(const std::vector<Reading *>& readings) const;
+		void			restore(size_t segments, size_t records);
+		void			removeSegment(bool oldest);
+
+	private:
+		std::deque<WindowSpillSegment *>
+					m_segments;
+		static std::string	m_directory;
+		static std::mutex	m_directoryMutex;
+		// Mapped size of all the spill files
+		static std::atomic<unsigned long>
+					m_totalBytes;
+};
+
+#endif
@@ -15,6 +15,9 @@
 #include "notification_manager.h"
 #include "notification_subscription.h"
 #include "notification_queue.h"
+#include "binary_readings.h"
+#include "rapidjson/document.h"
+#include <algorithm>
 
 
 NotificationApi* NotificationApi::m_instance = 0;
@@ -22,6 +25,7 @@ NotificationApi* NotificationApi::m_instance = 0;
 using namespace std;
 using HttpServer = SimpleWeb::Server<SimpleWeb::HTTP>;
 using HttpClient = SimpleWeb::Client<SimpleWeb::HTTP>;
+using namespace rapidjson;
 
 /**
  * Wrapper function for the notification POST callback API call.
@@ -38,6 +42,21 @@ void notificationReceiveWrapper(shared_ptr<HttpServer::Response> response,
 	api->processCallback(response, request);
 }
 
+/**
+ * Wrapper function for the multi asset notification POST callback API call.
+ *
+ * POST /notification/reading
+ *
+ * @param response	The response stream to send the response on
+ * @param request	The HTTP request
+ */
+void notificationReceiveBatchWrapper(shared_ptr<HttpServer::Response> response,
+				     shared_ptr<HttpServer::Request> request)
+{
+	NotificationApi* api = NotificationApi::getInstance();
+	api->processBatchCallback(response, request);
+}
+
 /**
  * Wrapper for GET /notification
  *
@@ -86,6 +105,21 @@ void notificationGetDelivery(shared_ptr<HttpServer::Response> response,
 				   request);
 }
 
+/**
+ * Wrapper for GET /notification/buffers
+ *
+ * Return the size of data buffered per rule and asset
+ * and the rule buffers memory budget.
+ */
+void notificationGetBuffers(shared_ptr<HttpServer::Response> response,
+			    shared_ptr<HttpServer::Request> request)
+{
+	NotificationApi* api = NotificationApi::getInstance();
+	api->getNotificationObject(NotificationApi::ObjGetBuffersAll,
+				   response,
+				   request);
+}
+
 /**
  * Wrapper for POST /notification/{notificationName}
  */
@@ -207,6 +241,19 @@ unsigned short NotificationApi::getListenerPort()
 	return m_server->getLocalPort();
 }
 
+/**
+ * Set the thread pool size of HTTP server
+ *
+ * This must be called before start()
+ *
+ * @param    threads	Thread pool size of HTTP server
+ */
+void NotificationApi::setThreads(unsigned int threads)
+{
+	m_threads = threads;
+	m_server->config.thread_pool_size = threads;
+}
+
 /**
  * Method for HTTP server, called by a dedicated thread
  */
@@ -241,14 +288,21 @@ void NotificationApi::stopServer() {
  */
 void NotificationApi::stop()
 {
-	this->stopServer();
+	// Nothing to stop if the server has not been started
+	if (m_thread)
+	{
+		this->stopServer();
+	}
 }
 
 /**
  * Wait for the HTTP server to shutdown
  */
 void NotificationApi::wait() {
-	m_thread->join();
+	if (m_thread)
+	{
+		m_thread->join();
+	}
 }
 
 /**
@@ -258,9 +312,11 @@ void NotificationApi::wait() {
 void NotificationApi::initResources()
 {       
 	m_server->resource[RECEIVE_NOTIFICATION]["POST"] = notificationReceiveWrapper;
+	m_server->resource[RECEIVE_NOTIFICATIONS]["POST"] = notificationReceiveBatchWrapper;
 	m_server->resource[GET_NOTIFICATION_INSTANCES]["GET"] = notificationGetInstances;
 	m_server->resource[GET_NOTIFICATION_RULES]["GET"] = notificationGetRules;
 	m_server->resource[GET_NOTIFICATION_DELIVERY]["GET"] = notificationGetDelivery;
+	m_server->resource[GET_NOTIFICATION_BUFFERS]["GET"] = notificationGetBuffers;
 	m_server->resource[POST_NOTIFICATION_NAME]["POST"] = notificationCreateNotification;
 	m_server->resource[POST_NOTIFICATION_RULE_NAME]["POST"] = notificationCreateNotificationRule;
 	m_server->resource[POST_NOTIFICATION_DELIVERY_NAME]["POST"] = notificationCreateNotificationDelivery;
@@ -326,6 +382,92 @@ void NotificationApi::respond(shared_ptr<HttpServer::Response> response,
 		  <<  "Content-type: application/json\r\n\r\n" << payload;
 }
 
+/**
+ * Construct an HTTP 503 Service Unavailable response, with a Retry-After
+ * header, for callback data rejected because the notification queue
+ * has reached its high-water mark.
+ *
+ * The caller may safely retry sending the same data later.
+ *
+ * @param response	The response stream to send the response on
+ */
+void NotificationApi::overloaded(shared_ptr<HttpServer::Response> response)
+{
+	string payload = "{ \"error\" : \"notification queue is full\", "
+			 "\"retryable\" : true }";
+
+	*response << "HTTP/1.1 "
+		  << status_code(SimpleWeb::StatusCode::server_error_service_unavailable)
+		  << "\r\nContent-Length: " << payload.length() << "\r\n"
+		  << "Retry-After: " << RETRY_AFTER_SECONDS << "\r\n"
+		  <<  "Content-type: application/json\r\n\r\n" << payload;
+}
+
+/**
+ * Check whether the notification queue cannot accept new data
+ *
+ * @return	True if the queue has reached its high-water mark
+ */
+bool NotificationApi::isOverloaded()
+{
+	NotificationQueue* queue = NotificationQueue::getInstance();
+	return queue && queue->isFull();
+}
+
+/**
+ * Check whether request content is binary encoded readings data
+ *
+ * JSON is the default encoding.
+ *
+ * @param request	The HTTP request
+ * @return		True for binary readings data
+ */
+bool NotificationApi::isBinary(shared_ptr<HttpServer::Request> request)
+{
+	auto header = request->header.find("Content-Type");
+	return header != request->header.end() &&
+	       (*header).second.compare(0,
+					strlen(BINARY_READINGS_CONTENT_TYPE),
+					BINARY_READINGS_CONTENT_TYPE) == 0;
+}
+
+/**
+ * Get the request content as a writable NUL terminated buffer
+ *
+ * The buffer is the request stream buffer itself: readings are
+ * parsed in place without copying the request content.
+ * Content is copied only if the request stream buffer is not
+ * an asio stream buffer or if it has no room left for the
+ * terminator.
+ *
+ * @param request	The HTTP request
+ * @param length	Output content length
+ * @param copy		Storage of the content copy, if needed
+ * @return		The content buffer
+ */
+char* NotificationApi::getContent(shared_ptr<HttpServer::Request> request,
+				  size_t& length,
+				  string& copy)
+{
+	SimpleWeb::asio::streambuf* buffer =
+		dynamic_cast<SimpleWeb::asio::streambuf *>(request->content.rdbuf());
+	if (!buffer || buffer->size() >= buffer->max_size())
+	{
+		// No room for the terminator: prepare() would throw
+		copy = request->content.string();
+		length = copy.size();
+		return &copy[0];
+	}
+
+	length = buffer->size();
+	// The terminator is written after the content,
+	// reserving space first as this may move the content
+	char* terminator = SimpleWeb::asio::buffer_cast<char *>(buffer->prepare(1));
+	*terminator = '\0';
+	// The input sequence is contiguous
+	return const_cast<char *>(SimpleWeb::asio::buffer_cast<const char *>(buffer->data()));
+}
+
 /**
  * Add data provided in the payload of callback API call
  * into the notification queue.
@@ -343,11 +485,52 @@ void NotificationApi::processCallback(shared_ptr<HttpServer::Response> response,
 	{
 		// URL decode assetName
 		string assetName = urlDecode(request->path_match[ASSET_NAME_COMPONENT]);
-		string payload = request->content.string();
 		string responsePayload;
 
+		// Acknowledge and drop data of assets without enabled
+		// notifications, before parsing readings
+		NotificationSubscription* subscriptions = NotificationSubscription::getInstance();
+		if (subscriptions &&
+		    !subscriptions->hasActiveSubscription(assetName))
+		{
+			NotificationManager* manager = NotificationManager::getInstance();
+			if (manager)
+			{
+				manager->updateDiscardedStats();
+			}
+
+			responsePayload = "{ \"response\" : \"processed\", \"";
+			responsePayload += assetName;
+			responsePayload += "\" : \"data discarded\" }";
+
+			this->respond(response, responsePayload);
+			return;
+		}
+
+		// Reject data before parsing it if the queue is full
+		if (this->isOverloaded())
+		{
+			NotificationManager* manager = NotificationManager::getInstance();
+			if (manager)
+			{
+				manager->updateRejectedStats();
+			}
+			this->overloaded(response);
+			return;
+		}
+
+		// Readings are parsed in place in the request buffer
+		string copy;
+		size_t length = 0;
+		char* payload = this->getContent(request, length, copy);
+
 		// Add data to the queue
-		if (queueNotification(assetName, payload))
+		bool full = false;
+		if (queueNotification(assetName,
+				      payload,
+				      length,
+				      this->isBinary(request),
+				      &full))
 		{
 			responsePayload = "{ \"response\" : \"processed\", \"";
 			responsePayload += assetName;
@@ -355,6 +538,11 @@ void NotificationApi::processCallback(shared_ptr<HttpServer::Response> response,
 
 			this->respond(response, responsePayload);
 		}
+		else if (full)
+		{
+			// Queue became full while parsing data
+			this->overloaded(response);
+		}
 		else
 		{
 			responsePayload = "{ \"error\": \"error_message\" }";
@@ -369,6 +557,349 @@ void NotificationApi::processCallback(shared_ptr<HttpServer::Response> response,
 	}
 }
 
+/**
+ * Add data provided in the payload of multi asset callback API call
+ * into the notification queue.
+ *
+ * This is called by the storage service with new data
+ * of all the assets in which we have registered an interest.
+ *
+ * @param response	The response stream to send the response on
+ * @param request	The HTTP request
+ */
+void NotificationApi::processBatchCallback(shared_ptr<HttpServer::Response> response,
+					   shared_ptr<HttpServer::Request> request)
+{
+	try
+	{
+		// Reject data before parsing it if the queue is full
+		if (this->isOverloaded())
+		{
+			NotificationManager* manager = NotificationManager::getInstance();
+			if (manager)
+			{
+				manager->updateRejectedStats();
+			}
+			this->overloaded(response);
+			return;
+		}
+
+		// Readings are parsed in place in the request buffer
+		string copy;
+		size_t length = 0;
+		char* payload = this->getContent(request, length, copy);
+		string responsePayload;
+		unsigned long queued = 0;
+		unsigned long discarded = 0;
+
+		// Add data to the queue
+		bool full = false;
+		if (queueNotifications(payload,
+				       length,
+				       this->isBinary(request),
+				       queued,
+				       discarded,
+				       &full))
+		{
+			responsePayload = "{ \"response\" : \"processed\", ";
+			responsePayload += "\"queued\" : " + to_string(queued) + ", ";
+			responsePayload += "\"discarded\" : " + to_string(discarded) + " }";
+
+			this->respond(response, responsePayload);
+		}
+		else if (full)
+		{
+			// Queue became full while parsing data
+			this->overloaded(response);
+		}
+		else
+		{
+			responsePayload = "{ \"error\": \"error_message\" }";
+			this->respond(response,
+				      SimpleWeb::StatusCode::client_error_bad_request,
+				      responsePayload);
+		}
+	}
+	catch (exception ex)
+	{
+		this->internalError(response, ex);
+	}
+}
+
+/**
+ * Split readings data of different asset names
+ * and add them into the process queue, one element per asset name.
+ *
+ * Readings of assets without enabled notifications are discarded
+ * before building Reading objects.
+ * All the elements are added to the queue with a single queue lock.
+ *
+ * @param payload	Writable readings data, NULL terminated if JSON
+ * @param length	Readings data length
+ * @param binary	True if data has binary encoding, false if JSON
+ * @param queued	Output number of asset names queued
+ * @param discarded	Output number of asset names discarded
+ * @param full		Optional output, set to true when
+ *			data is rejected by the queue limits
+ * @return		false error, true on success
+ */
+bool NotificationApi::queueNotifications(char* payload,
+					 size_t length,
+					 bool binary,
+					 unsigned long& queued,
+					 unsigned long& discarded,
+					 bool* full)
+{
+	NotificationManager* manager = NotificationManager::getInstance();
+
+	// Take the batch handoff ticket before parsing: asset names
+	// are known only after parsing, batches then take their
+	// asset tickets in the callback order.
+	vector<string> batch(1, BATCH_HANDOFF_NAME);
+	vector<unsigned long> batchTicket;
+	m_handoff.enter(batch, batchTicket);
+
+	// Per asset readings, nothing is added for discarded assets
+	map<string, vector<Reading *>> assetReadings;
+	// Per asset active subscription check and needed datapoints
+	map<string, AssetFilter> filters;
+
+	bool parsed = false;
+	try
+	{
+		parsed = binary ?
+			 this->decodeAssetReadings(payload, length, assetReadings, filters) :
+			 this->parseAssetReadings(payload, assetReadings, filters);
+	}
+	catch (...)
+	{
+		// The handoff ticket must be released
+		parsed = false;
+	}
+	if (!parsed)
+	{
+		// Free readings created so far
+		for (auto a = assetReadings.begin(); a != assetReadings.end(); ++a)
+		{
+			for (auto r = (*a).second.begin(); r != (*a).second.end(); ++r)
+			{
+				delete *r;
+			}
+		}
+		m_logger->error("Found invalid reading in multi asset readings %s data",
+				binary ? "binary" : "JSON");
+
+		// Wait for the turn even on errors: the ticket must be released
+		m_handoff.wait(batch, batchTicket);
+		m_handoff.leave(batch);
+		return false;
+	}
+
+	// Create one queue element per asset
+	vector<NotificationQueueElement *> items;
+	for (auto a = assetReadings.begin(); a != assetReadings.end(); ++a)
+	{
+		ReadingSet* readings = new ReadingSet();
+		readings->append((*a).second);
+		items.push_back(new NotificationQueueElement((*a).first, readings));
+		items.back()->setDatapoints(filters[(*a).first].datapoints);
+	}
+
+	queued = items.size();
+	discarded = filters.size() - queued;
+	if (manager && discarded && !queued)
+	{
+		// The whole callback is discarded, as on the asset route
+		manager->updateDiscardedStats();
+	}
+
+	// Take the asset tickets in the batch turn
+	m_handoff.wait(batch, batchTicket);
+	vector<string> assets;
+	vector<unsigned long> tickets;
+	for (auto a = assetReadings.begin(); a != assetReadings.end(); ++a)
+	{
+		assets.push_back((*a).first);
+	}
+	m_handoff.enter(assets, tickets);
+	m_handoff.leave(batch);
+	m_handoff.wait(assets, tickets);
+
+	NotificationQueue* queue = NotificationQueue::getInstance();
+
+	// Add all elements to the queue
+	bool ret = queue->addElements(items, full);
+
+	m_handoff.leave(assets);
+
+	return ret;
+}
+
+/**
+ * Get the filter of readings data belonging to an asset:
+ * active subscription check and datapoints needed by the rules.
+ *
+ * Result is cached in the filters map for next readings.
+ *
+ * @param assetName	The asset name
+ * @param filters	Per asset filters
+ * @return		The asset filter
+ */
+static const AssetFilter& getAssetFilter(const string& assetName,
+					 map<string, AssetFilter>& filters)
+{
+	auto f = filters.find(assetName);
+	if (f == filters.end())
+	{
+		AssetFilter filter;
+		NotificationSubscription* subscriptions = NotificationSubscription::getInstance();
+		filter.active = !subscriptions ||
+				subscriptions->hasActiveSubscription(assetName);
+		if (subscriptions && filter.active)
+		{
+			subscriptions->getDatapointsMask(assetName, filter.datapoints);
+		}
+		f = filters.insert(make_pair(assetName, filter)).first;
+	}
+	return (*f).second;
+}
+
+/**
+ * Remove from a Reading the datapoints not needed by the rules
+ *
+ * @param reading	The Reading object
+ * @param datapoints	The datapoints to keep, empty means all datapoints
+ */
+static void projectReading(Reading* reading,
+			   const vector<string>& datapoints)
+{
+	if (datapoints.empty())
+	{
+		return;
+	}
+
+	vector<Datapoint *>& values = reading->getReadingData();
+	for (auto d = values.begin(); d != values.end(); )
+	{
+		if (find(datapoints.begin(),
+			 datapoints.end(),
+			 (*d)->getName()) == datapoints.end())
+		{
+			delete *d;
+			d = values.erase(d);
+		}
+		else
+		{
+			++d;
+		}
+	}
+}
+
+/**
+ * Parse multi asset readings JSON data in place
+ * and group Reading objects by asset name
+ *
+ * @param payload	Writable, NULL terminated readings data
+ * @param assetReadings	Output per asset readings
+ * @param filters	Output per asset filters
+ * @return		false error, true on success
+ */
+bool NotificationApi::parseAssetReadings(char* payload,
+					 map<string, vector<Reading *>>& assetReadings,
+					 map<string, AssetFilter>& filters)
+{
+	Document doc;
+	doc.ParseInsitu(payload);
+	if (doc.HasParseError() ||
+	    !doc.IsObject() ||
+	    !doc.HasMember("readings") ||
+	    !doc["readings"].IsArray())
+	{
+		return false;
+	}
+
+	const Value& data = doc["readings"];
+	try
+	{
+		for (Value::ConstValueIterator itr = data.Begin();
+					       itr != data.End();
+					       ++itr)
+		{
+			if (!(*itr).IsObject() ||
+			    !(*itr).HasMember("asset_code") ||
+			    !(*itr)["asset_code"].IsString())
+			{
+				return false;
+			}
+
+			string assetName = (*itr)["asset_code"].GetString();
+			const AssetFilter& filter = getAssetFilter(assetName, filters);
+			if (filter.active)
+			{
+				Reading* reading = new JSONReading(*itr);
+				projectReading(reading, filter.datapoints);
+				assetReadings[assetName].push_back(reading);
+			}
+		}
+	}
+	catch (...)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Decode multi asset binary readings data
+ * and group Reading objects by asset name
+ *
+ * @param data		Binary readings data
+ * @param length	Readings data length
+ * @param assetReadings	Output per asset readings
+ * @param filters	Output per asset filters
+ * @return		false error, true on success
+ */
+bool NotificationApi::decodeAssetReadings(const char* data,
+					  size_t length,
+					  map<string, vector<Reading *>>& assetReadings,
+					  map<string, AssetFilter>& filters)
+{
+	BinaryReadingsDecoder decoder(data, length);
+	uint32_t count;
+	if (!decoder.getCount(count))
+	{
+		return false;
+	}
+
+	string assetName;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (!decoder.getAssetName(assetName))
+		{
+			return false;
+		}
+
+		const AssetFilter& filter = getAssetFilter(assetName, filters);
+		if (filter.active)
+		{
+			Reading* reading = decoder.getReading(assetName,
+							      filter.datapoints);
+			if (!reading)
+			{
+				return false;
+			}
+			assetReadings[assetName].push_back(reading);
+		}
+		else if (!decoder.skipReading())
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
 /**
  * Add readings data of asset name into the process queue
  *
@@ -379,10 +910,60 @@ void NotificationApi::processCallback(shared_ptr<HttpServer::Response> response,
 bool NotificationApi::queueNotification(const string& assetName,
 					const string& payload)
 {
+	// In place parsing modifies the buffer: use a writable copy
+	string buffer(payload);
+
+	return this->queueNotification(assetName, &buffer[0]);
+}
+
+/**
+ * Add readings data of asset name into the process queue
+ *
+ * The readings JSON document is parsed in place:
+ * the payload buffer is modified by the parser.
+ *
+ * @param assetName	The asset name
+ * @param payload	Writable readings data belonging to asset name,
+ *			NULL terminated if JSON
+ * @param length	Readings data length, used for binary data
+ * @param binary	True if data has binary encoding, false if JSON
+ * @param full		Optional output, set to true when
+ *			data is rejected by the queue limits
+ * @return		false error, true on success
+ */
+bool NotificationApi::queueNotification(const string& assetName,
+					char* payload,
+					size_t length,
+					bool binary,
+					bool* full)
+{
+	// Take the handoff ticket before parsing: the queue gets data
+	// of this asset in the callback order even if parsing of
+	// concurrent callbacks completes in a different order.
+	vector<string> assets(1, assetName);
+	vector<unsigned long> tickets;
+	m_handoff.enter(assets, tickets);
+
+	// Get datapoints needed by the rules
+	vector<string> datapoints;
+	NotificationSubscription* subscriptions = NotificationSubscription::getInstance();
+	if (subscriptions)
+	{
+		subscriptions->getDatapointsMask(assetName, datapoints);
+	}
+
 	ReadingSet* readings = NULL;
 	try
 	{
-		readings = new ReadingSet(payload);
+		readings = binary ?
+			   this->decodeReadings(assetName, payload, length, datapoints) :
+			   this->parseReadings(payload, datapoints);
+		if (!readings)
+		{
+			m_logger->error("Unable to parse readings %s data for asset '%s'",
+					binary ? "binary" : "JSON",
+					assetName.c_str());
+		}
 	}
 	catch (exception* ex)
 	{
@@ -390,7 +971,6 @@ bool NotificationApi::queueNotification(const string& assetName,
 				"' while parsing readings for asset '" + \
 				assetName + "'" );
 		delete ex;
-		return false;
 	}
 	catch (...)
 	{
@@ -399,14 +979,226 @@ bool NotificationApi::queueNotification(const string& assetName,
 		m_logger->error("Exception '" + name + \
 				"' while parsing readigns for asset '" + \
 				assetName  + "'" );
-		return false;
 	}
 
-	NotificationQueue* queue = NotificationQueue::getInstance();
-	NotificationQueueElement* item =  new NotificationQueueElement(assetName, readings);
+	// Wait for the turn even on errors: the ticket must be released
+	m_handoff.wait(assets, tickets);
+
+	bool ret = false;
+	if (readings)
+	{
+		NotificationQueue* queue = NotificationQueue::getInstance();
+		NotificationQueueElement* item =  new NotificationQueueElement(assetName, readings);
+		item->setDatapoints(datapoints);
 
-	// Add element to the queue
-	return queue->addElement(item);
+		// Add element to the queue
+		ret = queue->addElement(item, full);
+	}
+
+	m_handoff.leave(assets);
+
+	return ret;
+}
+
+/**
+ * Take handoff tickets for a set of asset names
+ *
+ * All the tickets are taken at once, so callbacks
+ * with several asset names can't wait for each other.
+ *
+ * @param assets	The asset names
+ * @param tickets	Output tickets, one per asset name
+ */
+void AssetHandoff::enter(const vector<string>& assets,
+			 vector<unsigned long>& tickets)
+{
+	lock_guard<mutex> guard(m_mutex);
+	for (auto a = assets.begin(); a != assets.end(); ++a)
+	{
+		// Insert with next and served tickets set to 0
+		tickets.push_back(m_tickets[*a].first++);
+	}
+}
+
+/**
+ * Wait until all earlier tickets of the asset names are done
+ *
+ * @param assets	The asset names
+ * @param tickets	The tickets taken with enter()
+ */
+void AssetHandoff::wait(const vector<string>& assets,
+			const vector<unsigned long>& tickets)
+{
+	unique_lock<mutex> guard(m_mutex);
+	for (size_t i = 0; i < assets.size(); i++)
+	{
+		const string& assetName = assets[i];
+		unsigned long ticket = tickets[i];
+		m_cv.wait(guard, [this, &assetName, ticket] {
+			return m_tickets[assetName].second == ticket;
+		});
+	}
+}
+
+/**
+ * Release the tickets of the asset names, after wait()
+ *
+ * Asset names without waiting tickets are removed.
+ *
+ * @param assets	The asset names
+ */
+void AssetHandoff::leave(const vector<string>& assets)
+{
+	{
+		lock_guard<mutex> guard(m_mutex);
+		for (auto a = assets.begin(); a != assets.end(); ++a)
+		{
+			auto t = m_tickets.find(*a);
+			if (++(*t).second.second == (*t).second.first)
+			{
+				m_tickets.erase(t);
+			}
+		}
+	}
+	m_cv.notify_all();
+}
+
+/**
+ * Decode binary readings data and create a ReadingSet
+ *
+ * All the readings must belong to the given asset name.
+ *
+ * @param assetName	The asset name of the readings
+ * @param data		Binary readings data
+ * @param length	Readings data length
+ * @param datapoints	The datapoints to keep, empty means all datapoints
+ * @return		The new ReadingSet object or NULL on decode errors
+ */
+ReadingSet* NotificationApi::decodeReadings(const string& assetName,
+					    const char* data,
+					    size_t length,
+					    const vector<string>& datapoints)
+{
+	BinaryReadingsDecoder decoder(data, length);
+	uint32_t count;
+	if (!decoder.getCount(count))
+	{
+		return NULL;
+	}
+
+	vector<Reading *> readings;
+	string readingAsset;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		Reading* reading = NULL;
+		if (decoder.getAssetName(readingAsset))
+		{
+			if (readingAsset == assetName)
+			{
+				reading = decoder.getReading(readingAsset, datapoints);
+			}
+			else
+			{
+				m_logger->error("Binary reading of asset '%s' "
+						"sent for asset '%s'",
+						readingAsset.c_str(),
+						assetName.c_str());
+			}
+		}
+
+		if (!reading)
+		{
+			for (auto r = readings.begin(); r != readings.end(); ++r)
+			{
+				delete *r;
+			}
+			return NULL;
+		}
+		readings.push_back(reading);
+	}
+
+	ReadingSet* readingSet = new ReadingSet();
+	readingSet->append(readings);
+
+	return readingSet;
+}
+
+/**
+ * Parse readings JSON data in place and create a ReadingSet
+ *
+ * Parsed JSON strings are not copied into the document:
+ * they are unescaped and NULL terminated inside the payload buffer,
+ * so each Reading object is built straight from the request buffer.
+ *
+ * Readings array is found either in "readings" or "rows" member.
+ *
+ * @param payload	Writable, NULL terminated readings data
+ * @param datapoints	The datapoints to keep, empty means all datapoints
+ * @return		The new ReadingSet object or NULL on parse errors
+ */
+ReadingSet* NotificationApi::parseReadings(char* payload,
+					   const vector<string>& datapoints)
+{
+	Document doc;
+	doc.ParseInsitu(payload);
+	if (doc.HasParseError() ||
+	    !doc.IsObject())
+	{
+		return NULL;
+	}
+
+	const char* member = doc.HasMember("readings") ? "readings" : "rows";
+	vector<Reading *> readings;
+
+	if (doc.HasMember(member))
+	{
+		const Value& data = doc[member];
+		if (!data.IsArray())
+		{
+			return NULL;
+		}
+
+		readings.reserve(data.Size());
+		try
+		{
+			for (Value::ConstValueIterator itr = data.Begin();
+						       itr != data.End();
+						       ++itr)
+			{
+				if (!(*itr).IsObject())
+				{
+					break;
+				}
+				Reading* reading = new JSONReading(*itr);
+				projectReading(reading, datapoints);
+				readings.push_back(reading);
+			}
+		}
+		catch (...)
+		{
+			// Free readings created so far
+			for (auto r = readings.begin(); r != readings.end(); ++r)
+			{
+				delete *r;
+			}
+			throw;
+		}
+
+		if (readings.size() != data.Size())
+		{
+			// Found an item which is not a reading object
+			for (auto r = readings.begin(); r != readings.end(); ++r)
+			{
+				delete *r;
+			}
+			return NULL;
+		}
+	}
+
+	ReadingSet* readingSet = new ReadingSet();
+	readingSet->append(readings);
+
+	return readingSet;
 }
 
 /**
@@ -437,6 +1229,21 @@ void NotificationApi::getNotificationObject(NOTIFICATION_OBJECT object,
 			responsePayload = manager->getJSONDelivery();
 			break;
 
+		case ObjGetBuffersAll:
+			// Get buffered data sizes
+			{
+				NotificationQueue* queue = NotificationQueue::getInstance();
+				if (queue)
+				{
+					responsePayload = queue->getJSONBuffers();
+				}
+				else
+				{
+					responsePayload = "{ \"error\": \"NotificationQueue not yet available.\" }";
+				}
+			}
+			break;
+
 		case ObjGetNotificationsAll:
 			// Get all Notifications
 			responsePayload = "{ \"notifications\": [" + \
@@ -56,6 +56,9 @@ NotificationDetail::NotificationDetail(const string& asset,
 				       m_rule(rule),
 				       m_value(type)
 {
+	SymbolTable* symbols = SymbolTable::getInstance();
+	m_assetId = symbols->intern(asset);
+	m_ruleId = symbols->intern(rule);
 }
 
 /*
@@ -228,6 +231,14 @@ NotificationManager::NotificationManager(const std::string& serviceName,
 {
 	NotificationManager::m_instance = this;
 
+	// No readers using instances
+	m_epoch = 0;
+	m_epochUsers[0] = 0;
+	m_epochUsers[1] = 0;
+	m_retiredCount = 0;
+	// Empty instances table
+	this->publishInstances();
+
 	// Get logger
 	m_logger = Logger::getLogger();
 
@@ -265,6 +276,16 @@ NotificationManager::~NotificationManager()
 	{
 		delete (*it).second;
 	}
+
+	// Delete retired instances
+	lock_guard<mutex> retiredGuard(m_retiredMutex);
+	for (auto it = m_retired.begin();
+		  it != m_retired.end();
+		  ++it)
+	{
+		delete (*it).second;
+	}
+	m_retired.clear();
 }
 
 /**
@@ -322,6 +343,7 @@ void NotificationManager::addInstance(const string& instanceName,
 				      NotificationDelivery* delivery)
 {
 	bool createInstance = true;
+	NotificationInstance* zombie = NULL;
 
 	// Protect changes to m_instances
 	lock_guard<mutex> guard(m_instancesMutex);
@@ -338,10 +360,10 @@ void NotificationManager::addInstance(const string& instanceName,
 		}
 		else
 		{
-			// Zombie instance: delete it now
+			// Zombie instance: delete it when unpublished
 			Logger::getLogger()->debug("Zombie instance %s detected, deleting it ...", instanceName.c_str());
 
-			delete instance->second;
+			zombie = instance->second;
 			instance->second = NULL;
 			m_instances.erase(instance);
 		}
@@ -365,6 +387,152 @@ void NotificationManager::addInstance(const string& instanceName,
 						    instanceName.c_str());
 		}
 	}
+
+	if (createInstance || zombie)
+	{
+		this->publishInstances();
+	}
+
+	if (zombie)
+	{
+		this->retireInstance(zombie);
+	}
+}
+
+/**
+ * Publish a copy of m_instances for lock free lookups
+ * and rebuild the subscriptions routing table
+ *
+ * The caller must hold m_instancesMutex.
+ */
+void NotificationManager::publishInstances()
+{
+	shared_ptr<const INSTANCES_TABLE> table(new INSTANCES_TABLE(m_instances.begin(),
+								    m_instances.end()));
+	atomic_store(&m_instancesTable, table);
+
+	// Routes must not keep removed instances
+	NotificationSubscription* subscriptions = NotificationSubscription::getInstance();
+	if (subscriptions)
+	{
+		subscriptions->updateRoutes();
+	}
+}
+
+/**
+ * Register a reader of the published instances table
+ * and subscription routes
+ *
+ * Instances found from now on are not deleted
+ * until the reader leaves the returned epoch.
+ *
+ * @return	The reader epoch, for removeInstancesUser
+ */
+unsigned long NotificationManager::addInstancesUser()
+{
+	while (true)
+	{
+		unsigned long epoch = m_epoch;
+		m_epochUsers[epoch & 1]++;
+		// The epoch can not advance twice while we are counted:
+		// look up instances only if it did not change meanwhile
+		if (m_epoch == epoch)
+		{
+			return epoch;
+		}
+		m_epochUsers[epoch & 1]--;
+	}
+}
+
+/**
+ * Unregister a reader of the published instances table
+ * and subscription routes
+ *
+ * Retired instances are reclaimed here only if there are any,
+ * so readers pay no reclamation cost when nothing was removed.
+ *
+ * @param    epoch	The epoch returned by addInstancesUser
+ */
+void NotificationManager::removeInstancesUser(unsigned long epoch)
+{
+	m_epochUsers[epoch & 1]--;
+	if (m_retiredCount)
+	{
+		this->reclaimInstances();
+	}
+}
+
+/**
+ * Retire an instance removed from the published instances table
+ *
+ * The instance is deleted when no reader of the current
+ * or earlier epochs can be using it.
+ * The caller must hold m_instancesMutex and must have
+ * published the instances table without the instance.
+ *
+ * @param    instance	The instance to delete
+ */
+void NotificationManager::retireInstance(NotificationInstance* instance)
+{
+	{
+		lock_guard<mutex> guard(m_retiredMutex);
+		// Get the epoch after publishing the instances table
+		atomic_thread_fence(memory_order_seq_cst);
+		m_retired.push_back(make_pair(m_epoch.load(), instance));
+		m_retiredCount++;
+	}
+
+	this->reclaimInstances();
+}
+
+/**
+ * Advance the epoch and delete retired instances
+ *
+ * The epoch advances when no reader is left in the previous epoch:
+ * an instance retired in epoch E is deleted from epoch E + 2,
+ * when all readers which might have found it are done.
+ */
+void NotificationManager::reclaimInstances()
+{
+	vector<NotificationInstance *> reclaimed;
+	{
+		unique_lock<mutex> guard(m_retiredMutex, try_to_lock);
+		if (!guard.owns_lock())
+		{
+			// Another thread is reclaiming
+			return;
+		}
+
+		// Only the reclaiming thread advances the epoch
+		unsigned long epoch = m_epoch;
+		for (int i = 0; i < 2 && m_epochUsers[(epoch + 1) & 1] == 0; i++)
+		{
+			m_epoch = ++epoch;
+		}
+
+		for (auto r = m_retired.begin(); r != m_retired.end(); )
+		{
+			if ((*r).first + 2 <= epoch)
+			{
+				reclaimed.push_back((*r).second);
+				r = m_retired.erase(r);
+			}
+			else
+			{
+				++r;
+			}
+		}
+		m_retiredCount = m_retired.size();
+	}
+
+	// Instance destructors add elements to the delivery queue:
+	// the retired lock is not held here
+	for (auto r = reclaimed.begin(); r != reclaimed.end(); ++r)
+	{
+		Logger::getLogger()->debug("Deleting retired instance %s",
+					   (*r)->getName().c_str());
+		delete *r;
+	}
 }
 
 /**
@@ -394,6 +562,9 @@ string NotificationManager::getJSONInstances()
 /**
  * Return a notification instance, given its name
  *
+ * The lookup is done in the published instances table,
+ * without locks.
+ *
  * @param instanceName		The instance name to fetch
  * @return			Pointer of the found instance or
  *				NULL if not found.
@@ -401,8 +572,9 @@ string NotificationManager::getJSONInstances()
 NotificationInstance*
 NotificationManager::getNotificationInstance(const std::string& instanceName) const
 {
-	auto instance = m_instances.find(instanceName);
-	if (instance != m_instances.end())
+	shared_ptr<const INSTANCES_TABLE> table = this->getInstancesTable();
+	auto instance = table->find(instanceName);
+	if (instance != table->end())
 	{
 		return (*instance).second;
 	}
@@ -868,7 +1040,33 @@ bool NotificationManager::APIcreateEmptyInstance(const string& name)
 			 "\"type\": \"boolean\", \"default\": \"false\"}, " 
 		   "\"retrigger_time\": {\"description\" : \"Retrigger time in seconds for sending a new notification.\", "
 			 "\"displayName\" : \"Retrigger Time\", \"order\" : \"6\", "
-			 "\"type\": \"integer\",  \"default\": \"" + to_string(DEFAULT_RETRIGGER_TIME) + "\"} }";
+			 "\"type\": \"integer\",  \"default\": \"" + to_string(DEFAULT_RETRIGGER_TIME) + "\"}, "
+		   "\"stale_data\": {\"description\" : \"Process or drop data older than the maximum ages.\", "
+			 "\"type\": \"enumeration\", \"options\": [ \"process\", \"drop\" ], "
+			 "\"displayName\" : \"Stale Data\", \"order\" : \"7\", "
+			 "\"default\" : \"process\"}, "
+		   "\"max_queue_age\": {\"description\" : \"Maximum time in seconds data can wait in the queue, 0 means no limit.\", "
+			 "\"displayName\" : \"Maximum Queue Age\", \"order\" : \"8\", "
+			 "\"type\": \"integer\",  \"default\": \"" + to_string(DEFAULT_MAX_QUEUE_AGE) + "\"}, "
+		   "\"max_reading_age\": {\"description\" : \"Maximum age in seconds of a reading, 0 means no limit.\", "
+			 "\"displayName\" : \"Maximum Reading Age\", \"order\" : \"9\", "
+			 "\"type\": \"integer\",  \"default\": \"" + to_string(DEFAULT_MAX_READING_AGE) + "\"}, "
+		   "\"priority\": {\"description\" : \"Data of higher priority notifications is processed first.\", "
+			 "\"type\": \"enumeration\", \"options\": [ \"high\", \"normal\", \"low\" ], "
+			 "\"displayName\" : \"Priority\", \"order\" : \"10\", "
+			 "\"default\" : \"normal\"}, "
+		   "\"buffer_max_bytes\": {\"description\" : \"Maximum size in bytes of the data buffered for the rule, 0 means no limit.\", "
+			 "\"displayName\" : \"Maximum Buffered Data\", \"order\" : \"11\", "
+			 "\"type\": \"integer\",  \"default\": \"" + to_string(DEFAULT_BUFFER_MAX_BYTES) + "\"}, "
+		   "\"buffer_eviction\": {\"description\" : \"How buffered data is reduced above the maximum size: "
+			 "drop the oldest data or halve the resolution of the older data.\", "
+			 "\"type\": \"enumeration\", \"options\": [ \"drop oldest\", \"downsample\" ], "
+			 "\"displayName\" : \"Buffered Data Eviction\", \"order\" : \"12\", "
+			 "\"default\" : \"drop oldest\"}, "
+		   "\"buffer_spill_bytes\": {\"description\" : \"Size in bytes of the data buffered for an asset "
+			 "above which older numeric data is moved into memory mapped files, 0 means no spill.\", "
+			 "\"displayName\" : \"Buffered Data Spill Size\", \"order\" : \"13\", "
+			 "\"type\": \"integer\",  \"default\": \"" + to_string(DEFAULT_BUFFER_SPILL_BYTES) + "\"} }";
 
 
 	DefaultConfigCategory notificationConfig(name, payload);
@@ -880,6 +1078,13 @@ bool NotificationManager::APIcreateEmptyInstance(const string& name)
 		NOTIFICATION_TYPE type;
 		type.retriggerTime = DEFAULT_RETRIGGER_TIME;
 		type.type = E_NOTIFICATION_TYPE::OneShot;
+		type.dropStale = false;
+		type.maxQueueAge = DEFAULT_MAX_QUEUE_AGE;
+		type.maxReadingAge = DEFAULT_MAX_READING_AGE;
+		type.priority = E_NOTIFICATION_PRIORITY::PriorityNormal;
+		type.bufferMaxBytes = DEFAULT_BUFFER_MAX_BYTES;
+		type.bufferEviction = E_BUFFER_EVICTION::EvictDropOldest;
+		type.bufferSpillBytes = DEFAULT_BUFFER_SPILL_BYTES;
 		// Create the empty Notification instance
 		this->addInstance(name,
 				  false,
@@ -1076,8 +1281,14 @@ bool NotificationInstance::reconfigure(const string& name,
 					const string& category)
 {
 	ConfigCategory newConfig(name, category);
+	NotificationManager* manager = NotificationManager::getInstance();
+
+	// This instance is not deleted while it is being updated
+	unsigned long epoch = manager->addInstancesUser();
+	bool ret = this->updateInstance(name, newConfig);
+	manager->removeInstancesUser(epoch);
 
-	return this->updateInstance(name, newConfig);
+	return ret;
 }
 
 /**
@@ -1328,7 +1539,7 @@ bool NotificationInstance::updateInstance(const string& name,
 			subscriptions->removeSubscription((*a).getAssetName(),
 							  ruleName);
 			// Remove asset
-			a = assets.erase(a);
+			a = this->getRule()->removeAsset(a);
 		}
 
 		// Just remove current instance
@@ -1399,7 +1610,7 @@ bool NotificationInstance::updateInstance(const string& name,
 				subscriptions->removeSubscription((*a).getAssetName(),
 								  ruleName);
 				// Remove asseet
-				a = assets.erase(a);
+				a = this->getRule()->removeAsset(a);
 			}
 		}
 
@@ -1449,8 +1660,8 @@ bool NotificationInstance::updateInstance(const string& name,
  * Remove an instance from instances map
  *
  * Rather than actually delete them we mark them as zombies
- * so that they will be deleted when we are sure the system is not
- * processing the notification.
+ * and retire them, so that they will be deleted when we are sure
+ * the system is not processing the notification.
  *
  * @param    instanceName	The instance name to remove.
  * @return			True for found instance removed,
@@ -1466,45 +1677,18 @@ bool NotificationManager::removeInstance(const string& instanceName)
 	auto r = m_instances.find(instanceName);
 	if (r != m_instances.end())
 	{
-		(*r).second->markAsZombie();
+		NotificationInstance* instance = (*r).second;
+		instance->markAsZombie();
+		m_instances.erase(r);
 		ret = true;
 		Logger::getLogger()->debug("Instance %s marked as Zombie",
 					   instanceName.c_str());
-	}
-	return ret;
-}
-
-/**
- * Traverse all the instances and remove the zombies
- */
-void NotificationManager::collectZombies()
-{
-	lock_guard<mutex> guard(m_instancesMutex);
-	for (auto r = m_instances.begin();
-		  r != m_instances.end(); )
-	{
-		if (!r->second)
-		{
-			Logger::getLogger()->debug("Instance has NULL object, size %lu",
-						   m_instances.size());
-		}
 
-		if (r->second &&
-		    r->second->isZombie())
-		{
-			Logger::getLogger()->debug("Instance %s removed from m_instances",
-					   r->second->getName().c_str());
-			// Free memory
-			delete r->second;
-			r->second = NULL;
-			// Remove element
-			r = m_instances.erase(r);
-		}
-		else
-		{
-			++r;
-		}
+		// Readers must not find it any longer
+		this->publishInstances();
+		this->retireInstance(instance);
 	}
+	return ret;
 }
 
 /**
@@ -1548,6 +1732,61 @@ bool NotificationManager::getConfigurationItems(const ConfigCategory& config,
 	}
 	nType.retriggerTime = retriggerTime;
 
+	// Stale data policy
+	nType.dropStale = config.itemExists("stale_data") &&
+			  config.getValue("stale_data").compare("drop") == 0;
+	nType.maxQueueAge = DEFAULT_MAX_QUEUE_AGE;
+	if (config.itemExists("max_queue_age") &&
+	    !config.getValue("max_queue_age").empty())
+	{
+		nType.maxQueueAge = atol(config.getValue("max_queue_age").c_str());
+	}
+	nType.maxReadingAge = DEFAULT_MAX_READING_AGE;
+	if (config.itemExists("max_reading_age") &&
+	    !config.getValue("max_reading_age").empty())
+	{
+		nType.maxReadingAge = atol(config.getValue("max_reading_age").c_str());
+	}
+
+	// Queue priority
+	nType.priority = E_NOTIFICATION_PRIORITY::PriorityNormal;
+	if (config.itemExists("priority"))
+	{
+		string priority = config.getValue("priority");
+		if (priority.compare("high") == 0)
+		{
+			nType.priority = E_NOTIFICATION_PRIORITY::PriorityHigh;
+		}
+		else if (priority.compare("low") == 0)
+		{
+			nType.priority = E_NOTIFICATION_PRIORITY::PriorityLow;
+		}
+	}
+
+	// Memory budget of the rule buffers
+	nType.bufferMaxBytes = DEFAULT_BUFFER_MAX_BYTES;
+	if (config.itemExists("buffer_max_bytes") &&
+	    !config.getValue("buffer_max_bytes").empty())
+	{
+		nType.bufferMaxBytes = strtoul(config.getValue("buffer_max_bytes").c_str(),
+					       NULL,
+					       10);
+	}
+	nType.bufferEviction = E_BUFFER_EVICTION::EvictDropOldest;
+	if (config.itemExists("buffer_eviction") &&
+	    config.getValue("buffer_eviction").compare("downsample") == 0)
+	{
+		nType.bufferEviction = E_BUFFER_EVICTION::EvictDownsample;
+	}
+	nType.bufferSpillBytes = DEFAULT_BUFFER_SPILL_BYTES;
+	if (config.itemExists("buffer_spill_bytes") &&
+	    !config.getValue("buffer_spill_bytes").empty())
+	{
+		nType.bufferSpillBytes = strtoul(config.getValue("buffer_spill_bytes").c_str(),
+						 NULL,
+						 10);
+	}
+
 	// Get notification type
 	string notification_type;
 	if (config.itemExists("notification_type") &&
@@ -1664,7 +1903,7 @@ bool NotificationManager::APIdeleteInstance(const string& instanceName)
 				subscriptions->removeSubscription((*a).getAssetName(),
 								   ruleName);
 				// Remove asseet
-				a = assets.erase(a);
+				a = rule->removeAsset(a);
 			}
 		}
 	}
@@ -16,6 +16,8 @@
 #include <logger.h>
 #include <iostream>
 #include <string>
+#include <algorithm>
+#include <chrono>
 #include <datapoint.h>
 #include <notification_service.h>
 #include <notification_manager.h>
@@ -32,44 +34,173 @@ NotificationQueue* NotificationQueue::m_instance = 0;
  * Process queue worker thread entry point
  *
  * @param    queue	Pointer to NotificationQueue instance
+ * @param    shard	The queue shard processed by the thread
  */
-static void worker(NotificationQueue* queue)
+static void worker(NotificationQueue* queue, unsigned long shard)
 {
-	queue->process();
+	queue->process(shard);
 }
 
 static void addReadyData(const map<string, string>& readyData,
 			     string& output);
-static void deliverData(NotificationRule* rule,
+static void deliverData(NotificationInstance* instance,
 			const std::multimap<uint64_t, Reading*>& itemData,
 			const map<string, string>& readyData);
-static void deliverNotification(NotificationRule* rule,
+static void deliverNotification(NotificationInstance* instance,
 				const std::string& data);
 
+/**
+ * Monotonic clock for queue latency
+ *
+ * @return	Current time in microseconds
+ */
+static inline uint64_t queueClock()
+{
+	return chrono::duration_cast<chrono::microseconds>(
+		chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Get the user timestamp of a reading
+ *
+ * @param    reading	The reading
+ * @return		User timestamp in microseconds
+ */
+static inline uint64_t readingTime(Reading* reading)
+{
+	struct timeval tv;
+	reading->getUserTimestamp(&tv);
+	return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/**
+ * Readings built for the rules with the same needed datapoints,
+ * oldest reading time and oldest queued time
+ */
+class SharedView
+{
+	public:
+		const vector<string>*	datapoints;
+		time_t			oldest;
+		time_t			oldestQueued;
+		shared_ptr<const SharedReadings>
+					readings;
+};
+
+static shared_ptr<const SharedReadings> shareReadings(const shared_ptr<const SharedReadings>& all,
+						      const vector<string>& datapoints,
+						      time_t oldest,
+						      const vector<time_t>& queuedTimes,
+						      time_t oldestQueued,
+						      vector<SharedView>& views);
+
+/**
+ * SharedReadings constructor
+ *
+ * @param    readings		The readings, now owned by this object
+ */
+SharedReadings::SharedReadings(const vector<Reading *>& readings) :
+			       m_readings(readings)
+{
+	// Estimate memory used by readings data
+	m_size = 0;
+	for (auto r = m_readings.begin(); r != m_readings.end(); ++r)
+	{
+		m_size += NotificationQueueElement::getReadingSize(*r);
+	}
+
+	NotificationManager* manager = NotificationManager::getInstance();
+	if (manager)
+	{
+		manager->addBufferStats(m_readings.size(), m_size);
+	}
+}
+
+/**
+ * SharedReadings view constructor
+ *
+ * @param    readings		Subset of the owner readings
+ * @param    owner		The owner of the readings
+ */
+SharedReadings::SharedReadings(const vector<Reading *>& readings,
+			       const shared_ptr<const SharedReadings>& owner) :
+			       m_readings(readings),
+			       m_owner(owner),
+			       m_size(0)
+{
+}
+
+/**
+ * SharedReadings destructor
+ */
+SharedReadings::~SharedReadings()
+{
+	if (m_owner)
+	{
+		// Readings are deleted by the owner
+		return;
+	}
+
+	NotificationManager* manager = NotificationManager::getInstance();
+	if (manager)
+	{
+		manager->removeBufferStats(m_readings.size(), m_size);
+	}
+
+	for (auto r = m_readings.begin(); r != m_readings.end(); ++r)
+	{
+		delete *r;
+	}
+}
+
 /**
  * NotificationDataElement construcrtor
  *
- * @param    ruleName		The ruleName which asseName belongs to
- * @param    assetName		The asseName for current data
- * @param    assetData		The ReadingSet data related to assetName
+ * @param    rule		The interned rule name which asset belongs to
+ * @param    asset		The interned asset name for current data
+ * @param    assetData		The shared readings data related to asset
  */
-NotificationDataElement::NotificationDataElement(const string& ruleName,
-						 const string& assetName,
-						 ReadingSet* assetData) :
-						 m_ruleName(ruleName),
-						 m_asset(assetName),
-						 m_data(assetData)
+NotificationDataElement::NotificationDataElement(SYMBOL_ID rule,
+						 SYMBOL_ID asset,
+						 const shared_ptr<const SharedReadings>& assetData) :
+						 m_asset(asset),
+						 m_rule(rule),
+						 m_shared(assetData)
 {
 	// Set element creation time
 	m_time = time(NULL);
 
+	// Readings are not owned by the ReadingSet
+	vector<Reading *> readings = assetData->getReadings();
+	m_data.append(readings);
+
+	// Event time range of the readings
+	m_firstTime = 0;
+	m_lastTime = 0;
+	m_size = 0;
+	for (auto r = readings.begin();
+		  r != readings.end();
+		  ++r)
+	{
+		m_size += NotificationQueueElement::getReadingSize(*r);
+
+		uint64_t t = readingTime(*r);
+		if (r == readings.begin() || t < m_firstTime)
+		{
+			m_firstTime = t;
+		}
+		if (t > m_lastTime)
+		{
+			m_lastTime = t;
+		}
+	}
+
 #ifdef QUEUE_DEBUG_DATA
-	const vector<Reading *>& readings = assetData->getAllReadings();
 	for (auto m = readings.begin();
 		  m != readings.end();
 		  ++m)
 	{
-		assert((*m)->getAssetName().compare(assetName) == 0);
+		assert((*m)->getAssetName().compare(this->getAssetName()) == 0);
 	}
 #endif
 }
@@ -79,454 +210,2098 @@ NotificationDataElement::NotificationDataElement(const string& ruleName,
  */
 NotificationDataElement::~NotificationDataElement()
 {
-	m_data->removeAll();
-	delete m_data;
+	// Readings are not owned by the ReadingSet: shared readings
+	// are deleted with the last element using them
+	m_data.removeAll();
 }
 
 /**
- * NotificatioQueueElement constructor
+ * Get the pool of NotificationDataElement objects
  *
- * @param    assetName	The assetName which gets ntotification data
- * @param    data	The readings data pointer
+ * The pool is not deleted: elements may be released at exit.
+ *
+ * @return	The element pool
  */
-NotificationQueueElement::NotificationQueueElement(const string& assetName,
-						   ReadingSet* data) :
-						   m_assetName(assetName),
-						   m_readings(data)
+SlabPool& NotificationDataElement::getPool()
 {
-#ifdef QUEUE_DEBUG_DATA
-	m_logger->debug("addind to queue a NotificationQueueElement [" + \
-			assetName + "] of # readings = " + \
-			(data ? to_string(data->getCount()) : string("NO_DATA")));
-	// Debug check
-	const vector<Reading *>& readings = data->getAllReadings();
-        for (auto m = readings.begin();
-             m != readings.end();
-             ++m)
-        {
-                assert((*m)->getAssetName().compare(assetName) == 0);
-        }
-#endif
-	time(&m_qTime);
+	static SlabPool* pool = new SlabPool(sizeof(NotificationDataElement));
+	return *pool;
 }
 
 /**
- * NotificatioQueueElement destructor
+ * Allocate a NotificationDataElement from the element pool
+ *
+ * @param    size	The object size
+ * @return		The object memory
  */
-NotificationQueueElement::~NotificationQueueElement()
+void* NotificationDataElement::operator new(size_t size)
 {
-	// Remove readings
-	delete m_readings;
+	if (size != sizeof(NotificationDataElement))
+	{
+		return ::operator new(size);
+	}
+	return getPool().allocate();
 }
 
 /**
- * Constructor for the NotificationQueue class
+ * Release a NotificationDataElement into the element pool
  *
- * @param    notificationName	NotificationService name
+ * @param    p		The object memory
+ * @param    size	The object size
  */
-NotificationQueue::NotificationQueue(const string& notificationName) :
-				     m_name(notificationName)
+void NotificationDataElement::operator delete(void* p, size_t size)
 {
-	// Set running
-	m_running = true;
-	// Set instance
-	m_instance = this;
-	// Start process queue thread
-	m_queue_thread = new thread(worker, this);
-
-	// Get logger
-	m_logger = Logger::getLogger();
+	if (size != sizeof(NotificationDataElement))
+	{
+		::operator delete(p);
+		return;
+	}
+	getPool().release(p);
 }
 
+// Size of data in all the rule buffers
+std::atomic<unsigned long> NotificationDataBuffer::m_totalBytes(0);
+
 /**
- * NotificatioQueue destructor
+ * Insert data of an asset in first reading time order
+ *
+ * Data is usually newer than the buffered data and appended:
+ * late data is inserted at its position, found by binary search.
+ *
+ * @param    asset		The interned asset name
+ * @param    data		The data to insert
  */
-NotificationQueue::~NotificationQueue()
+void NotificationDataBuffer::insert(SYMBOL_ID asset,
+				    NotificationDataElement* data)
 {
-	delete m_queue_thread;
+	RULE_BUFFER_DATA& assetData = m_assetData[asset];
+	if (assetData.empty() ||
+	    assetData.back()->getFirstTime() <= data->getFirstTime())
+	{
+		assetData.push_back(data);
+	}
+	else
+	{
+		auto pos = upper_bound(assetData.begin(),
+				       assetData.end(),
+				       data->getFirstTime(),
+				       [](uint64_t t, NotificationDataElement* e)
+				       {
+						return t < e->getFirstTime();
+				       });
+		assetData.insert(pos, data);
+	}
+
+	m_assetBytes[asset] += data->getSize();
+	m_bytes += data->getSize();
+	m_totalBytes += data->getSize();
+
+	uint64_t& lastTime = m_assetLastTime[asset];
+	if (data->getLastTime() > lastTime)
+	{
+		lastTime = data->getLastTime();
+	}
 }
 
 /**
- * Process data still in the buffers
+ * Append data of an asset
+ *
+ * The caller must hold the rule lock.
+ *
+ * @param    asset		The interned asset name
+ * @param    data		The data to append
  */
-void NotificationQueue::stop()
+void NotificationDataBuffer::append(SYMBOL_ID asset,
+				    NotificationDataElement* data)
 {
+	this->insert(asset, data);
+	m_assetArrival[asset] = queueClock();
 
-	m_running = false;
+	auto c = m_columns.find(asset);
+	if (c != m_columns.end())
+	{
+		(*c).second.append(data->getData()->getAllReadings());
+	}
+}
 
-	m_processCv.notify_all();
+/**
+ * Add back data of an asset
+ *
+ * Columns are not changed: this is the part of
+ * an element which has been removed from the data.
+ *
+ * The caller must hold the rule lock.
+ *
+ * @param    asset		The interned asset name
+ * @param    data		The data to insert
+ */
+void NotificationDataBuffer::reinsert(SYMBOL_ID asset,
+				      NotificationDataElement* data)
+{
+	this->insert(asset, data);
+}
 
-	// Waiting for the process thread to complete
-	m_queue_thread->join();
+/**
+ * Get the newest reading time of the buffered
+ * and spilled data of an asset
+ *
+ * The caller must hold the rule lock.
+ *
+ * @param    asset		The interned asset name
+ * @return			Time in microseconds, 0 without data
+ */
+uint64_t NotificationDataBuffer::getLastTime(SYMBOL_ID asset)
+{
+	auto t = m_assetLastTime.find(asset);
+	return t != m_assetLastTime.end() ? (*t).second : 0;
+}
 
-	// NotifictionQueue is empty now: clear all remaining data
+/**
+ * Get the time data of an asset was last appended
+ *
+ * The caller must hold the rule lock.
+ *
+ * @param    asset		The interned asset name
+ * @return			Queue clock time in microseconds,
+ *				0 if no data was appended
+ */
+uint64_t NotificationDataBuffer::getArrivalTime(SYMBOL_ID asset)
+{
+	auto t = m_assetArrival.find(asset);
+	return t != m_assetArrival.end() ? (*t).second : 0;
+}
 
-	// Get the subscriptions instance
-	NotificationSubscription* subscriptions = NotificationSubscription::getInstance();
-	if (!subscriptions)
+/**
+ * Set the newest reading time of an asset
+ * from its buffered and spilled data
+ *
+ * @param    asset		The interned asset name
+ */
+void NotificationDataBuffer::setLastTime(SYMBOL_ID asset)
+{
+	uint64_t lastTime = 0;
+	WindowSpill* spill = this->getSpill(asset);
+	if (spill)
 	{
-		return;
+		lastTime = spill->getLastTime();
 	}
-
-	NotificationManager* manager = NotificationManager::getInstance();
-
-	// NOTE:
-	//
-	// Notificatiion API server is down: we cannot receive any configuration change
-	// so we don't need to lock subscriptions object
-	//
-        // Get all subscriptions for assetName
-	std::map<std::string, std::vector<SubscriptionElement>>&
-		registeredItems = subscriptions->getAllSubscriptions();
-
-	lock_guard<mutex> guard(manager->m_instancesMutex);
-	// Iterate trough subscriptions
-	for (auto it = registeredItems.begin();
-		  it != registeredItems.end();
-		  ++it)
+	RULE_BUFFER_DATA& data = m_assetData[asset];
+	for (auto e = data.begin(); e != data.end(); ++e)
 	{
-		for (auto s = (*it).second.begin();
-			  s != (*it).second.end();
-			  ++s)
+		if ((*e)->getLastTime() > lastTime)
 		{
-			// Get notification rule object
-			string notificationName = (*s).getNotificationName();
-			NotificationInstance* instance = manager->getNotificationInstance(notificationName);
-
-			// Get ruleName
-			if (instance &&
-			    instance->getRule())
-			{
-				string ruleName = instance->getRule()->getName();
-				// Get all assests belonging to current rule
-				vector<NotificationDetail>& assets = instance->getRule()->getAssets();
-
-				//Iterate trough assets
-				for (auto itr = assets.begin();
-					  itr != assets.end();
-					   ++itr)
-				{
-					// Remove all buffers:
-					// queue process is donwn, queue lock not needed
-					this->clearBufferData(ruleName, (*itr).getAssetName());
-				}
-			}
+			lastTime = (*e)->getLastTime();
 		}
 	}
+	m_assetLastTime[asset] = lastTime;
 }
 
 /**
- * Add an element to the queue
+ * Delete an element removed from the data of an asset
  *
- * @param    element		The element to add the queue.
- * @return			True on succes, false otherwise.
+ * @param    asset		The interned asset name
+ * @param    data		The removed element
+ * @return			The number of readings of the element
  */
-bool NotificationQueue::addElement(NotificationQueueElement* element)
+unsigned long NotificationDataBuffer::release(SYMBOL_ID asset,
+					      NotificationDataElement* data)
 {
-	if (!m_running)
-	{
-		// Don't add new elements if queue is being stopped
-		delete element;
-		return true;
-	}
+	unsigned long readings = data->getData()->getCount();
 
-	lock_guard<mutex> loadLock(m_qMutex);
+	m_assetBytes[asset] -= data->getSize();
+	m_bytes -= data->getSize();
+	m_totalBytes -= data->getSize();
 
-	m_queue.push(element);
+	// Free object data
+	delete data;
 
-#ifdef QUEUE_DEBUG_DATA
-	m_logger->debug("Element added to queue, asset [" + element->getAssetName() + \
-			"], #readings " + to_string(element->getAssetData()->getCount()));
-#endif
+	return readings;
+}
+
+/**
+ * Delete the oldest data of an asset
+ *
+ * The caller must hold the rule lock.
+ *
+ * @param    asset		The interned asset name
+ * @param    num		The number of newest elements to keep
+ * @return			The number of deleted elements
+ */
+unsigned long NotificationDataBuffer::keep(SYMBOL_ID asset,
+					   unsigned long num)
+{
+	RULE_BUFFER_DATA& data = m_assetData[asset];
 
-	m_processCv.notify_all();
+	unsigned long removed = 0;
+	while (data.size() > num)
+	{
+		this->release(asset, data.front());
+		data.pop_front();
+		removed++;
+	}
 
-	return true;
+	// Columns and spilled data are trimmed by time
+	// with trimColumns and trimSpill: spilled data
+	// may be newer than late buffered data
+	if (data.empty())
+	{
+		auto c = m_columns.find(asset);
+		if (c != m_columns.end())
+		{
+			(*c).second.clear();
+		}
+		if (this->getSpill(asset))
+		{
+			this->setLastTime(asset);
+		}
+		else
+		{
+			m_assetLastTime.erase(asset);
+			m_assetArrival.erase(asset);
+		}
+	}
+	return removed;
 }
 
 /**
- * Process data in the queue
+ * Halve the resolution of the older half of the data of an asset:
+ * every second element is deleted, the oldest one is kept.
+ *
+ * @param    asset		The interned asset name
+ * @return			The number of deleted readings
  */
-void NotificationQueue::process()
+unsigned long NotificationDataBuffer::downsample(SYMBOL_ID asset)
 {
-	bool doProcess = true;
+	RULE_BUFFER_DATA& data = m_assetData[asset];
+	RULE_BUFFER_DATA kept;
+	unsigned long half = data.size() / 2;
+	unsigned long readings = 0;
+	unsigned long i = 0;
 
-	while (doProcess)
+	for (auto e = data.begin(); e != data.end(); ++e, i++)
 	{
-		NotificationQueueElement* data = NULL;
-		// Get data from the queue
+		if (i < half && i % 2)
 		{
-			unique_lock<mutex> sendLock(m_qMutex);
-			while (m_queue.empty())
-			{
-				if (!m_running)
-				{
-					// No data and load thread is not running.
-					doProcess = false;
-					break;
-				}
-				else
-				{
-					// No data, wait util notified
-					m_processCv.wait(sendLock);
-				}
-			}
+			readings += this->release(asset, *e);
+		}
+		else
+		{
+			kept.push_back(*e);
+		}
+	}
+	data.swap(kept);
+
+	return readings;
+}
+
+/**
+ * Remove data above the memory budgets
+ *
+ * Data of the asset with the largest size is removed first,
+ * the newest element of each asset is always kept.
+ * Only this rule buffer data is removed: above the budget of all
+ * the rule buffers, data at least as large as the added data is removed,
+ * so rules adding data don't grow the total size.
+ *
+ * The caller must hold the rule lock.
+ *
+ * @param    maxBytes		Budget of this rule buffer, 0 means no limit
+ * @param    maxTotalBytes	Budget of all the rule buffers, 0 means no limit
+ * @param    added		Size of the data just added
+ * @param    policy		Drop the oldest data or downsample it
+ * @param    readings		Output number of removed readings
+ * @param    bytes		Output size of removed data
+ * @return			True if data is within the budgets,
+ *				false if no more data can be removed
+ */
+bool NotificationDataBuffer::evict(unsigned long maxBytes,
+				   unsigned long maxTotalBytes,
+				   unsigned long added,
+				   E_BUFFER_EVICTION policy,
+				   unsigned long& readings,
+				   unsigned long& bytes)
+{
+	unsigned long size = m_bytes;
+	vector<SYMBOL_ID> evicted;
+	readings = 0;
+	bytes = 0;
 
-			if (doProcess)
+	while ((maxBytes && m_bytes > maxBytes) ||
+	       (maxTotalBytes && m_totalBytes > maxTotalBytes && bytes < added))
+	{
+		// Asset with the largest data which can be reduced
+		SYMBOL_ID asset = 0;
+		bool found = false;
+		unsigned long largest = 0;
+		for (auto a = m_assetData.begin(); a != m_assetData.end(); ++a)
+		{
+			if ((*a).second.size() > 1 &&
+			    (!found || m_assetBytes[(*a).first] > largest))
 			{
-				// Get first element in the queue
-				data = m_queue.front();
-				// Remove the item
-				m_queue.pop();
+				asset = (*a).first;
+				largest = m_assetBytes[(*a).first];
+				found = true;
 			}
 		}
-
-		if (data)
+		if (!found)
 		{
-			data->queuedTimeCheck();
-			// Process data
-			this->processDataSet(data);
+			break;
+		}
+		if (find(evicted.begin(), evicted.end(), asset) == evicted.end())
+		{
+			evicted.push_back(asset);
+		}
+
+		RULE_BUFFER_DATA& data = m_assetData[asset];
+		// Downsampling needs two elements in the older half
+		if (policy == E_BUFFER_EVICTION::EvictDownsample &&
+		    data.size() >= 4)
+		{
+			readings += this->downsample(asset);
+		}
+		else
+		{
+			readings += this->release(asset, data.front());
+			data.pop_front();
+		}
+		bytes = size - m_bytes;
+	}
+
+	// Newest time and columns of the remaining data
+	for (auto a = evicted.begin(); a != evicted.end(); ++a)
+	{
+		this->setLastTime(*a);
+		if (m_columns.find(*a) != m_columns.end())
+		{
+			this->buildColumns(*a);
+		}
+	}
+
+	return !(maxBytes && m_bytes > maxBytes) &&
+	       !(maxTotalBytes && m_totalBytes > maxTotalBytes && bytes < added);
+}
+
+/**
+ * Get the size of buffered data of an asset
+ *
+ * The caller must hold the rule lock.
+ *
+ * @param    asset		The interned asset name
+ * @return			The size in bytes
+ */
+unsigned long NotificationDataBuffer::getAssetBytes(SYMBOL_ID asset)
+{
+	auto a = m_assetBytes.find(asset);
+	return a != m_assetBytes.end() ? (*a).second : 0;
+}
+
+/**
+ * Keep or drop the numeric datapoint columns of an asset
+ *
+ * Columns are built from the buffered data when enabled.
+ * The caller must hold the rule lock.
+ *
+ * @param    asset		The interned asset name
+ * @param    enable		True to keep columns, false to drop them
+ * @param    intervalUs		The window interval in microseconds
+ */
+void NotificationDataBuffer::setColumns(SYMBOL_ID asset,
+					bool enable,
+					uint64_t intervalUs)
+{
+	auto c = m_columns.find(asset);
+	bool enabled = c != m_columns.end();
+	if (enable && !enabled)
+	{
+		m_columns[asset].setInterval(intervalUs);
+		this->buildColumns(asset);
+	}
+	else if (enable && (*c).second.getInterval() != intervalUs)
+	{
+		(*c).second.setInterval(intervalUs);
+	}
+	else if (!enable && enabled)
+	{
+		m_columns.erase(asset);
+	}
+}
+
+/**
+ * Build the columns of an asset from its buffered data
+ *
+ * @param    asset		The interned asset name
+ */
+void NotificationDataBuffer::buildColumns(SYMBOL_ID asset)
+{
+	WindowColumns& columns = m_columns[asset];
+	columns.clear();
+
+	RULE_BUFFER_DATA& data = m_assetData[asset];
+	for (auto e = data.begin(); e != data.end(); ++e)
+	{
+		columns.append((*e)->getData()->getAllReadings());
+	}
+}
+
+/**
+ * Get the columns of an asset
+ *
+ * The caller must hold the rule lock.
+ *
+ * @param    asset		The interned asset name
+ * @return			The columns if enabled and valid, NULL otherwise
+ */
+WindowColumns* NotificationDataBuffer::getColumns(SYMBOL_ID asset)
+{
+	auto c = m_columns.find(asset);
+	if (c == m_columns.end() || !(*c).second.isValid())
+	{
+		return NULL;
+	}
+	return &(*c).second;
+}
+
+/**
+ * Remove the column data of an asset not newer than a given time
+ *
+ * Not valid columns are built again from the buffered data.
+ * The caller must hold the rule lock.
+ *
+ * @param    asset		The interned asset name
+ * @param    time		The time in microseconds
+ */
+void NotificationDataBuffer::trimColumns(SYMBOL_ID asset, uint64_t time)
+{
+	auto c = m_columns.find(asset);
+	if (c == m_columns.end())
+	{
+		return;
+	}
+
+	if ((*c).second.isValid())
+	{
+		(*c).second.trim(time);
+	}
+	else
+	{
+		this->buildColumns(asset);
+	}
+}
+
+/**
+ * NotificationDataBuffer destructor
+ *
+ * Remove the spill files
+ */
+NotificationDataBuffer::~NotificationDataBuffer()
+{
+	for (auto s = m_spills.begin(); s != m_spills.end(); ++s)
+	{
+		delete (*s).second;
+	}
+}
+
+/**
+ * Move the oldest data of an asset into spill files
+ *
+ * Elements are moved, oldest first, when the asset data
+ * is above the given size until it is down to half of it:
+ * the newest element is always kept.
+ * Data with not numeric datapoints, other datapoints than the
+ * spilled data or out of order readings is not moved and stops the spill.
+ *
+ * The caller must hold the rule lock.
+ *
+ * @param    asset		The interned asset name
+ * @param    maxBytes		The maximum size of the asset data
+ * @return			The number of moved readings
+ */
+unsigned long NotificationDataBuffer::spill(SYMBOL_ID asset,
+					    unsigned long maxBytes)
+{
+	if (this->getAssetBytes(asset) <= maxBytes)
+	{
+		return 0;
+	}
+
+	WindowSpill*& spill = m_spills[asset];
+	if (!spill)
+	{
+		spill = new WindowSpill();
+	}
+
+	RULE_BUFFER_DATA& data = m_assetData[asset];
+	unsigned long readings = 0;
+	while (data.size() > 1 &&
+	       m_assetBytes[asset] > maxBytes / 2)
+	{
+		if (!spill->append(data.front()->getData()->getAllReadings()))
+		{
+			break;
+		}
+		readings += this->release(asset, data.front());
+		data.pop_front();
+	}
+
+	// Columns of the remaining data
+	if (readings && m_columns.find(asset) != m_columns.end())
+	{
+		this->buildColumns(asset);
+	}
+	return readings;
+}
+
+/**
+ * Get the spilled data of an asset
+ *
+ * The caller must hold the rule lock.
+ *
+ * @param    asset		The interned asset name
+ * @return			The spilled data, NULL if there is none
+ */
+WindowSpill* NotificationDataBuffer::getSpill(SYMBOL_ID asset)
+{
+	auto s = m_spills.find(asset);
+	if (s == m_spills.end() || (*s).second->empty())
+	{
+		return NULL;
+	}
+	return (*s).second;
+}
+
+/**
+ * Remove the spilled data of an asset not newer than a given time
+ *
+ * The caller must hold the rule lock.
+ *
+ * @param    asset		The interned asset name
+ * @param    time		The time in microseconds
+ */
+void NotificationDataBuffer::trimSpill(SYMBOL_ID asset, uint64_t time)
+{
+	auto s = m_spills.find(asset);
+	if (s != m_spills.end())
+	{
+		(*s).second->trim(time);
+	}
+}
+
+/**
+ * Get the assets with buffered data
+ *
+ * The caller must hold the rule lock.
+ *
+ * @param    assets		Output interned asset names
+ */
+void NotificationDataBuffer::getAssets(vector<SYMBOL_ID>& assets)
+{
+	for (auto a = m_assetData.begin(); a != m_assetData.end(); ++a)
+	{
+		if (!(*a).second.empty())
+		{
+			assets.push_back((*a).first);
+		}
+	}
+}
+
+/**
+ * NotificatioQueueElement constructor
+ *
+ * @param    assetName	The assetName which gets ntotification data
+ * @param    data	The readings data pointer
+ */
+NotificationQueueElement::NotificationQueueElement(const string& assetName,
+						   ReadingSet* data) :
+						   m_assetName(assetName),
+						   m_readings(data)
+{
+#ifdef QUEUE_DEBUG_DATA
+	m_logger->debug("addind to queue a NotificationQueueElement [" + \
+			assetName + "] of # readings = " + \
+			(data ? to_string(data->getCount()) : string("NO_DATA")));
+	// Debug check
+	const vector<Reading *>& readings = data->getAllReadings();
+        for (auto m = readings.begin();
+             m != readings.end();
+             ++m)
+        {
+                assert((*m)->getAssetName().compare(assetName) == 0);
+        }
+#endif
+	time(&m_qTime);
+	m_newestQTime = m_qTime;
+	m_qTimeUs = queueClock();
+	m_lane = NotificationInstance::PriorityNormal;
+	m_merged = 0;
+
+	// Estimate memory used by readings data
+	m_size = 0;
+	const vector<Reading *>& readings = data->getAllReadings();
+	for (auto r = readings.begin(); r != readings.end(); ++r)
+	{
+		m_size += NotificationQueueElement::getReadingSize(*r);
+	}
+}
+
+/**
+ * NotificatioQueueElement destructor
+ */
+NotificationQueueElement::~NotificationQueueElement()
+{
+	// Remove readings
+	delete m_readings;
+}
+
+/**
+ * Move the readings of a newer element of the same asset
+ * into this element, the merged element has no readings
+ *
+ * The queued time of each reading is kept, so the queue age
+ * of the data applies to each merged part.
+ *
+ * @param    element	The element to merge
+ */
+void NotificationQueueElement::merge(NotificationQueueElement* element)
+{
+	if (m_queuedTimes.empty())
+	{
+		m_queuedTimes.assign(m_readings->getCount(), m_qTime);
+	}
+	if (element->m_queuedTimes.empty())
+	{
+		m_queuedTimes.insert(m_queuedTimes.end(),
+				     element->m_readings->getCount(),
+				     element->m_qTime);
+	}
+	else
+	{
+		m_queuedTimes.insert(m_queuedTimes.end(),
+				     element->m_queuedTimes.begin(),
+				     element->m_queuedTimes.end());
+		element->m_queuedTimes.clear();
+	}
+	if (element->m_newestQTime > m_newestQTime)
+	{
+		m_newestQTime = element->m_newestQTime;
+	}
+
+	vector<Reading *> readings = element->m_readings->getAllReadings();
+	element->m_readings->removeAll();
+	m_readings->append(readings);
+
+	m_size += element->m_size;
+	element->m_size = 0;
+	m_merged += element->m_merged + 1;
+}
+
+/**
+ * Estimate the memory used by a Reading object
+ *
+ * Datapoint names and string values are accounted,
+ * array contents are not.
+ *
+ * @param    reading	The Reading object
+ * @return		Estimated size in bytes
+ */
+unsigned long NotificationQueueElement::getReadingSize(Reading* reading)
+{
+	unsigned long size = sizeof(Reading) + reading->getAssetName().size();
+
+	vector<Datapoint *>& dataPoints = reading->getReadingData();
+	for (auto d = dataPoints.begin(); d != dataPoints.end(); ++d)
+	{
+		size += sizeof(Datapoint) + sizeof(Datapoint *) + (*d)->getName().size();
+		if ((*d)->getData().getType() == DatapointValue::T_STRING)
+		{
+			size += (*d)->getData().toStringValue().size();
+		}
+	}
+
+	return size;
+}
+
+/**
+ * Constructor for the NotificationQueue class
+ *
+ * @param    notificationName	NotificationService name
+ * @param    numWorkers		Number of queue shards and worker threads
+ * @param    numEvalWorkers	Number of rule evaluation threads,
+ *				0 means rules are evaluated by the queue workers
+ */
+NotificationQueue::NotificationQueue(const string& notificationName,
+				     unsigned long numWorkers,
+				     unsigned long numEvalWorkers) :
+				     m_name(notificationName)
+{
+	// Set running
+	m_running = true;
+	// Set instance
+	m_instance = this;
+	// No data and no limits
+	m_queuedReadings = 0;
+	m_queuedBytes = 0;
+	m_maxReadings = 0;
+	m_maxBytes = 0;
+	m_bufferMaxBytes = 0;
+
+	// Get logger
+	m_logger = Logger::getLogger();
+
+	if (!numWorkers)
+	{
+		numWorkers = 1;
+	}
+
+	m_evaluations = new EvaluationPool(numEvalWorkers);
+
+	// Create all shards before starting any process queue thread
+	for (unsigned long i = 0; i < numWorkers; ++i)
+	{
+		m_shards.push_back(new QueueShard());
+	}
+	for (unsigned long i = 0; i < numWorkers; ++i)
+	{
+		m_shards[i]->m_thread = new thread(worker, this, i);
+	}
+
+	m_logger->info("Notification queue has %lu worker threads.",
+		       m_shards.size());
+}
+
+/**
+ * NotificatioQueue destructor
+ */
+NotificationQueue::~NotificationQueue()
+{
+	for (auto s = m_shards.begin(); s != m_shards.end(); ++s)
+	{
+		delete *s;
+	}
+	delete m_evaluations;
+}
+
+/**
+ * Get the queue shard of an asset
+ *
+ * An asset is always mapped to the same shard
+ * so that its data is processed in order.
+ *
+ * @param    assetName	The asset name
+ * @return		The queue shard
+ */
+NotificationQueue::QueueShard* NotificationQueue::getShard(const string& assetName)
+{
+	return m_shards[std::hash<string>()(assetName) % m_shards.size()];
+}
+
+/**
+ * Process data still in the buffers
+ */
+void NotificationQueue::stop()
+{
+
+	m_running = false;
+
+	for (auto s = m_shards.begin(); s != m_shards.end(); ++s)
+	{
+		// Take the shard lock so that a waiting worker is not missed
+		lock_guard<mutex> guard((*s)->m_qMutex);
+		(*s)->m_processCv.notify_all();
+	}
+
+	// Waiting for the process threads to complete
+	for (auto s = m_shards.begin(); s != m_shards.end(); ++s)
+	{
+		if ((*s)->m_thread->joinable())
+		{
+			(*s)->m_thread->join();
+		}
+	}
+
+	// No more evaluations
+	m_evaluations->stop();
+
+	// NotifictionQueue is empty now: clear all remaining data
+
+	// Get the subscriptions instance
+	NotificationSubscription* subscriptions = NotificationSubscription::getInstance();
+	if (!subscriptions)
+	{
+		return;
+	}
+
+	NotificationManager* manager = NotificationManager::getInstance();
+
+	// NOTE:
+	//
+	// Notificatiion API server is down: we cannot receive any configuration change
+	// so we don't need to lock subscriptions object
+	//
+        // Get all subscriptions for assetName
+	std::map<std::string, std::vector<SubscriptionElement>>&
+		registeredItems = subscriptions->getAllSubscriptions();
+
+	lock_guard<mutex> guard(manager->m_instancesMutex);
+	// Iterate trough subscriptions
+	for (auto it = registeredItems.begin();
+		  it != registeredItems.end();
+		  ++it)
+	{
+		for (auto s = (*it).second.begin();
+			  s != (*it).second.end();
+			  ++s)
+		{
+			// Get notification rule object
+			string notificationName = (*s).getNotificationName();
+			NotificationInstance* instance = manager->getNotificationInstance(notificationName);
+
+			// Get ruleName
+			if (instance &&
+			    instance->getRule())
+			{
+				string ruleName = instance->getRule()->getName();
+				// Get all assests belonging to current rule
+				vector<NotificationDetail>& assets = instance->getRule()->getAssets();
+
+				//Iterate trough assets
+				for (auto itr = assets.begin();
+					  itr != assets.end();
+					   ++itr)
+				{
+					// Remove all buffers:
+					// queue process is donwn, queue lock not needed
+					this->clearBufferData(ruleName, (*itr).getAssetName());
+				}
+			}
+		}
+	}
+}
+
+/**
+ * Set the queue high-water marks
+ *
+ * @param    maxReadings	Maximum number of queued readings,
+ *				0 means no limit
+ * @param    maxBytes		Maximum size of queued readings data,
+ *				0 means no limit
+ */
+void NotificationQueue::setLimits(unsigned long maxReadings,
+				  unsigned long maxBytes)
+{
+	m_maxReadings = maxReadings;
+	m_maxBytes = maxBytes;
+
+	m_logger->info("Notification queue limits: %lu readings, %lu bytes",
+		       maxReadings,
+		       maxBytes);
+}
+
+/**
+ * Set the memory budget of all the rule buffers
+ *
+ * @param    maxBytes		Maximum size of buffered readings data,
+ *				0 means no limit
+ */
+void NotificationQueue::setBufferBudget(unsigned long maxBytes)
+{
+	m_bufferMaxBytes = maxBytes;
+
+	m_logger->info("Notification rule buffers budget: %lu bytes",
+		       maxBytes);
+}
+
+/**
+ * Set the directory of the rule buffers spill files
+ *
+ * @param    directory		The directory
+ */
+void NotificationQueue::setSpillDirectory(const string& directory)
+{
+	WindowSpill::setDirectory(directory);
+
+	m_logger->info("Notification rule buffers spill directory: %s",
+		       directory.c_str());
+}
+
+/**
+ * Return JSON string with the size of buffered data
+ * per rule and asset and the rule buffers budget
+ *
+ * @return	JSON string
+ */
+string NotificationQueue::getJSONBuffers()
+{
+	// Rule buffers are never removed: they can be used
+	// after releasing the buffers lock
+	vector<pair<SYMBOL_ID, NotificationDataBuffer *>> buffers;
+	{
+		lock_guard<mutex> guard(m_bufferMutex);
+		for (auto b = m_ruleBuffers.begin(); b != m_ruleBuffers.end(); ++b)
+		{
+			buffers.push_back(make_pair((*b).first, &(*b).second));
+		}
+	}
+
+	SymbolTable* symbols = SymbolTable::getInstance();
+	string ret = "{ \"maxBytes\" : " + to_string(m_bufferMaxBytes.load()) + ", ";
+	ret += "\"bufferedBytes\" : " + to_string(NotificationDataBuffer::getTotalBytes()) + ", ";
+	ret += "\"spillFileBytes\" : " + to_string(WindowSpill::getTotalBytes()) + ", ";
+	ret += "\"rules\" : { ";
+	for (auto b = buffers.begin(); b != buffers.end(); ++b)
+	{
+		NotificationDataBuffer* buffer = (*b).second;
+		lock_guard<mutex> ruleGuard(buffer->getMutex());
+
+		vector<SYMBOL_ID> assets;
+		buffer->getAssets(assets);
+
+		ret += "\"" + symbols->getName((*b).first) + "\" : { ";
+		ret += "\"bytes\" : " + to_string(buffer->getBytes()) + ", ";
+		ret += "\"assets\" : { ";
+		for (auto a = assets.begin(); a != assets.end(); ++a)
+		{
+			ret += "\"" + symbols->getName(*a) + "\" : { ";
+			ret += "\"elements\" : " + to_string(buffer->getData(*a).size()) + ", ";
+			ret += "\"bytes\" : " + to_string(buffer->getAssetBytes(*a));
+			WindowSpill* spill = buffer->getSpill(*a);
+			if (spill)
+			{
+				ret += ", \"spilledReadings\" : " + to_string(spill->getReadings());
+				ret += ", \"spilledBytes\" : " + to_string(spill->getBytes());
+			}
+			ret += " }";
+			if (std::next(a, 1) != assets.end())
+			{
+				ret += ", ";
+			}
+		}
+		ret += " } }";
+		if (std::next(b, 1) != buffers.end())
+		{
+			ret += ", ";
+		}
+	}
+	ret += " } }";
+
+	return ret;
+}
+
+/**
+ * Check whether queued data has reached one of the high-water marks
+ *
+ * @return	True if new data cannot be queued, false otherwise
+ */
+static inline bool overLimits(unsigned long queuedReadings,
+			      unsigned long queuedBytes,
+			      unsigned long maxReadings,
+			      unsigned long maxBytes)
+{
+	return (maxReadings && queuedReadings >= maxReadings) ||
+	       (maxBytes && queuedBytes >= maxBytes);
+}
+
+/**
+ * Check whether the queue has reached one of the high-water marks
+ *
+ * @return	True if new data cannot be queued, false otherwise
+ */
+bool NotificationQueue::isFull()
+{
+	return overLimits(m_queuedReadings,
+			  m_queuedBytes,
+			  m_maxReadings,
+			  m_maxBytes);
+}
+
+/**
+ * Add an element to the queue
+ *
+ * The element is rejected and deleted when queued data
+ * has reached one of the high-water marks.
+ *
+ * @param    element		The element to add the queue.
+ * @param    full		Optional output, set to true when
+ *				the element is rejected by the queue limits
+ * @return			True on succes, false otherwise.
+ */
+bool NotificationQueue::addElement(NotificationQueueElement* element,
+				   bool* full)
+{
+	if (!m_running)
+	{
+		// Don't add new elements if queue is being stopped
+		delete element;
+		return true;
+	}
+
+	if (this->isFull())
+	{
+		m_logger->warn("Notification queue is full: "
+			       "rejecting data for asset '%s'",
+			       element->getAssetName().c_str());
+		delete element;
+
+		NotificationManager* manager = NotificationManager::getInstance();
+		if (manager)
+		{
+			manager->updateRejectedStats();
+		}
+		if (full)
+		{
+			*full = true;
+		}
+		return false;
+	}
+
+	if (!this->push(element))
+	{
+		// Queue stopped while waiting: data can be sent again
+		if (full)
+		{
+			*full = true;
+		}
+		return false;
+	}
+
+#ifdef QUEUE_DEBUG_DATA
+	m_logger->debug("Element added to queue, asset [" + element->getAssetName() + \
+			"], #readings " + to_string(element->getAssetData()->getCount()));
+#endif
+
+	return true;
+}
+
+/**
+ * Append an element to the queue shard of its asset
+ *
+ * The shard worker thread is notified only if it is waiting for data,
+ * so elements added while it is processing don't cost a wakeup.
+ * When the shard ring is full the caller waits for the worker,
+ * the element is deleted if the queue is stopped meanwhile.
+ *
+ * @param    element		The element to add the queue.
+ * @return			True if the element has been added,
+ *				false if the queue has been stopped
+ */
+bool NotificationQueue::push(NotificationQueueElement* element)
+{
+	QueueShard* shard = this->getShard(element->getAssetName());
+
+	// Element can be processed and deleted as soon as it is in the ring
+	unsigned long readings = element->getAssetData()->getCount();
+	unsigned long bytes = element->getSize();
+	m_queuedReadings += readings;
+	m_queuedBytes += bytes;
+
+	while (!shard->m_ring.push(element))
+	{
+		if (!m_running)
+		{
+			// Worker threads are stopped: ring is not emptied
+			m_queuedReadings -= readings;
+			m_queuedBytes -= bytes;
+			delete element;
+			return false;
+		}
+		// Ring is full: wait for the worker thread
+		this_thread::sleep_for(chrono::microseconds(100));
+	}
+
+	// Check the worker state after the element is in the ring
+	atomic_thread_fence(memory_order_seq_cst);
+	if (shard->m_sleeping.load() &&
+	    shard->m_sleeping.exchange(false))
+	{
+		lock_guard<mutex> guard(shard->m_qMutex);
+		shard->m_processCv.notify_one();
+	}
+	return true;
+}
+
+/**
+ * Move all the elements in the shard ring to the worker queue,
+ * waiting for data if the ring is empty.
+ *
+ * Windows of quiet assets are checked every QUEUE_WINDOW_FLUSH_MS
+ * meanwhile.
+ *
+ * Called by the shard worker thread only.
+ *
+ * @param    shard	The queue shard
+ * @return		True if data is available,
+ *			false if the queue is stopped and there is no data
+ */
+bool NotificationQueue::takeElements(QueueShard* shard)
+{
+	while (true)
+	{
+		this->takeRing(shard);
+
+		uint64_t now = queueClock();
+		if (now - shard->m_flushed >= QUEUE_WINDOW_FLUSH_MS * 1000)
+		{
+			shard->m_flushed = now;
+			this->flushWindows(shard);
+		}
+
+		if (shard->getSize())
+		{
+			return true;
+		}
+
+		if (!m_running)
+		{
+			// No data and load thread is not running.
+			return false;
+		}
+
+		// No data, wait util notified
+		unique_lock<mutex> sendLock(shard->m_qMutex);
+		shard->m_sleeping.store(true);
+		// Check the ring after setting the worker state
+		atomic_thread_fence(memory_order_seq_cst);
+		if (shard->m_ring.empty() && m_running)
+		{
+			shard->m_processCv.wait_for(sendLock,
+						    chrono::milliseconds(QUEUE_WINDOW_FLUSH_MS));
+		}
+		shard->m_sleeping.store(false);
+	}
+}
+
+/**
+ * Move all the elements in the shard ring to the priority lanes
+ *
+ * Called by the shard worker thread only.
+ *
+ * @param    shard	The queue shard
+ */
+void NotificationQueue::takeRing(QueueShard* shard)
+{
+	NotificationQueueElement* element;
+	if (!shard->m_ring.pop(element))
+	{
+		return;
+	}
+
+	NotificationManager* manager = NotificationManager::getInstance();
+	NotificationSubscription* subscriptions = NotificationSubscription::getInstance();
+
+	// Routed instances are not deleted while getting their priority
+	unsigned long epoch = 0;
+	shared_ptr<const SubscriptionRoutes> routes;
+	if (manager && subscriptions)
+	{
+		epoch = manager->addInstancesUser();
+		routes = subscriptions->getRoutes();
+	}
+
+	do
+	{
+		// Pending data of the same asset is processed in one pass
+		auto queued = shard->m_queued.find(element->getAssetName());
+		if (queued != shard->m_queued.end())
+		{
+			if ((*queued).second->getDatapoints() == element->getDatapoints())
+			{
+				(*queued).second->merge(element);
+				delete element;
+				continue;
+			}
+			// Readings with other datapoints are not merged:
+			// the asset data stays in the same lane, in order
+			element->setLane((*queued).second->getLane());
+		}
+		else if (routes)
+		{
+			element->setLane(this->getLane(*routes, element->getAssetName()));
+		}
+		shard->m_lanes[element->getLane()].push_back(element);
+		shard->m_queued[element->getAssetName()] = element;
+	} while (shard->m_ring.pop(element));
+
+	if (routes)
+	{
+		manager->removeInstancesUser(epoch);
+	}
+}
+
+/**
+ * Evaluate the complete windows of the assets of a queue shard
+ *
+ * Windows are evaluated when data is processed, but a quiet source
+ * sends no data: its last window is complete when no data has been
+ * buffered for the window interval, and it is evaluated here.
+ *
+ * Called by the shard worker thread only.
+ *
+ * @param    shard	The queue shard
+ */
+void NotificationQueue::flushWindows(QueueShard* shard)
+{
+	NotificationManager* manager = NotificationManager::getInstance();
+	NotificationSubscription* subscriptions = NotificationSubscription::getInstance();
+	if (!manager || !subscriptions)
+	{
+		return;
+	}
+
+	// Routed instances are not deleted while evaluated
+	unsigned long epoch = manager->addInstancesUser();
+	shared_ptr<const SubscriptionRoutes> routes = subscriptions->getRoutes();
+	for (auto asset = routes->assets.begin();
+		  asset != routes->assets.end();
+		  ++asset)
+	{
+		// Data of an asset is processed by its shard only
+		if (this->getShard((*asset).first) != shard)
+		{
+			continue;
+		}
+
+		const vector<SubscriptionRoute>& assetRoutes = (*asset).second;
+		for (auto r = assetRoutes.begin(); r != assetRoutes.end(); ++r)
+		{
+			if ((*r).window)
+			{
+				this->processAllDataBuffers((*asset).first, assetRoutes);
+				break;
+			}
+		}
+	}
+	manager->removeInstancesUser(epoch);
+}
+
+/**
+ * Get the priority lane of an asset:
+ * the highest priority of its enabled notifications
+ *
+ * @param    routes	The subscription routes
+ * @param    assetName	The asset name
+ * @return		The lane index
+ */
+unsigned int NotificationQueue::getLane(const SubscriptionRoutes& routes,
+					const string& assetName)
+{
+	unsigned int lane = NotificationInstance::PriorityLow;
+
+	auto asset = routes.assets.find(assetName);
+	if (asset == routes.assets.end())
+	{
+		// Data is discarded quickly
+		return lane;
+	}
+
+	for (auto r = (*asset).second.begin();
+		  r != (*asset).second.end();
+		  ++r)
+	{
+		NotificationInstance* instance = (*r).instance;
+		if (instance &&
+		    instance->isEnabled() &&
+		    (unsigned int)instance->getPriority() < lane)
+		{
+			lane = instance->getPriority();
+		}
+	}
+	return lane;
+}
+
+/**
+ * Select the priority lane to serve
+ *
+ * The highest priority lane with data is served, unless a lower
+ * priority lane with data has been skipped QUEUE_LANE_MAX_SKIPS times:
+ * low priority data keeps moving under high priority load.
+ *
+ * @param    shard	The queue shard, with data
+ * @return		The lane index
+ */
+unsigned int NotificationQueue::selectLane(QueueShard* shard)
+{
+	int lane = -1;
+	for (int i = 0; i < NOTIFICATION_PRIORITIES; i++)
+	{
+		if (shard->m_lanes[i].empty())
+		{
+			shard->m_skipped[i] = 0;
+			continue;
+		}
+		if (lane < 0)
+		{
+			lane = i;
+		}
+		else if (shard->m_skipped[i] >= QUEUE_LANE_MAX_SKIPS)
+		{
+			// Starving lane
+			lane = i;
+			break;
+		}
+	}
+
+	for (int i = 0; i < NOTIFICATION_PRIORITIES; i++)
+	{
+		if (i == lane)
+		{
+			shard->m_skipped[i] = 0;
+		}
+		else if (!shard->m_lanes[i].empty())
+		{
+			shard->m_skipped[i]++;
+		}
+	}
+
+	return lane;
+}
+
+/**
+ * Add a set of elements to the queue
+ *
+ * Elements are added in order to the queue shard of their asset.
+ *
+ * All the elements are rejected and deleted when queued data
+ * has reached one of the high-water marks.
+ *
+ * @param    elements		The elements to add the queue.
+ * @param    full		Optional output, set to true when
+ *				the elements are rejected by the queue limits
+ * @return			True on succes, false otherwise.
+ */
+bool NotificationQueue::addElements(vector<NotificationQueueElement *>& elements,
+				    bool* full)
+{
+	if (!m_running)
+	{
+		// Don't add new elements if queue is being stopped
+		for (auto e = elements.begin(); e != elements.end(); ++e)
+		{
+			delete *e;
+		}
+		return true;
+	}
+
+	if (!elements.size())
+	{
+		return true;
+	}
+
+	if (this->isFull())
+	{
+		m_logger->warn("Notification queue is full: "
+			       "rejecting data for %lu assets",
+			       elements.size());
+		for (auto e = elements.begin(); e != elements.end(); ++e)
+		{
+			delete *e;
+		}
+
+		NotificationManager* manager = NotificationManager::getInstance();
+		if (manager)
+		{
+			manager->updateRejectedStats();
+		}
+		if (full)
+		{
+			*full = true;
+		}
+		return false;
+	}
+
+	for (auto e = elements.begin(); e != elements.end(); ++e)
+	{
+		if (!this->push(*e))
+		{
+			// Queue stopped while waiting: data can be sent again
+			for (++e; e != elements.end(); ++e)
+			{
+				delete *e;
+			}
+			if (full)
+			{
+				*full = true;
+			}
+			return false;
+		}
+	}
+
+#ifdef QUEUE_DEBUG_DATA
+	m_logger->debug("Added %lu elements to queue", elements.size());
+#endif
+
+	return true;
+}
+
+/**
+ * Process data in a queue shard
+ *
+ * @param    shardIndex		The queue shard to process
+ */
+void NotificationQueue::process(unsigned long shardIndex)
+{
+	bool doProcess = true;
+	QueueShard* shard = m_shards[shardIndex];
+
+	while (doProcess)
+	{
+		NotificationQueueElement* data = NULL;
+		// Get data from the queue: elements added meanwhile
+		// are merged with pending data of the same asset
+		doProcess = this->takeElements(shard);
+
+		if (doProcess)
+		{
+			// Get first element in the lane to serve
+			unsigned int lane = this->selectLane(shard);
+			data = shard->m_lanes[lane].front();
+			// Remove the item
+			shard->m_lanes[lane].pop_front();
+			auto queued = shard->m_queued.find(data->getAssetName());
+			if (queued != shard->m_queued.end() &&
+			    (*queued).second == data)
+			{
+				shard->m_queued.erase(queued);
+			}
+
+			m_queuedReadings -= data->getAssetData()->getCount();
+			m_queuedBytes -= data->getSize();
+
+			NotificationManager* manager = NotificationManager::getInstance();
+			if (manager)
+			{
+				// Queue latency per priority lane
+				// of the oldest data of the asset
+				manager->updateLatencyStats(data->getLane(),
+							    queueClock() - data->getQueuedTimeUs());
+			}
+		}
+
+		if (data)
+		{
+			// Merged data of the asset in timestamp order
+			this->coalesce(data);
+			// Process data
+			this->processDataSet(data);
 			delete data;
 		}
 
 #ifdef QUEUE_DEBUG_DATA
-		m_logger->debug("Queue processing done: "
-				"queue has %ld elements",
-				m_queue.size());
+		m_logger->debug("Queue shard %lu processing done: "
+				"shard has %ld elements",
+				shardIndex,
+				shard->getSize());
+#endif
+	}
+
+#ifdef QUEUE_DEBUG_DATA
+		m_logger->debug("Queue shard %lu stopped: size %ld elments",
+				shardIndex,
+				shard->getSize());
 #endif
+}
+
+/**
+ * Compare user timestamps of two readings with their queued time
+ *
+ * @param    a		First reading
+ * @param    b		Second reading
+ * @return		True if first reading is older
+ */
+static bool olderReading(const pair<Reading *, time_t>& a,
+			 const pair<Reading *, time_t>& b)
+{
+	struct timeval tvA, tvB;
+	a.first->getUserTimestamp(&tvA);
+	b.first->getUserTimestamp(&tvB);
+	return timercmp(&tvA, &tvB, <);
+}
+
+/**
+ * Sort the readings of a dequeued element with merged
+ * pending elements of the same asset in user timestamp order.
+ *
+ * Pending elements are merged when they are taken from the shard ring:
+ * rules then process all the pending data of an asset in one pass.
+ *
+ * @param    data	The dequeued element
+ */
+void NotificationQueue::coalesce(NotificationQueueElement* data)
+{
+	NotificationManager* manager = NotificationManager::getInstance();
+	if (manager)
+	{
+		manager->updateCoalescingStats(data->getMerged() + 1);
+	}
+
+	if (!data->getMerged())
+	{
+		return;
+	}
+
+	// Readings are moved, not deleted, with their queued time
+	ReadingSet* readingSet = data->getAssetData();
+	vector<Reading *> readings = readingSet->getAllReadings();
+	vector<time_t>& queuedTimes = data->getQueuedTimes();
+	vector<pair<Reading *, time_t>> sorted;
+	sorted.reserve(readings.size());
+	for (size_t i = 0; i < readings.size(); i++)
+	{
+		sorted.push_back(make_pair(readings[i], queuedTimes[i]));
+	}
+	stable_sort(sorted.begin(), sorted.end(), olderReading);
+
+	for (size_t i = 0; i < sorted.size(); i++)
+	{
+		readings[i] = sorted[i].first;
+		queuedTimes[i] = sorted[i].second;
+	}
+	readingSet->removeAll();
+	readingSet->append(readings);
+}
+
+/**
+ * Process a queue data element
+ *
+ * @param   data	Data element in the queue
+ */
+void NotificationQueue::processDataSet(NotificationQueueElement* data)
+{
+	/**
+	 * Here we have one queue entry, for one assetName only,
+	 *
+	 * (1) Add data to each data buffer[ruleName] related to this assetName
+	 * (2) For each ruleName related to assetName process data in buffer[ruleName]
+	 */
+
+	NotificationSubscription* subscriptions = NotificationSubscription::getInstance();
+	if (!subscriptions)
+	{
+		return;
+	}
+
+	// Get NotificationManager instance
+	NotificationManager* manager = NotificationManager::getInstance();
+
+	// Instances found from now on are not deleted while in use
+	unsigned long epoch = manager->addInstancesUser();
+
+	// Get the published routing table: it is not changed
+	// while in use, updates publish a new table
+	shared_ptr<const SubscriptionRoutes> routes = subscriptions->getRoutes();
+	auto asset = routes->assets.find(data->getAssetName());
+	if (asset != routes->assets.end())
+	{
+		// (1) feed all rule buffers
+		if (this->feedAllDataBuffers(data, (*asset).second))
+		{
+			// (2) process all data in all rule buffers for given assetName
+			this->processAllDataBuffers(data->getAssetName(), (*asset).second);
+		}
+	}
+
+	// Removed instances are deleted when no reader uses them
+	manager->removeInstancesUser(epoch);
+}
+
+/**
+ * Check whether readings have the datapoints needed by a rule
+ *
+ * @param    kept	The datapoints of the readings,
+ *			empty means all datapoints
+ * @param    needed	The datapoints needed by the rule,
+ *			empty means all datapoints
+ * @return		True if all the needed datapoints are kept
+ */
+static bool hasDatapoints(const vector<string>& kept,
+			  const vector<string>& needed)
+{
+	if (kept.empty())
+	{
+		return true;
+	}
+	if (needed.empty())
+	{
+		return false;
+	}
+	for (auto d = needed.begin(); d != needed.end(); ++d)
+	{
+		if (find(kept.begin(), kept.end(), *d) == kept.end())
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Append input data in ALL process data buffers which need assetName
+ * assetName has some rules associated: ruleA, ... ruleN
+ * Append same data in buffera[ruleA][assetName] ... buffera[ruleN][assetName]
+ *
+ * @param    data		Current item in the queue
+ * @param    routes		The subscription routes of the asset
+ */
+bool NotificationQueue::feedAllDataBuffers(NotificationQueueElement* data,
+					   const vector<SubscriptionRoute>& routes)
+{
+	if (!data)
+	{
+		return false;
+	}
+	bool ret = false;
+
+	// Get assetName in the data element
+	string assetName = data->getAssetName();
+
+	// Get NotificationManager instance
+	NotificationManager* manager = NotificationManager::getInstance();
+
+	time_t now = time(NULL);
+	unsigned long count = data->getAssetData()->getCount();
+
+	// Take the readings of the queue element: rules needing all
+	// its data share them, other rules share views or copies
+	vector<Reading *> readings = data->getAssetData()->getAllReadings();
+	// Readings are now owned by the shared readings
+	data->getAssetData()->removeAll();
+	shared_ptr<const SharedReadings> all =
+		allocate_shared<SharedReadings>(PoolAllocator<SharedReadings>(), readings);
+	vector<SharedView> views;
+	// Queued time of each reading of merged elements
+	const vector<time_t>& queuedTimes = data->getQueuedTimes();
+	// Stale readings of this element are counted once: the readings
+	// dropped by any notification are all readings, or readings
+	// older than the newest reading or queued time limit
+	bool staleAll = false;
+	time_t staleOldest = 0;
+	time_t staleQueued = 0;
+
+	for (auto it = routes.begin();
+		  it != routes.end();
+		  ++it)
+	{
+		const string& notificationName = (*it).notificationName;
+		NOTIFICATION_TYPE type;
+		bool enabled = false;
+		bool zombie = false;
+		bool found = false;
+
+		// Instance resolved when the routes were built
+		NotificationInstance* instance = (*it).instance;
+		if (instance)
+		{
+			found = true;
+			zombie = instance->isZombie();
+			enabled = instance->isEnabled() && instance->getRule();
+			if (enabled)
+			{
+				type = instance->getType();
+			}
+		}
+
+		if (enabled &&
+		    !hasDatapoints(data->getDatapoints(), (*it).datapoints))
+		{
+			// Subscribed after data was received
+			Logger::getLogger()->debug("Notification %s needs datapoints of asset %s "
+						   "not kept when data was received",
+						   notificationName.c_str(),
+						   assetName.c_str());
+		}
+		else if (enabled)
+		{
+			// Apply stale data policy of the notification
+			time_t oldest = 0;
+			time_t oldestQueued = 0;
+			if (type.dropStale)
+			{
+				if (type.maxQueueAge)
+				{
+					oldestQueued = now - type.maxQueueAge;
+					if (data->getNewestQueuedTime() < oldestQueued)
+					{
+						// Drop all data for this notification
+						staleAll = true;
+						continue;
+					}
+					if (queuedTimes.empty() ||
+					    data->getQueuedTime() >= oldestQueued)
+					{
+						// No merged part is stale
+						oldestQueued = 0;
+					}
+				}
+				if (type.maxReadingAge)
+				{
+					oldest = now - type.maxReadingAge;
+				}
+			}
+			if (oldest > staleOldest)
+			{
+				staleOldest = oldest;
+			}
+			if (oldestQueued > staleQueued)
+			{
+				staleQueued = oldestQueued;
+			}
+
+			shared_ptr<const SharedReadings> shared = shareReadings(all,
+									       (*it).datapoints,
+									       oldest,
+									       queuedTimes,
+									       oldestQueued,
+									       views);
+			// Feed buffer[ruleName][theAsset] with Readings data
+			ret = this->feedDataBuffer(this->getRouteBuffer(*it),
+						   *it,
+						   shared,
+						   type) || ret;
+		}
+		else
+		{
+			if (found)
+			{
+				if (zombie)
+				{
+					Logger::getLogger()->debug("Notification %s has Zombie instance for asset %s",
+						       		   notificationName.c_str(),
+							   	   assetName.c_str());
+				}
+			}
+			else
+			{
+				Logger::getLogger()->debug("Notification %s has no instance for asset %s",
+					       		   notificationName.c_str(),
+						   	   assetName.c_str());
+			}
+		}
+	}
+
+	unsigned long staleReadings = 0;
+	if (staleAll)
+	{
+		staleReadings = count;
+	}
+	else if (staleOldest || staleQueued)
+	{
+		const vector<Reading *>& allReadings = all->getReadings();
+		for (size_t i = 0; i < allReadings.size(); i++)
+		{
+			if ((staleOldest &&
+			     (time_t)allReadings[i]->getUserTimestamp() < staleOldest) ||
+			    (staleQueued && queuedTimes[i] < staleQueued))
+			{
+				staleReadings++;
+			}
+		}
+	}
+	if (staleReadings)
+	{
+		manager->updateDroppedStats(assetName, staleReadings);
 	}
 
-#ifdef QUEUE_DEBUG_DATA
-		m_logger->debug("Queue stopped: size %ld elments",
-				m_queue.size());
-#endif
+	return ret;
 }
 
 /**
- * Process a queue data element
+ * Copy a Reading with only the given datapoints
  *
- * @param   data	Data element in the queue
+ * @param    reading		The Reading to copy
+ * @param    datapoints		The datapoint names to copy
+ * @return			New Reading object
  */
-void NotificationQueue::processDataSet(NotificationQueueElement* data)
+static Reading* projectReading(Reading* reading,
+			       const vector<string>& datapoints)
 {
-	/**
-	 * Here we have one queue entry, for one assetName only,
-	 *
-	 * (1) Add data to each data buffer[ruleName] related to this assetName
-	 * (2) For each ruleName related to assetName process data in buffer[ruleName]
-	 */
-
-	// (1) feed all rule buffers
-	if (this->feedAllDataBuffers(data))
+	vector<Datapoint *> values;
+	vector<Datapoint *>& dataPoints = reading->getReadingData();
+	for (auto d = dataPoints.begin(); d != dataPoints.end(); ++d)
 	{
-		// (2) process all data in all rule buffers for given assetName
-		this->processAllDataBuffers(data->getAssetName());
+		if (find(datapoints.begin(),
+			 datapoints.end(),
+			 (*d)->getName()) != datapoints.end())
+		{
+			DatapointValue value((*d)->getData());
+			values.push_back(new Datapoint((*d)->getName(), value));
+		}
 	}
+
+	Reading* newReading = new Reading(reading->getAssetName(), values);
+
+	struct timeval tv;
+	reading->getUserTimestamp(&tv);
+	newReading->setUserTimestamp(tv);
+	reading->getTimestamp(&tv);
+	newReading->setTimestamp(tv);
+
+	return newReading;
 }
 
 /**
- * Append input data in ALL process data buffers which need assetName
- * assetName has some rules associated: ruleA, ... ruleN
- * Append same data in buffera[ruleA][assetName] ... buffera[ruleN][assetName]
+ * Get the readings for a rule needing some datapoints
+ * or readings not older than a given time
+ *
+ * Rules with the same needs share the same readings:
+ * readings not older than a given time are a view of all the readings,
+ * only the needed datapoints are copied.
  *
- * @param    data	Current item in the queue
+ * @param    all		All the readings
+ * @param    datapoints		The datapoints needed by the rule,
+ *				empty means all datapoints
+ * @param    oldest		Oldest reading user timestamp to keep,
+ *				0 means all readings
+ * @param    queuedTimes	Queued time of each reading,
+ *				empty if all readings were queued together
+ * @param    oldestQueued	Oldest queued time to keep,
+ *				0 means all readings
+ * @param    views		Readings already built for other rules
+ * @return			The shared readings
  */
-bool NotificationQueue::feedAllDataBuffers(NotificationQueueElement* data)
+static shared_ptr<const SharedReadings> shareReadings(const shared_ptr<const SharedReadings>& all,
+						      const vector<string>& datapoints,
+						      time_t oldest,
+						      const vector<time_t>& queuedTimes,
+						      time_t oldestQueued,
+						      vector<SharedView>& views)
 {
-	if (!data)
+	if (datapoints.empty() && !oldest && !oldestQueued)
 	{
-		return false;
+		return all;
 	}
-	bool ret = false;
-
-	// Get assetName in the data element
-	string assetName = data->getAssetName();
 
-	// Get all subscriptions related the asetName
-	NotificationSubscription* subscriptions = NotificationSubscription::getInstance();
-	if (!subscriptions)
+	for (auto v = views.begin(); v != views.end(); ++v)
 	{
-		return false;
+		if ((*v).oldest == oldest &&
+		    (*v).oldestQueued == oldestQueued &&
+		    *(*v).datapoints == datapoints)
+		{
+			return (*v).readings;
+		}
 	}
 
-	// Get NotificationManager instance
-	NotificationManager* manager = NotificationManager::getInstance();
-
-	subscriptions->lockSubscriptions();
-	std::vector<SubscriptionElement>&
-		subscriptionItems = subscriptions->getSubscription(assetName);
+	SharedView view;
+	view.datapoints = &datapoints;
+	view.oldest = oldest;
+	view.oldestQueued = oldestQueued;
 
-	for (auto it = subscriptionItems.begin();
-		  it != subscriptionItems.end();
-		  ++it)
+	vector<Reading *> readings;
+	const vector<Reading *>& allReadings = all->getReadings();
+	for (size_t i = 0; i < allReadings.size(); i++)
 	{
-		lock_guard<mutex> guard(manager->m_instancesMutex);
+		Reading* reading = allReadings[i];
+		if ((oldest &&
+		     (time_t)reading->getUserTimestamp() < oldest) ||
+		    (oldestQueued && queuedTimes[i] < oldestQueued))
+		{
+			// Stale reading
+			continue;
+		}
 
-		// Get notification instance name
-		string notificationName = (*it).getNotificationName();
-		// Get instance pointer
-		NotificationInstance* instance = manager->getNotificationInstance(notificationName);
-		
-		if (instance &&
-		    instance->isEnabled())
+		if (datapoints.empty())
 		{
-			// Get ruleName for the assetName
-			string ruleName = instance->getRule()->getName();
-			// Feed buffer[ruleName][theAsset] with Readings data
-			ret = this->feedDataBuffer(ruleName,
-						   assetName,
-						   data->getAssetData());
+			readings.push_back(reading);
 		}
 		else
 		{
-			if (instance)
-			{
-				if (instance->isZombie())
-				{
-					Logger::getLogger()->debug("Notification %s has Zombie instance for asset %s",
-						       		   notificationName.c_str(),
-							   	   assetName.c_str());
-				}
-			}
-			else
-			{
-				Logger::getLogger()->debug("Notification %s has no instance for asset %s",
-					       		   notificationName.c_str(),
-						   	   assetName.c_str());
-			}
+			readings.push_back(projectReading(reading, datapoints));
 		}
 	}
-	subscriptions->unlockSubscriptions();
 
-	/*
-	 * Now collect all pending deletes of notification instances
-	 * and really delete them. We defer this until we know we are not
-	 * processing any of the noptifications.
-	 */
-	manager->collectZombies();
+	if (datapoints.empty())
+	{
+		view.readings = allocate_shared<SharedReadings>(PoolAllocator<SharedReadings>(),
+								readings,
+								all);
+	}
+	else
+	{
+		view.readings = allocate_shared<SharedReadings>(PoolAllocator<SharedReadings>(),
+								readings);
+	}
+	views.push_back(view);
 
-	return ret;
+	return view.readings;
 }
 
 /**
- * Append a ReadingSet copy into the process data buffers[rule][asset]
+ * Append shared readings into the process data buffers[rule][asset]
  *
- * @param    ruleName		The ruleName
- * @param    assetName		The assetName
- * @param    assetData		The ReadingSet data
+ * @param    buffer		The data buffers[rule]
+ * @param    route		The subscription route
+ *				with the interned asset and rule names
+ * @param    readings		The shared readings of the rule
+ * @param    type		The notification type with the
+ *				rule buffer memory budget
  * @return			True on success, false otherwise
  */
-bool NotificationQueue::feedDataBuffer(const std::string& ruleName,
-				       const std::string& assetName,
-				       ReadingSet* assetData)
+bool NotificationQueue::feedDataBuffer(NotificationDataBuffer* buffer,
+				       const SubscriptionRoute& route,
+				       const shared_ptr<const SharedReadings>& readings,
+				       const NOTIFICATION_TYPE& type)
 {
-	vector<Reading *> readings = assetData->getAllReadings();
-	vector<Reading *> newReadings;
-	// Create a ReadingSet deep copy
-	for (auto it = readings.cbegin(); it != readings.cend(); it++)
+	if (readings->getReadings().empty())
 	{
-		newReadings.push_back(new Reading(**it));
+		// No data or all readings are stale
+		return false;
 	}
-	ReadingSet* readingsCopy = new ReadingSet;
-	readingsCopy->append(newReadings);
 
-	NotificationDataElement* newdata = new NotificationDataElement(ruleName,
-								       assetName,
-								       readingsCopy);
+	NotificationDataElement* newdata = new NotificationDataElement(route.ruleId,
+								       route.assetId,
+								       readings);
 	if (!newdata)
 	{
 		return false;
 	}
 
 	// Append data
-	lock_guard<mutex> guard(m_bufferMutex);
-	NotificationDataBuffer& dataContainer = this->m_ruleBuffers[ruleName];
-	dataContainer.append(assetName, newdata);
+	lock_guard<mutex> ruleGuard(buffer->getMutex());
+	buffer->append(route.assetId, newdata);
+
+	// Move the oldest data of long windows into spill files:
+	// other evaluations don't read spilled data
+	if (type.bufferSpillBytes && route.window)
+	{
+		unsigned long spilledReadings = buffer->spill(route.assetId,
+							      type.bufferSpillBytes);
+		if (spilledReadings)
+		{
+			NotificationManager::getInstance()->updateSpilledStats(spilledReadings);
+		}
+	}
+
+	// Apply the memory budgets of the notification and of all the buffers
+	unsigned long evictedReadings = 0;
+	unsigned long evictedBytes = 0;
+	if (!buffer->evict(type.bufferMaxBytes,
+			   m_bufferMaxBytes,
+			   newdata->getSize(),
+			   type.bufferEviction,
+			   evictedReadings,
+			   evictedBytes))
+	{
+		Logger::getLogger()->debug("Buffer[%s] is above the memory budget "
+					   "with the newest data only",
+					   route.ruleName.c_str());
+	}
+	if (evictedReadings)
+	{
+		NotificationManager::getInstance()->updateEvictedStats(evictedReadings,
+								       evictedBytes);
+	}
 
 	Logger::getLogger()->debug("Feeding buffer[%s][%s] ...",
-				   ruleName.c_str(),
-				   assetName.c_str());
+				   route.ruleName.c_str(),
+				   newdata->getAssetName().c_str());
 
 	return true;
 }
 
 /**
- * Get content of data buffers[rule][asset]
+ * Get the data buffers[rule]
+ *
+ * Rule buffers are never removed, so the buffer
+ * can be used after releasing the buffers lock,
+ * its data is protected by the rule mutex.
  *
  * @param    ruleName		The ruleName
- * @param    assetName		The assetName
- * @return			Vector of data in the buffer
+ * @return			The rule data buffers
  */
-vector<NotificationDataElement*>& NotificationQueue::getBufferData(const std::string& ruleName,
-								   const std::string& assetName)
+NotificationDataBuffer* NotificationQueue::getRuleBuffer(const std::string& ruleName)
 {
-	NotificationDataBuffer& dataContainer = this->m_ruleBuffers[ruleName];
-	return dataContainer.getData(assetName);
+	return this->getRuleBuffer(SymbolTable::getInstance()->intern(ruleName));
+}
+
+/**
+ * Get the data buffers[rule]
+ *
+ * @param    rule		The interned rule name
+ * @return			The rule data buffers
+ */
+NotificationDataBuffer* NotificationQueue::getRuleBuffer(SYMBOL_ID rule)
+{
+	lock_guard<mutex> guard(m_bufferMutex);
+	return &this->m_ruleBuffers[rule];
+}
+
+/**
+ * Get the data buffers[rule] of a subscription route
+ *
+ * @param    route		The subscription route
+ * @return			The rule data buffers
+ */
+NotificationDataBuffer* NotificationQueue::getRouteBuffer(const SubscriptionRoute& route)
+{
+	if (route.buffer)
+	{
+		return route.buffer;
+	}
+	// Routes built before the queue was created
+	return this->getRuleBuffer(route.ruleId);
 }
 
 /**
  * Clear all in data buffers[rule][asset]
  *
+ * The rule lock is held while clearing data,
+ * so that no queue worker is processing it.
+ *
  * @param    ruleName		The ruleName
  * @param    assetName		The assetName
  */
 void NotificationQueue::clearBufferData(const std::string& ruleName,
 					const std::string& assetName)
 {
-	NotificationDataBuffer& dataContainer = this->m_ruleBuffers[ruleName];
-	vector<NotificationDataElement*>& data = dataContainer.getData(assetName);
+	SymbolTable* symbols = SymbolTable::getInstance();
+	SYMBOL_ID rule = symbols->intern(ruleName);
+	SYMBOL_ID asset = symbols->intern(assetName);
 
-	for (auto it = data.begin();
-                  it != data.end();
-                  ++it)
-        {
-		// Free object data
-		delete(*it);
-	}
-	// Remove all vector objects
-	data.clear();
+	lock_guard<mutex> ruleGuard(this->getRuleBuffer(rule)->getMutex());
+	lock_guard<mutex> guard(m_bufferMutex);
+	this->clearRuleBufferData(rule, asset);
+}
+
+/**
+ * Clear all in data buffers[rule][asset]
+ *
+ * The caller must hold the rule lock and the buffers lock.
+ *
+ * @param    rule		The interned rule name
+ * @param    asset		The interned asset name
+ */
+void NotificationQueue::clearRuleBufferData(SYMBOL_ID rule,
+					    SYMBOL_ID asset)
+{
+	NotificationDataBuffer& dataContainer = this->m_ruleBuffers[rule];
+	// Free all object data
+	dataContainer.trimSpill(asset, UINT64_MAX);
+	dataContainer.keep(asset, 0);
 }
 
 /**
  * Keep some data in buffers[rule][asset]
  *
- * @param    ruleName		The ruleName
- * @param    assetName		The assetName
+ * @param    rule		The interned rule name
+ * @param    asset		The interned asset name
  * @param    num		The number of elements
  *				to keep in buffers[rule][asset]
  */
-void NotificationQueue::keepBufferData(const std::string& ruleName,
-					const std::string& assetName,
+void NotificationQueue::keepBufferData(SYMBOL_ID rule,
+					SYMBOL_ID asset,
 					unsigned long num)
 {
-	NotificationDataBuffer& dataContainer = this->m_ruleBuffers[ruleName];
-	vector<NotificationDataElement*>& data = dataContainer.getData(assetName);
+	NotificationDataBuffer& dataContainer = this->m_ruleBuffers[rule];
 
 	// Save current size
-	unsigned long initialSize = data.size();
-	unsigned long removed = 0;
-
-	for (auto it = data.begin();
-		  it != data.end(); removed++)
-	{
-		if (data.size() <= num)
-		{
-			break;
-		}
-
-		// Free object data
-		delete(*it);
-		//Remove current vector object
-		it = data.erase(it);
-	}
+	unsigned long initialSize = dataContainer.getData(asset).size();
+	unsigned long removed = dataContainer.keep(asset, num);
 	
 #ifdef QUEUE_DEBUG_DATA
+	SymbolTable* symbols = SymbolTable::getInstance();
 	m_logger->debug("Keeping Buffers for " + \
-			assetName + " of " + ruleName + \
+			symbols->getName(asset) + " of " + symbols->getName(rule) + \
 			" removed " + to_string(removed) + "/" + \
 			to_string(initialSize) + " now has size " + \
-			to_string(data.size()));
-	assert(num == data.size());
+			to_string(dataContainer.getData(asset).size()));
+	assert(num == dataContainer.getData(asset).size());
 #endif
 }
 
@@ -534,27 +2309,30 @@ void NotificationQueue::keepBufferData(const std::string& ruleName,
  * Process data in buffers[rule][asset]
  *
  * @param    results		Map with output data, per assetName
- * @param    ruleName		The ruleName
- * @param    assetName		The assetName
+ * @param    buffer		The data buffers[rule],
+ *				the caller holds the rule lock
  * @param    info		The notification info:
- *				evaluation type and time period
+ *				asset, evaluation type and time period
  * @return			True if processed data found or false.
  */
 bool NotificationQueue::processDataBuffer(map<string, AssetData>& results,
-					  const string& ruleName,
-					  const string& assetName,
+					  NotificationDataBuffer* buffer,
 					  NotificationDetail& info)
 {
 #ifdef QUEUE_DEBUG_DATA
-	assert(assetName.compare(info.getAssetName()) == 0);
-	assert(ruleName.compare(info.getRuleName()) == 0);
+	const string& assetName = info.getAssetName();
 #endif
 
-	m_bufferMutex.lock();
-	// Get all data for assetName in the buffer[ruleName]
-	vector<NotificationDataElement*>& readingsData =
-		this->getBufferData(ruleName, assetName);
-	m_bufferMutex.unlock();
+	// Numeric datapoint columns for window aggregates
+	EvaluationType::EVAL_TYPE type = info.getType();
+	buffer->setColumns(info.getAssetId(),
+			   type == EvaluationType::Minimum ||
+			   type == EvaluationType::Maximum ||
+			   type == EvaluationType::Average,
+			   info.getIntervalUs());
+
+	// Get all data for the asset in the buffer[rule]
+	RULE_BUFFER_DATA& readingsData = buffer->getData(info.getAssetId());
 
 	if (readingsData.size() == 0)
 	{
@@ -577,18 +2355,20 @@ bool NotificationQueue::processDataBuffer(map<string, AssetData>& results,
 #endif
 
 	// Process all reading data in the buffer
-	return this->processAllReadings(info, readingsData, results);
+	return this->processAllReadings(info, buffer, readingsData, results);
 }
 
 /**
  * Call rule plugin_eval with notification JSON data
  *
  * @param    results	Ready notification results
- * @param    rule	The RulePlugin instance
+ * @param    instance	The notification instance
  */
 void NotificationQueue::evalRule(map<string, AssetData>& results,
-				 NotificationRule* rule)
+				 NotificationInstance* instance)
 {
+	NotificationRule* rule = instance->getRule();
+
 	// Output data string for MIN/MAX/AVG/ALL DATA
 	map<string, string> JSONOutput;
 	// Points in time data for all SingleItem assets data
@@ -635,12 +2415,12 @@ void NotificationQueue::evalRule(map<string, AssetData>& results,
 		evalJSON += " }";
 
 		// Call plugin_eval, plugin_reason and plugin_deliver
-		deliverNotification(rule, evalJSON);
+		deliverNotification(instance, evalJSON);
 	}
 	else
 	{
 		// Deliver SingleItem data + ready data
-		deliverData(rule, singleItem, JSONOutput);
+		deliverData(instance, singleItem, JSONOutput);
 	}
 
 	// Clean all buffers for SingleItem data
@@ -655,7 +2435,9 @@ void NotificationQueue::evalRule(map<string, AssetData>& results,
 		{
 			// Clear all data in buffer buffers[rule][asset]
 			lock_guard<mutex> guard(m_bufferMutex);
-			this->clearBufferData(rule->getName(), (*mm).first);
+			SymbolTable* symbols = SymbolTable::getInstance();
+			this->clearRuleBufferData(symbols->intern(rule->getName()),
+						  symbols->intern((*mm).first));
 		}
 	}
 }
@@ -672,57 +2454,81 @@ void NotificationQueue::evalRule(map<string, AssetData>& results,
  * (3) If a notification is ready, call rule plugin_eval
  *     and delivery plugin_deliver (if notification has to be sent)
  *
+ * Data of rules with assets in other queue shards is
+ * protected by the rule lock.
+ *
  * @param    assetName		Current assetName
  *				that is receiving notifications data
+ * @param    routes		The subscription routes of the asset
  */
-void NotificationQueue::processAllDataBuffers(const string& assetName)
+void NotificationQueue::processAllDataBuffers(const string& assetName,
+					      const vector<SubscriptionRoute>& routes)
 {
-	// Get the subscriptions instance
-	NotificationSubscription* subscriptions = NotificationSubscription::getInstance();
-	if (!subscriptions)
+	// One evaluation task per subscription
+	vector<function<void()>> tasks;
+	for (auto it = routes.begin();
+		  it != routes.end();
+		  ++it)
 	{
-		return;
+		const SubscriptionRoute* route = &(*it);
+		tasks.push_back([this, &assetName, route] {
+			this->processSubscription(assetName, *route);
+		});
 	}
-	// Get all subscriptions for assetName
-	subscriptions->lockSubscriptions();
-	std::vector<SubscriptionElement>&
-		registeredItems = subscriptions->getSubscription(assetName);
 
-	// Get NotificationManager instance
-	NotificationManager* manager = NotificationManager::getInstance();
+	// Evaluate rules concurrently: all results are delivered
+	// before processing next data of assetName
+	m_evaluations->run(tasks);
+}
 
-	// Iterate trough subscriptions
-	for (auto it = registeredItems.begin();
-		  it != registeredItems.end();
-		  ++it)
-	{
-		lock_guard<mutex> guard(manager->m_instancesMutex);
+/**
+ * Process all data buffers of a subscription rule
+ * and send the notification when ready
+ *
+ * The instance and the rule buffers are resolved in the routing
+ * table, the evaluation is done with the rule lock only.
+ *
+ * @param    assetName		Current assetName
+ *				that is receiving notifications data
+ * @param    route		The subscription route to process
+ */
+void NotificationQueue::processSubscription(const string& assetName,
+					    const SubscriptionRoute& route)
+{
+	// Per asset notification map
+	map<string, AssetData> results;
 
-		// Per asset notification map
-		map<string, AssetData> results;
+	const string& notificationName = route.notificationName;
+	NotificationInstance* instance = route.instance;
+
+	// Check wether the instance exists and it is enabled
+	if (!instance ||
+	    !instance->getRule() ||
+	    !instance->isEnabled())
+	{
+		Logger::getLogger()->debug("Skipping instance for asset %s in notification %s",
+					   assetName.c_str(),
+					   notificationName.c_str());
+		// Skip this instance
+		return;
+	}
 
-		// Get notification instance name
-		string notificationName = (*it).getNotificationName();
-		// Get instance pointer
-		NotificationInstance* instance = manager->getNotificationInstance(notificationName);
+	const string& ruleName = route.ruleName;
+	NotificationDataBuffer* buffer = this->getRouteBuffer(route);
 
-		// Check wether the instance exists and it is enabled
-		if (!instance ||
-		    !instance->getRule() ||
-		    !instance->isEnabled())
-		{
-			Logger::getLogger()->debug("Skipping instance for asset %s in notification %s",
-						   assetName.c_str(),
-						   (*it).getNotificationName().c_str());
-			// Skip this instance
-			continue;
-		}
+	// Get all assests belonging to current rule
+	vector<NotificationDetail> assets;
+	instance->getRule()->copyAssets(assets);
 
-		// Get ruleName for the assetName
-		string ruleName = instance->getRule()->getName();
+	// Don't let other queue workers feed or process rule data
+	lock_guard<mutex> ruleGuard(buffer->getMutex());
 
-		// Get all assests belonging to current rule
-		vector<NotificationDetail>& assets = instance->getRule()->getAssets();
+	// Backlogged data may complete several windows:
+	// all of them are evaluated, in time order
+	bool ready = true;
+	while (ready)
+	{
+		results.clear();
 
 		// Iterate trough assets
 		for (auto itr = assets.begin();
@@ -731,19 +2537,22 @@ void NotificationQueue::processAllDataBuffers(const string& assetName)
 		{
 			// Process data buffer and fill results
 			this->processDataBuffer(results,
-						ruleName,
-						(*itr).getAssetName(),
+						buffer,
 						*itr);
 		}
 
 		// Eval rule?
-		if (results.size() == assets.size())
+		ready = !assets.empty() &&
+			results.size() == assets.size();
+		if (ready)
 		{
 			// Notification data ready: eval data and sent notification
-			this->sendNotification(results, *it);
+			this->sendNotification(results, instance);
+
+			// Next windows of all the assets complete?
+			ready = this->windowsReady(buffer, assets);
 		}
 	}
-	subscriptions->unlockSubscriptions();
 }
 
 /**
@@ -754,6 +2563,7 @@ void NotificationQueue::processAllDataBuffers(const string& assetName)
  * or all the readings data, accordingly to rule evaluation type
  *
  * @param    info		The notification details for assetName
+ * @param    buffer		The data buffers[rule]
  * @param    readingsData	All data buffers
  * @param    results		The output result map to fill
  * @return			True if notifcation is ready to be sent,
@@ -761,7 +2571,8 @@ void NotificationQueue::processAllDataBuffers(const string& assetName)
  *
  */
 bool NotificationQueue::processAllReadings(NotificationDetail& info,
-					   vector<NotificationDataElement *>& readingsData,
+					   NotificationDataBuffer* buffer,
+					   RULE_BUFFER_DATA& readingsData,
 					   map<string, AssetData>& results)
 {
 	bool evalRule = false;
@@ -812,9 +2623,10 @@ bool NotificationQueue::processAllReadings(NotificationDetail& info,
 		{
 		// Process ALL buffers
 		map<string, string> output;
-		this->processAllBuffers(readingsData,
+		this->processAllBuffers(buffer,
+					readingsData,
 					info.getType(),
-					info.getInterval(),
+					info.getIntervalUs(),
 					output);
 
 		if (output.size())
@@ -925,8 +2737,8 @@ string NotificationQueue::processLastBuffer(NotificationDataElement* data)
 
 		// Just keep last buffer
 		lock_guard<mutex> guard(m_bufferMutex);
-		this->keepBufferData(data->getRuleName(),
-				     data->getAssetName(),
+		this->keepBufferData(data->getRuleId(),
+				     data->getAssetId(),
 				     1);
 
 		return ret;
@@ -939,90 +2751,212 @@ string NotificationQueue::processLastBuffer(NotificationDataElement* data)
  * evaluation of notification data
  *
  * @param    results		Notification data
- * @param    subscription	Current subscription
- * @return			True if the notification can be sent,
- *				false otherwise.
+ * @param    instance		Current notification instance
  */
 void NotificationQueue::sendNotification(map<string, AssetData>& results,
-					 SubscriptionElement& subscription)
+					 NotificationInstance* instance)
+{
+	if (instance &&
+	    instance->getRule())
+	{
+		this->evalRule(results, instance);
+	}
+}
+
+/**
+ * Check whether the first window of the buffered data of an asset
+ * is complete
+ *
+ * The window starts at the oldest buffered or spilled reading.
+ * It is complete when a newer reading is buffered, or when no data has
+ * been buffered for the window interval, at least QUEUE_WINDOW_FLUSH_MS:
+ * the source is quiet, no newer reading would complete the window.
+ *
+ * The caller holds the rule lock.
+ *
+ * @param    buffer		The data buffers[rule]
+ * @param    readingsData	The buffered data of the asset, not empty
+ * @param    intervalUs		The window interval in microseconds
+ * @param    endTime		Output window end time in microseconds
+ * @return			True if the window is complete
+ */
+bool NotificationQueue::windowComplete(NotificationDataBuffer* buffer,
+				       RULE_BUFFER_DATA& readingsData,
+				       uint64_t intervalUs,
+				       uint64_t& endTime)
+{
+	SYMBOL_ID asset = readingsData.front()->getAssetId();
+
+	uint64_t startTime = readingsData.front()->getFirstTime();
+	WindowSpill* spill = buffer->getSpill(asset);
+	if (spill && spill->getFirstTime() < startTime)
+	{
+		startTime = spill->getFirstTime();
+	}
+	endTime = startTime + intervalUs;
+
+	if (buffer->getLastTime(asset) > endTime)
+	{
+		return true;
+	}
+
+	uint64_t quiet = intervalUs;
+	if (quiet < QUEUE_WINDOW_FLUSH_MS * 1000)
+	{
+		quiet = QUEUE_WINDOW_FLUSH_MS * 1000;
+	}
+	return queueClock() - buffer->getArrivalTime(asset) > quiet;
+}
+
+/**
+ * Check whether the next window of all the assets of a rule is complete
+ *
+ * The caller holds the rule lock.
+ *
+ * @param    buffer		The data buffers[rule]
+ * @param    assets		The rule assets
+ * @return			True if all the assets are evaluated by windows
+ *				and their next window is complete
+ */
+bool NotificationQueue::windowsReady(NotificationDataBuffer* buffer,
+				     const vector<NotificationDetail>& assets)
 {
-	if (subscription.getInstance())
+	for (auto a = assets.begin(); a != assets.end(); ++a)
 	{
-		this->evalRule(results, subscription.getRule());
+		if ((*a).getType() == EvaluationType::SingleItem)
+		{
+			return false;
+		}
+
+		RULE_BUFFER_DATA& readingsData = buffer->getData((*a).getAssetId());
+		uint64_t endTime;
+		if (readingsData.empty() ||
+		    !this->windowComplete(buffer,
+					  readingsData,
+					  (*a).getIntervalUs(),
+					  endTime))
+		{
+			return false;
+		}
 	}
+	return true;
 }
 
 /**
  * Process all data buffers
  *
+ * The evaluation window starts at the user timestamp of the oldest
+ * buffered reading and is complete when a newer reading is buffered:
+ * readings are windowed by event time, not by arrival time,
+ * so backlogged data is evaluated in the window it belongs to.
+ * The window of a quiet asset is complete when no data has been
+ * buffered for the window interval, see windowComplete().
+ *
+ * Buffered elements are in first reading time order, the window end
+ * is found by binary search.
+ * Elements with readings on both sides of the window end are split:
+ * the readings after the window end are kept for the next window.
+ *
+ * Minimum, Maximum and Average of numeric datapoints are taken
+ * from the running aggregates of the asset columns when these are valid:
+ * closing a window costs a number of operations per datapoint,
+ * not per buffered reading.
+ * Spilled readings are older than the buffered ones:
+ * the window starts with them when there are any.
+ *
+ * @param    buffer		The data buffers[rule]
  * @param    readingsData	The data buffers
  * @param    type		The rule evaluation type
- * @param    timeInterval	The time interval for data evaluation
+ * @param    intervalUs		The time interval for data evaluation
+ *				in microseconds
  * @return			A map with string values which
  *				represents the notification data ready.
  *				If the map is empty notification is not ready yet.
  *				
  */
-void NotificationQueue::processAllBuffers(vector<NotificationDataElement *>& readingsData,
+void NotificationQueue::processAllBuffers(NotificationDataBuffer* buffer,
+					  RULE_BUFFER_DATA& readingsData,
 					  EvaluationType::EVAL_TYPE type,
-					  unsigned long timeInterval,
+					  uint64_t intervalUs,
 					  map<string, string>& result)
 {
-	bool evalRule = false;
-	unsigned long first_time = 0;
-	unsigned long buffersDone = 0;
-	string assetName;
-	string ruleName;
+	if (readingsData.empty())
+	{
+		return;
+	}
 
-	// Iterate throught buffers data
-	for (auto item = readingsData.begin();
-		  item != readingsData.end();
-		  ++item)
+	NotificationDataElement* first = readingsData.front();
+	SYMBOL_ID asset = first->getAssetId();
+	SYMBOL_ID rule = first->getRuleId();
+
+	WindowSpill* spill = buffer->getSpill(asset);
+	uint64_t endTime;
+	if (!this->windowComplete(buffer, readingsData, intervalUs, endTime))
 	{
-		buffersDone++;
-		// Processing data, for assetName
-#ifdef QUEUE_DEBUG_DATA
-		if (!assetName.empty())
-		{
-			assert(assetName.compare((*item)->getAssetName()) == 0);
-		}
-#endif
-		assetName = (*item)->getAssetName();
+		// Window is not complete yet
+		return;
+	}
 
-#ifdef QUEUE_DEBUG_DATA
-		if (!ruleName.empty())
-		{
-			assert(ruleName.compare((*item)->getRuleName()) == 0);
-		}
-#endif
-		ruleName = (*item)->getRuleName();
+	// First element starting after the window end
+	auto last = upper_bound(readingsData.begin(),
+				readingsData.end(),
+				endTime,
+				[](uint64_t t, NotificationDataElement* e)
+				{
+					return t < e->getFirstTime();
+				});
+	unsigned long buffersDone = last - readingsData.begin();
+
+	// Aggregate data in the window and set values in result map
+	WindowColumns* columns = buffer->getColumns(asset);
+	if (!spill && columns && type != EvaluationType::All)
+	{
+		columns->aggregate(endTime, type, result);
+	}
+	else
+	{
+		aggregateData(readingsData, buffersDone, endTime, type, spill, result);
+	}
 
-		if (item == readingsData.begin())
+	// Readings after the window end in the elements of the window
+	vector<NotificationDataElement *> splits;
+	for (auto straddle = readingsData.begin(); straddle != last; ++straddle)
+	{
+		if ((*straddle)->getLastTime() <= endTime)
 		{
-			// Mark first_time as timestamp of first data buffer
-			first_time = (*item)->getTime();
+			continue;
 		}
 
-		if (((*item)->getTime() - first_time) > timeInterval)
+		vector<Reading *> remaining;
+		const vector<Reading *>& readings = (*straddle)->getData()->getAllReadings();
+		for (auto r = readings.begin();
+			  r != readings.end();
+			  ++r)
 		{
-			// Exit from buffers loop
-			evalRule = true;
-			break;
+			if (readingTime(*r) > endTime)
+			{
+				remaining.push_back(*r);
+			}
 		}
+		shared_ptr<const SharedReadings> view =
+			allocate_shared<SharedReadings>(PoolAllocator<SharedReadings>(),
+							remaining,
+							(*straddle)->getShared());
+		splits.push_back(new NotificationDataElement(rule, asset, view));
 	}
 
-	// Return notification data
-	if (buffersDone && evalRule)
+	// Remove the window buffers: split elements
+	// are after them, being newer than the window end
+	buffer->trimSpill(asset, endTime);
+	for (auto s = splits.begin(); s != splits.end(); ++s)
 	{
-		// Aggregate data in the buffers and set values in result map
-		aggregateData(readingsData, buffersDone, type, result);
-
-		// Just keep buffersDone buffers
-		lock_guard<mutex> guard(m_bufferMutex);
-		this->keepBufferData(ruleName,
-				     assetName,
-				     readingsData.size() - buffersDone);
+		buffer->reinsert(asset, *s);
 	}
+	lock_guard<mutex> guard(m_bufferMutex);
+	this->keepBufferData(rule,
+			     asset,
+			     readingsData.size() - buffersDone);
+	buffer->trimColumns(asset, endTime);
 }
 
 /**
@@ -1183,23 +3117,21 @@ void NotificationQueue::setSumValues(map<string, ResultData>& result,
  * 4) send notification via delivery "plugin_deliver"
  * 5) update Audit log
  *
- * @param    rule	The notification rule
+ * @param    instance	The notification instance
  * @param    data	JSON data to evaluate
  *
  */
-static void deliverNotification(NotificationRule* rule,
+static void deliverNotification(NotificationInstance* instance,
 				const string& data)
 {
+	NotificationRule* rule = instance->getRule();
+
 	// Eval notification data via ruel "plugin_eval"
 	bool evalRule = rule->getPlugin()->eval(data);
 
 	// Get instances
 	NotificationManager* instances = NotificationManager::getInstance();
 
-	// Find instance for this rule
-	NotificationInstance* instance =
-		instances->getNotificationInstance(rule->getNotificationName());
-
 	// Get delivery queue object
 	DeliveryQueue* dQueue = DeliveryQueue::getInstance();
 
@@ -1270,22 +3202,50 @@ static void deliverNotification(NotificationRule* rule,
  *
  * @param    readingsData	Data buffers
  * @param    size		Number of buffers to aggregate
+ * @param    endTime		Window end time in microseconds:
+ *				newer readings are not aggregated
  * @param    type		The evalaution type
+ * @param    spill		Spilled data, older than the buffers, or NULL
  * @param    ret		Output map with data
  *				map[dataPointName] = value(s)
  */
-void NotificationQueue::aggregateData(vector<NotificationDataElement *>& readingsData,
+void NotificationQueue::aggregateData(RULE_BUFFER_DATA& readingsData,
 				      unsigned long num,
+				      uint64_t endTime,
 				      EvaluationType::EVAL_TYPE type,
+				      const WindowSpill* spill,
 				      std::map<std::string, string>& ret)
 {
 	std::map<std::string, ResultData> result;
-	string assetName;
-	string ruleName;
 
 	unsigned long i = 0;
 	unsigned long readingsDone = 0;
 
+	// Copies of the spilled values kept for All
+	std::vector<Datapoint *> spilled;
+	if (spill)
+	{
+		spill->read(endTime, [&](const vector<Datapoint *>& data)
+		{
+			readingsDone++;
+			for (auto d = data.begin();
+				  d != data.end();
+				  ++d)
+			{
+				if (type == EvaluationType::All)
+				{
+					DatapointValue value((*d)->getData());
+					spilled.push_back(new Datapoint((*d)->getName(), value));
+					result[(*d)->getName()].vData.push_back(spilled.back());
+				}
+				else
+				{
+					this->setValue(result, *d, type);
+				}
+			}
+		});
+	}
+
 	// Iterate throught buffers data
 	for (auto item = readingsData.begin();
 		  item != readingsData.end() &&
@@ -1293,20 +3253,10 @@ void NotificationQueue::aggregateData(vector<NotificationDataElement *>& reading
 		  ++item, i++)
 	{
 #ifdef QUEUE_DEBUG_DATA
-		if (!assetName.empty())
-		{
-			assert(assetName.compare((*item)->getAssetName()) == 0);
-		}
-#endif
-		assetName = (*item)->getAssetName();
-
-#ifdef QUEUE_DEBUG_DATA
-		if (!ruleName.empty())
-		{
-			assert(ruleName.compare((*item)->getRuleName()) == 0);
-		}
+		assert((*item)->getAssetId() == readingsData.front()->getAssetId());
+		assert((*item)->getRuleId() == readingsData.front()->getRuleId());
+		const string& assetName = (*item)->getAssetName();
 #endif
-		ruleName = (*item)->getRuleName();
 
 		// Iterate throught readings
 		const std::vector<Reading *>& readings = (*item)->getData()->getAllReadings();
@@ -1314,6 +3264,11 @@ void NotificationQueue::aggregateData(vector<NotificationDataElement *>& reading
 			  r != readings.end();
 			  ++r)
 		{
+			if (readingTime(*r) > endTime)
+			{
+				// Belongs to next window
+				continue;
+			}
 			readingsDone++;
 
 #ifdef QUEUE_DEBUG_DATA
@@ -1412,6 +3367,11 @@ void NotificationQueue::aggregateData(vector<NotificationDataElement *>& reading
 			// Empty result data is returned
 			break;
 	}
+
+	for (auto d = spilled.begin(); d != spilled.end(); ++d)
+	{
+		delete *d;
+	}
 }
 
 /**
@@ -1421,7 +3381,7 @@ void NotificationQueue::aggregateData(vector<NotificationDataElement *>& reading
  * @param    readingsData	Vector of data buffers
  * @param    results		Output result map
  */
-void NotificationQueue::setSingleItemData(vector<NotificationDataElement *>& readingsData,
+void NotificationQueue::setSingleItemData(RULE_BUFFER_DATA& readingsData,
 					  map<string, AssetData>& results)
 {
 
@@ -1467,11 +3427,11 @@ void addReadyData(const map<string, string>& readyData,
  * Each SingleItem notification data + time aggregated data
  * is passed to plugin_eval -> plugin_reason -> plugin_deliver
  *
- * @param    rule		The notification rule
+ * @param    instance		The notification instance
  * @param    itemData		Input vector with all SingleItem Reading data
  * @param    readyData		Input map with ready  time aggregated data
  */
-static void deliverData(NotificationRule* rule,
+static void deliverData(NotificationInstance* instance,
 			const std::multimap<uint64_t, Reading*>& itemData,
 			const map<string, string>& readyData)
 {
@@ -1556,7 +3516,7 @@ static void deliverData(NotificationRule* rule,
 		// If all assets are available call plugin_eval, plugin_reason and plugin_deliver
 		if (assets.size() == values.size())
 		{
-			deliverNotification(rule, output);
+			deliverNotification(instance, output);
 		}
 	}
 }
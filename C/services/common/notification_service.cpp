@@ -27,6 +27,27 @@
 
 using namespace std;
 
+/**
+ * Get the directory of the rule buffers spill files:
+ * the FogLAMP data directory
+ *
+ * @return	The directory path
+ */
+static string getSpillDirectory()
+{
+	const char* dir = getenv("FOGLAMP_DATA");
+	if (dir)
+	{
+		return string(dir);
+	}
+	dir = getenv("FOGLAMP_ROOT");
+	if (dir)
+	{
+		return string(dir) + "/data";
+	}
+	return string("/tmp");
+}
+
 /**
  * Constructor for the NotificationService class
  *
@@ -47,8 +68,8 @@ NotificationService::NotificationService(const string& myName) :
 
 	m_logger->warn("Starting %s notification server", myName.c_str());
 
-	// One thread
-	unsigned int threads = 1;
+	// Thread pool size is set from configuration before API start
+	unsigned int threads = DEFAULT_API_THREADS;
 
 	// Instantiate the NotificationApi class
 	m_api = new NotificationApi(servicePort, threads);
@@ -56,6 +77,16 @@ NotificationService::NotificationService(const string& myName) :
 	// Set NULL for other resources
 	m_managerClient = NULL;
 	m_managementApi = NULL;
+
+	// Default notification queue high-water marks
+	m_queue_max_readings = DEFAULT_QUEUE_MAX_READINGS;
+	m_queue_max_bytes = DEFAULT_QUEUE_MAX_BYTES;
+	m_buffers_max_bytes = DEFAULT_BUFFERS_MAX_BYTES;
+
+	// Thread counts are set from configuration
+	m_delivery_threads = 0;
+	m_queue_threads = 0;
+	m_evaluation_threads = DEFAULT_EVALUATION_WORKER_THREADS;
 }
 
 /**
@@ -96,21 +127,6 @@ bool NotificationService::start(string& coreAddress,
 		sleep(1);
 	}
 
-        // Enable http API methods
-        m_api->initResources();
-
-        // Start the NotificationApi on service port
-	m_api->start();
-
-	// Allow time for the listeners to start before we continue
-	while(m_api->getListenerPort() == 0)
-	{
-		sleep(1);
-	}
-
-	// Set Notification callback url prefix
-	m_api->setCallBackURL();
-
 	// Get management client
 	m_managerClient = new ManagementClient(coreAddress, corePort);
 	if (!m_managerClient)
@@ -149,6 +165,63 @@ bool NotificationService::start(string& coreAddress,
 					 "integer", "2", "2");
 	notificationServerConfig.setItemDisplayName("deliveryThreads",
 						    "Maximun number of delivery threads");
+
+	notificationServerConfig.addItem("queueThreads",
+					 "Number of threads processing notification data. "
+					 "Data of an asset is always processed by the same thread. "
+					 "Changes need a service restart",
+					 "integer",
+					 to_string(DEFAULT_QUEUE_WORKER_THREADS),
+					 to_string(DEFAULT_QUEUE_WORKER_THREADS));
+	notificationServerConfig.setItemDisplayName("queueThreads",
+						    "Number of notification data threads");
+
+	notificationServerConfig.addItem("evaluationThreads",
+					 "Number of threads evaluating the notification rules "
+					 "of an asset concurrently, 0 means no concurrent evaluation. "
+					 "Changes need a service restart",
+					 "integer",
+					 to_string(DEFAULT_EVALUATION_WORKER_THREADS),
+					 to_string(DEFAULT_EVALUATION_WORKER_THREADS));
+	notificationServerConfig.setItemDisplayName("evaluationThreads",
+						    "Number of rule evaluation threads");
+
+	notificationServerConfig.addItem("apiThreads",
+					 "Number of threads handling notification API calls "
+					 "and reading callbacks. Changes need a service restart",
+					 "integer",
+					 to_string(DEFAULT_API_THREADS),
+					 to_string(DEFAULT_API_THREADS));
+	notificationServerConfig.setItemDisplayName("apiThreads",
+						    "Number of API threads");
+
+	notificationServerConfig.addItem("queueMaxReadings",
+					 "Maximum number of readings in the notification queue, "
+					 "readings are rejected above this value. 0 means no limit",
+					 "integer",
+					 to_string(DEFAULT_QUEUE_MAX_READINGS),
+					 to_string(DEFAULT_QUEUE_MAX_READINGS));
+	notificationServerConfig.setItemDisplayName("queueMaxReadings",
+						    "Maximum queued readings");
+
+	notificationServerConfig.addItem("queueMaxBytes",
+					 "Maximum size in bytes of readings in the notification queue, "
+					 "readings are rejected above this value. 0 means no limit",
+					 "integer",
+					 to_string(DEFAULT_QUEUE_MAX_BYTES),
+					 to_string(DEFAULT_QUEUE_MAX_BYTES));
+	notificationServerConfig.setItemDisplayName("queueMaxBytes",
+						    "Maximum queued readings size");
+
+	notificationServerConfig.addItem("buffersMaxBytes",
+					 "Maximum size in bytes of readings buffered for all the "
+					 "notification rules, data is evicted above this value. "
+					 "0 means no limit",
+					 "integer",
+					 to_string(DEFAULT_BUFFERS_MAX_BYTES),
+					 to_string(DEFAULT_BUFFERS_MAX_BYTES));
+	notificationServerConfig.setItemDisplayName("buffersMaxBytes",
+						    "Maximum buffered readings size");
 	
 	if (!m_managerClient->addCategory(notificationServerConfig, true))
 	{
@@ -160,6 +233,29 @@ bool NotificationService::start(string& coreAddress,
 		return false;
 	}
 
+	// Set NotificationApi thread pool size before starting it
+	ConfigCategory serverConfig = m_managerClient->getCategory(m_name);
+	if (serverConfig.itemExists("apiThreads"))
+	{
+		unsigned int apiThreads = atoi(serverConfig.getValue("apiThreads").c_str());
+		m_api->setThreads(apiThreads ? apiThreads : DEFAULT_API_THREADS);
+	}
+
+        // Enable http API methods
+        m_api->initResources();
+
+        // Start the NotificationApi on service port
+	m_api->start();
+
+	// Allow time for the listeners to start before we continue
+	while(m_api->getListenerPort() == 0)
+	{
+		sleep(1);
+	}
+
+	// Set Notification callback url prefix
+	m_api->setCallBackURL();
+
 	// Register this notification service with FogLAMP core
 	unsigned short listenerPort = m_api->getListenerPort();
 	unsigned short managementListener = m_managementApi->getListenerPort();
@@ -202,6 +298,23 @@ bool NotificationService::start(string& coreAddress,
 		m_delivery_threads = DEFAULT_DELIVERY_WORKER_THREADS;
 	}
 
+	if (category.itemExists("queueThreads"))
+	{
+		m_queue_threads = atoi(category.getValue("queueThreads").c_str());
+	}
+	if (!m_queue_threads)
+	{
+		m_queue_threads = DEFAULT_QUEUE_WORKER_THREADS;
+	}
+
+	if (category.itemExists("evaluationThreads"))
+	{
+		m_evaluation_threads = atoi(category.getValue("evaluationThreads").c_str());
+	}
+
+	// Get notification queue high-water marks
+	this->setQueueLimits(category);
+
 	// Get Storage service
 	ServiceRecord storageInfo("FogLAMP Storage");
 	if (!m_managerClient->getService(storageInfo))
@@ -238,7 +351,10 @@ bool NotificationService::start(string& coreAddress,
 	// We have notitication instances loaded
 	// (1.1) Start the NotificationQueue
 	// (1.2) Start the DeliveryQueue
-	NotificationQueue queue(m_name);
+	NotificationQueue queue(m_name, m_queue_threads, m_evaluation_threads);
+	queue.setLimits(m_queue_max_readings, m_queue_max_bytes);
+	queue.setBufferBudget(m_buffers_max_bytes);
+	queue.setSpillDirectory(getSpillDirectory());
 	DeliveryQueue dQueue(m_name, m_delivery_threads);
 
 	// (2) Register notification interest, per assetName:
@@ -319,6 +435,35 @@ void NotificationService::cleanupResources()
 	m_managementApi->stop();
 }
 
+/**
+ * Set the notification queue high-water marks
+ * and the rule buffers budget
+ * from notification server category items
+ *
+ * @param    category	The notification server category
+ */
+void NotificationService::setQueueLimits(ConfigCategory& category)
+{
+	if (category.itemExists("queueMaxReadings"))
+	{
+		m_queue_max_readings = strtoul(category.getValue("queueMaxReadings").c_str(),
+					       NULL,
+					       10);
+	}
+	if (category.itemExists("queueMaxBytes"))
+	{
+		m_queue_max_bytes = strtoul(category.getValue("queueMaxBytes").c_str(),
+					    NULL,
+					    10);
+	}
+	if (category.itemExists("buffersMaxBytes"))
+	{
+		m_buffers_max_bytes = strtoul(category.getValue("buffersMaxBytes").c_str(),
+					      NULL,
+					      10);
+	}
+}
+
 /**
  * Configuration change notification
  *
@@ -339,6 +484,15 @@ void NotificationService::configChange(const string& categoryName,
 			m_logger->setMinLevel(config.getValue("logLevel"));
 			m_logger->warn("Set log level to %s", config.getValue("logLevel").c_str());
 		}
+
+		// Apply new notification queue high-water marks
+		this->setQueueLimits(config);
+		NotificationQueue* queue = NotificationQueue::getInstance();
+		if (queue)
+		{
+			queue->setLimits(m_queue_max_readings, m_queue_max_bytes);
+			queue->setBufferBudget(m_buffers_max_bytes);
+		}
 		return;
 	}
 
@@ -410,7 +564,7 @@ void NotificationService::configChange(const string& categoryName,
 					subscriptions->removeSubscription((*a).getAssetName(),
 									  ruleName);
 					// Remove asseet
-					a = allAssets.erase(a);
+					a = instance->getRule()->removeAsset(a);
 				}
 
 				// Create a new subscription by calling "plugin_triggers"
@@ -17,6 +17,7 @@
 #include <iostream>
 #include <string>
 #include <string_utils.h>
+#include <algorithm>
 #include <notification_subscription.h>
 #include <notification_api.h>
 #include <notification_queue.h>
@@ -54,13 +55,18 @@ SubscriptionElement::~SubscriptionElement()
 NotificationSubscription::NotificationSubscription(const string& notificationName,
 						   StorageClient& storageClient) :
 						   m_name(notificationName),
-						   m_storage(storageClient)
+						   m_storage(storageClient),
+						   m_routesVersion(0)
 {
 	// Set instance
 	m_instance = this;
 
 	// get logger
 	m_logger = Logger::getLogger();
+
+	// Publish an empty routing table
+	shared_ptr<const SubscriptionRoutes> routes(new SubscriptionRoutes());
+	atomic_store(&m_routes, routes);
 }
 
 /*
@@ -69,6 +75,7 @@ NotificationSubscription::NotificationSubscription(const string& notificationNam
 NotificationSubscription::~NotificationSubscription()
 {
 	this->getAllSubscriptions().clear();
+	m_instance = NULL;
 }
 
 /**
@@ -190,9 +197,218 @@ bool NotificationSubscription::addSubscription(const std::string& assetName,
 
 	m_logger->info("Subscription for asset '" + assetName + \
 		       "' has # " + to_string(m_subscriptions[assetName].size()) + " rules"); 
+
+	this->buildRoutes();
+
 	return true;
 }
 
+/**
+ * Rebuild and publish the subscriptions routing table
+ *
+ * Called when notification instances change.
+ */
+void NotificationSubscription::updateRoutes()
+{
+	lock_guard<mutex> guard(m_subscriptionMutex);
+	this->buildRoutes();
+}
+
+/**
+ * Build and publish a new routing table from current subscriptions
+ *
+ * Notification instances, rule data buffers and interned names
+ * are resolved here, so that queue workers need one lookup per asset only.
+ * Tables in use by readers are released when the last reader is done.
+ *
+ * The caller must hold the subscriptions lock.
+ */
+void NotificationSubscription::buildRoutes()
+{
+	NotificationManager* manager = NotificationManager::getInstance();
+	NotificationQueue* queue = NotificationQueue::getInstance();
+	SymbolTable* symbols = SymbolTable::getInstance();
+
+	SubscriptionRoutes* routes = new SubscriptionRoutes();
+	routes->version = ++m_routesVersion;
+	routes->assets.reserve(m_subscriptions.size());
+
+	for (auto it = m_subscriptions.begin();
+		  it != m_subscriptions.end();
+		  ++it)
+	{
+		vector<SubscriptionRoute>& assetRoutes = routes->assets[(*it).first];
+		assetRoutes.reserve((*it).second.size());
+		SYMBOL_ID assetId = symbols->intern((*it).first);
+		for (auto e = (*it).second.begin();
+			  e != (*it).second.end();
+			  ++e)
+		{
+			SubscriptionRoute route;
+			route.notificationName = (*e).getNotificationName();
+			route.instance = manager ?
+					 manager->getNotificationInstance(route.notificationName) :
+					 NULL;
+			route.assetId = assetId;
+			route.ruleId = 0;
+			route.buffer = NULL;
+			route.window = false;
+			if (route.instance && route.instance->getRule())
+			{
+				route.ruleName = route.instance->getRule()->getName();
+				route.ruleId = symbols->intern(route.ruleName);
+				if (queue)
+				{
+					route.buffer = queue->getRuleBuffer(route.ruleId);
+				}
+				vector<NotificationDetail> ruleAssets;
+				route.instance->getRule()->copyAssets(ruleAssets);
+				for (auto a = ruleAssets.begin(); a != ruleAssets.end(); ++a)
+				{
+					if ((*a).getAssetId() == assetId &&
+					    (*a).getType() != EvaluationType::SingleItem)
+					{
+						route.window = true;
+					}
+				}
+			}
+			route.datapoints = (*e).getDatapoints();
+			assetRoutes.push_back(route);
+		}
+	}
+
+	shared_ptr<const SubscriptionRoutes> table(routes);
+	atomic_store(&m_routes, table);
+
+	m_logger->debug("Published subscription routes version %lu for %lu assets",
+			table->version,
+			table->assets.size());
+}
+
+/**
+ * Check whether an asset has at least one enabled notification
+ *
+ * This is a cheap check, done before parsing readings data,
+ * in the published routing table without locks.
+ *
+ * @param    assetName		The asset name to check
+ * @return			True if an enabled notification
+ *				subscribes to assetName, false otherwise
+ */
+bool NotificationSubscription::hasActiveSubscription(const string& assetName)
+{
+	bool ret = false;
+
+	// Get NotificationManager instance
+	NotificationManager* manager = NotificationManager::getInstance();
+	if (!manager)
+	{
+		return false;
+	}
+
+	// Routed instances are not deleted meanwhile
+	unsigned long epoch = manager->addInstancesUser();
+	shared_ptr<const SubscriptionRoutes> routes = this->getRoutes();
+	auto it = routes->assets.find(assetName);
+	if (it == routes->assets.end())
+	{
+		manager->removeInstancesUser(epoch);
+		return false;
+	}
+
+	for (auto e = (*it).second.begin();
+		  e != (*it).second.end() && !ret;
+		  ++e)
+	{
+		NotificationInstance* instance = (*e).instance;
+		ret = instance &&
+		      instance->isEnabled() &&
+		      !instance->isZombie();
+	}
+	manager->removeInstancesUser(epoch);
+
+	return ret;
+}
+
+/**
+ * Get the datapoint names needed by the notifications of an asset
+ *
+ * Datapoints are set by the optional "datapoints" array
+ * of "plugin_triggers" items: a rule without it needs all datapoints.
+ * Disabled notifications are included: data received before
+ * a notification is enabled has the datapoints it needs.
+ *
+ * @param    assetName		The asset name
+ * @param    datapoints		Output datapoint names,
+ *				empty means all datapoints
+ */
+void NotificationSubscription::getDatapointsMask(const string& assetName,
+						 vector<string>& datapoints)
+{
+	datapoints.clear();
+
+	// Get NotificationManager instance
+	NotificationManager* manager = NotificationManager::getInstance();
+	if (!manager)
+	{
+		return;
+	}
+
+	// Routed instances are not deleted meanwhile
+	unsigned long epoch = manager->addInstancesUser();
+	shared_ptr<const SubscriptionRoutes> routes = this->getRoutes();
+	auto it = routes->assets.find(assetName);
+	if (it == routes->assets.end())
+	{
+		manager->removeInstancesUser(epoch);
+		return;
+	}
+
+	for (auto e = (*it).second.begin();
+		  e != (*it).second.end();
+		  ++e)
+	{
+		NotificationInstance* instance = (*e).instance;
+		if (!instance ||
+		    instance->isZombie())
+		{
+			continue;
+		}
+
+		const vector<string>& needed = (*e).datapoints;
+		if (needed.empty())
+		{
+			// All datapoints are needed
+			datapoints.clear();
+			break;
+		}
+		for (auto d = needed.begin(); d != needed.end(); ++d)
+		{
+			if (find(datapoints.begin(), datapoints.end(), *d) == datapoints.end())
+			{
+				datapoints.push_back(*d);
+			}
+		}
+	}
+	manager->removeInstancesUser(epoch);
+}
+
+/**
+ * Get the evaluation interval in seconds:
+ * fractional values set sub-second windows
+ *
+ * @param    value	The interval JSON value
+ * @return		The interval in seconds or 0 if not a positive number
+ */
+static double getInterval(const Value& value)
+{
+	if (!value.IsNumber() || value.GetDouble() < 0)
+	{
+		return 0;
+	}
+	return value.GetDouble();
+}
+
 /**
  * Check for notification evaluation type in the input JSON object
  *
@@ -202,27 +418,27 @@ bool NotificationSubscription::addSubscription(const std::string& assetName,
 EvaluationType NotificationSubscription::getEvalType(const Value& value)
 {
 	// Default is SingleItem, so set time = 0
-	time_t interval = 0;
+	double interval = 0;
 	EvaluationType::EVAL_TYPE evaluation = EvaluationType::SingleItem;
 
 	if (value.HasMember("All"))
 	{
-		interval = value["All"].GetUint();
+		interval = getInterval(value["All"]);
 		evaluation = EvaluationType::All;
 	}
 	else if (value.HasMember("Average"))
 	{
-		interval = value["Average"].GetUint();
+		interval = getInterval(value["Average"]);
 		evaluation = EvaluationType::Average;
 	}
 	else if (value.HasMember("Minimum"))
 	{
-		interval = value["Minimum"].GetUint();
+		interval = getInterval(value["Minimum"]);
 		evaluation = EvaluationType::Minimum;
 	}
 	else if (value.HasMember("Maximum"))
 	{
-		interval = value["Maximum"].GetUint();
+		interval = getInterval(value["Maximum"]);
 		evaluation = EvaluationType::Maximum;
 	}
 
@@ -263,6 +479,9 @@ void NotificationSubscription::unregisterSubscription(const string& assetName)
 /**
  * Create a SubscriptionElement object and register interest for asset names
  *
+ * Readings are passed to the rule with the datapoints in the optional
+ * "datapoints" array of the trigger only, all datapoints without it.
+ *
  * @param    instance		The notification instance
  *				with already set rule and delivery plugins
  * @return			True on success, false on errors
@@ -325,6 +544,24 @@ bool NotificationSubscription::createSubscription(NotificationInstance* instance
 							 instance->getName(),
 							 instance);
 
+			// Get optional datapoints needed by the rule
+			if ((*itr).HasMember("datapoints") &&
+			    (*itr)["datapoints"].IsArray())
+			{
+				vector<string> datapoints;
+				const Value& names = (*itr)["datapoints"];
+				for (Value::ConstValueIterator n = names.Begin();
+							       n != names.End();
+							       ++n)
+				{
+					if ((*n).IsString())
+					{
+						datapoints.push_back((*n).GetString());
+					}
+				}
+				subscription.setDatapoints(datapoints);
+			}
+
 			// Add subscription and register asset interest
 			lock_guard<mutex> guard(m_subscriptionMutex);
 			ret = this->addSubscription(asset, subscription);
@@ -420,6 +657,8 @@ void NotificationSubscription::removeSubscription(const string& assetName,
 		{
 			allSubscriptions.erase(it);
 		}
+
+		this->buildRoutes();
 	}
 	this->unlockSubscriptions();
 }
@@ -86,6 +86,15 @@ void RulePlugin::shutdown()
 /**
  * Call the loaded plugin "plugin_triggers" method
  *
+ * Each trigger has the "asset" name, the optional evaluation type
+ * with its interval in seconds and the optional "datapoints" array
+ * with the names of the datapoints the rule evaluates:
+ * without the array, or with an empty array, all datapoints are passed.
+ *
+ * { "triggers" : [ { "asset" : "sinusoid",
+ *		      "datapoints" : [ "sinusoid" ],
+ *		      "Average" : 10 } ] }
+ *
  * @return		The JSON document, as string
  *			that describes the rule triggers.
  */
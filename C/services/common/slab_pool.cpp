@@ -0,0 +1,125 @@
+/*
+ * FogLAMP notification buffered data pools.
+ *
+ * Copyright (c) 2020 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Massimiliano Pinto
+ */
+#include <slab_pool.h>
+
+using namespace std;
+
+/**
+ * SlabPool constructor
+ *
+ * @param    size	The item size in bytes
+ * @param    items	The number of items per slab
+ */
+SlabPool::SlabPool(size_t size, size_t items) :
+		   m_items(items ? items : 1),
+		   m_free(NULL),
+		   m_allocations(0),
+		   m_used(0)
+{
+	// Items hold a free list link and keep pointer alignment
+	size_t align = alignof(max_align_t);
+	m_size = size < sizeof(FreeItem) ? sizeof(FreeItem) : size;
+	m_size = (m_size + align - 1) / align * align;
+}
+
+/**
+ * SlabPool destructor
+ *
+ * All the items must have been released.
+ */
+SlabPool::~SlabPool()
+{
+	for (auto s = m_slabs.begin(); s != m_slabs.end(); ++s)
+	{
+		delete[] *s;
+	}
+}
+
+/**
+ * Allocate an item, a new slab is allocated
+ * when there are no free items
+ *
+ * @return	The item memory
+ * @throw	std::bad_alloc if a slab can not be allocated
+ */
+void* SlabPool::allocate()
+{
+	lock_guard<mutex> guard(m_mutex);
+	if (!m_free)
+	{
+		char* slab = new char[m_size * m_items];
+		m_slabs.push_back(slab);
+		for (size_t i = m_items; i > 0; i--)
+		{
+			FreeItem* item = reinterpret_cast<FreeItem *>(slab + (i - 1) * m_size);
+			item->m_next = m_free;
+			m_free = item;
+		}
+	}
+
+	FreeItem* item = m_free;
+	m_free = item->m_next;
+	m_allocations++;
+	m_used++;
+
+	return item;
+}
+
+/**
+ * Release an item for reuse
+ *
+ * @param    item	An item returned by allocate
+ */
+void SlabPool::release(void* item)
+{
+	if (!item)
+	{
+		return;
+	}
+
+	lock_guard<mutex> guard(m_mutex);
+	FreeItem* free = static_cast<FreeItem *>(item);
+	free->m_next = m_free;
+	m_free = free;
+	m_used--;
+}
+
+/**
+ * Get the number of items allocated from the pool
+ *
+ * @return	The number of allocations
+ */
+unsigned long SlabPool::getAllocations()
+{
+	lock_guard<mutex> guard(m_mutex);
+	return m_allocations;
+}
+
+/**
+ * Get the number of heap allocations done by the pool
+ *
+ * @return	The number of slabs
+ */
+unsigned long SlabPool::getSlabs()
+{
+	lock_guard<mutex> guard(m_mutex);
+	return m_slabs.size();
+}
+
+/**
+ * Get the number of items in use
+ *
+ * @return	The number of items not released
+ */
+unsigned long SlabPool::getUsed()
+{
+	lock_guard<mutex> guard(m_mutex);
+	return m_used;
+}
@@ -0,0 +1,121 @@
+/*
+ * FogLAMP notification asset and rule names table.
+ *
+ * Copyright (c) 2020 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Massimiliano Pinto
+ */
+#include <symbol_table.h>
+#include <logger.h>
+#include <stdexcept>
+
+using namespace std;
+
+/**
+ * Get the names table
+ *
+ * The table is not deleted: identifiers
+ * may be used until the service exits.
+ *
+ * @return	The names table
+ */
+SymbolTable* SymbolTable::getInstance()
+{
+	static SymbolTable* table = new SymbolTable();
+	return table;
+}
+
+/**
+ * SymbolTable constructor
+ */
+SymbolTable::SymbolTable() : m_size(0)
+{
+	for (int i = 0; i < SYMBOL_MAX_CHUNKS; i++)
+	{
+		m_chunks[i] = NULL;
+	}
+}
+
+/**
+ * SymbolTable destructor
+ */
+SymbolTable::~SymbolTable()
+{
+	for (int i = 0; i < SYMBOL_MAX_CHUNKS; i++)
+	{
+		delete[] m_chunks[i].load();
+	}
+}
+
+/**
+ * Get the identifier of a name, adding the name if not found
+ *
+ * @param    name	The asset or rule name
+ * @return		The name identifier
+ * @throw		std::length_error if the table is full
+ */
+SYMBOL_ID SymbolTable::intern(const string& name)
+{
+	lock_guard<mutex> guard(m_mutex);
+	auto it = m_ids.find(name);
+	if (it != m_ids.end())
+	{
+		return (*it).second;
+	}
+
+	unsigned long id = m_size;
+	unsigned long chunk = id / SYMBOL_CHUNK_SIZE;
+	if (chunk >= SYMBOL_MAX_CHUNKS)
+	{
+		Logger::getLogger()->fatal("Names table is full, can not add name '%s'",
+					   name.c_str());
+		throw length_error("Names table is full");
+	}
+
+	string* names = m_chunks[chunk].load(memory_order_relaxed);
+	if (!names)
+	{
+		names = new string[SYMBOL_CHUNK_SIZE];
+		m_chunks[chunk].store(names, memory_order_release);
+	}
+	names[id % SYMBOL_CHUNK_SIZE] = name;
+	m_ids[name] = id;
+
+	// The name is set before the identifier is published
+	m_size.store(id + 1, memory_order_release);
+
+	return id;
+}
+
+/**
+ * Get the identifier of a name
+ *
+ * @param    name	The asset or rule name
+ * @param    id		Output name identifier
+ * @return		True if found, false otherwise
+ */
+bool SymbolTable::find(const string& name, SYMBOL_ID& id)
+{
+	lock_guard<mutex> guard(m_mutex);
+	auto it = m_ids.find(name);
+	if (it == m_ids.end())
+	{
+		return false;
+	}
+	id = (*it).second;
+	return true;
+}
+
+/**
+ * Get the name of an identifier returned by intern
+ *
+ * @param    id		The name identifier
+ * @return		The name
+ */
+const string& SymbolTable::getName(SYMBOL_ID id) const
+{
+	string* names = m_chunks[id / SYMBOL_CHUNK_SIZE].load(memory_order_acquire);
+	return names[id % SYMBOL_CHUNK_SIZE];
+}
@@ -182,6 +182,24 @@ string ThresholdRule::triggers()
 		  ++it)
 	{
 		ret += "{ \"asset\"  : \"" + (*it).first + "\"";
+
+		// Add the datapoints needed by the rule:
+		// without them the rule gets all datapoints
+		vector<Datapoint *>& datapoints = (*it).second->getDatapoints();
+		if (!datapoints.empty())
+		{
+			ret += ", \"datapoints\" : [ ";
+			for (auto d = datapoints.begin(); d != datapoints.end(); ++d)
+			{
+				ret += "\"" + (*d)->getName() + "\"";
+				if (std::next(d, 1) != datapoints.end())
+				{
+					ret += ", ";
+				}
+			}
+			ret += " ]";
+		}
+
 		if (!(*it).second->getEvaluation().empty())
 		{
 			ret += ", \"" + (*it).second->getEvaluation() + "\" : " + \
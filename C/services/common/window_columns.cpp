@@ -0,0 +1,473 @@
+/*
+ * FogLAMP notification window columns.
+ *
+ * Copyright (c) 2020 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Massimiliano Pinto
+ */
+#include <window_columns.h>
+#include <datapoint.h>
+#include <sys/time.h>
+#include <algorithm>
+
+using namespace std;
+
+/**
+ * Get the user timestamp of a reading
+ *
+ * @param    reading	The reading
+ * @return		User timestamp in microseconds
+ */
+static inline uint64_t userTime(Reading* reading)
+{
+	struct timeval tv;
+	reading->getUserTimestamp(&tv);
+	return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/**
+ * Append an integer value
+ *
+ * @param    time	The reading user timestamp in microseconds
+ * @param    value	The datapoint value
+ * @param    window	True if the value is in the current window
+ */
+void WindowColumn::append(uint64_t time, long value, bool window)
+{
+	m_times.push_back(time);
+	m_ints.push_back(value);
+	if (window)
+	{
+		this->addWindow(value);
+	}
+}
+
+/**
+ * Append a floating point value
+ *
+ * @param    time	The reading user timestamp in microseconds
+ * @param    value	The datapoint value
+ * @param    window	True if the value is in the current window
+ */
+void WindowColumn::append(uint64_t time, double value, bool window)
+{
+	m_times.push_back(time);
+	m_doubles.push_back(value);
+	if (window)
+	{
+		this->addWindow(value);
+	}
+}
+
+/**
+ * Add an integer value to the current window aggregates
+ *
+ * @param    value	The datapoint value
+ */
+void WindowColumn::addWindow(long value)
+{
+	if (m_windowValues == 0)
+	{
+		m_intMin = m_intMax = m_intSum = value;
+	}
+	else
+	{
+		m_intMin = value < m_intMin ? value : m_intMin;
+		m_intMax = value > m_intMax ? value : m_intMax;
+		m_intSum += value;
+	}
+	m_windowValues++;
+}
+
+/**
+ * Add a floating point value to the current window aggregates
+ *
+ * @param    value	The datapoint value
+ */
+void WindowColumn::addWindow(double value)
+{
+	if (m_windowValues == 0)
+	{
+		m_doubleMin = m_doubleMax = m_doubleSum = value;
+	}
+	else
+	{
+		m_doubleMin = value < m_doubleMin ? value : m_doubleMin;
+		m_doubleMax = value > m_doubleMax ? value : m_doubleMax;
+		m_doubleSum += value;
+	}
+	m_windowValues++;
+}
+
+/**
+ * Remove the current window aggregates
+ */
+void WindowColumn::resetWindow()
+{
+	m_windowValues = 0;
+	m_intMin = m_intMax = m_intSum = 0;
+	m_doubleMin = m_doubleMax = m_doubleSum = 0;
+}
+
+/**
+ * Set the current window aggregates from the stored values
+ *
+ * @param    end	The window end time in microseconds
+ */
+void WindowColumn::openWindow(uint64_t end)
+{
+	this->resetWindow();
+	for (size_t i = m_head; i < m_times.size() && m_times[i] <= end; i++)
+	{
+		if (m_integer)
+		{
+			this->addWindow(m_ints[i]);
+		}
+		else
+		{
+			this->addWindow(m_doubles[i]);
+		}
+	}
+}
+
+/**
+ * Get the current window aggregates
+ *
+ * @param    type		Minimum, Maximum or Average evaluation
+ * @param    intValue		Output Min/Max or sum of integer values
+ * @param    doubleValue	Output Min/Max or sum of floating point values
+ * @return			False if there are no values in the window
+ */
+bool WindowColumn::getWindow(EvaluationType::EVAL_TYPE type,
+			     long& intValue,
+			     double& doubleValue) const
+{
+	if (m_windowValues == 0)
+	{
+		return false;
+	}
+
+	if (type == EvaluationType::Minimum)
+	{
+		intValue = m_intMin;
+		doubleValue = m_doubleMin;
+	}
+	else if (type == EvaluationType::Maximum)
+	{
+		intValue = m_intMax;
+		doubleValue = m_doubleMax;
+	}
+	else
+	{
+		intValue = m_intSum;
+		doubleValue = m_doubleSum;
+	}
+	return true;
+}
+
+/**
+ * Remove the values not newer than a given time
+ *
+ * @param    time	The time in microseconds
+ */
+void WindowColumn::trim(uint64_t time)
+{
+	m_head = upper_bound(m_times.begin() + m_head, m_times.end(), time) - m_times.begin();
+
+	if (m_head > m_times.size() / 2)
+	{
+		// Compact storage
+		m_times.erase(m_times.begin(), m_times.begin() + m_head);
+		if (m_integer)
+		{
+			m_ints.erase(m_ints.begin(), m_ints.begin() + m_head);
+		}
+		else
+		{
+			m_doubles.erase(m_doubles.begin(), m_doubles.begin() + m_head);
+		}
+		m_head = 0;
+	}
+}
+
+/**
+ * Aggregate the values not newer than a given time
+ *
+ * @param    time		The window end time in microseconds
+ * @param    type		Minimum, Maximum or Average evaluation
+ * @param    intValue		Output Min/Max or sum of integer values
+ * @param    doubleValue	Output Min/Max or sum of floating point values
+ * @return			False if there are no values in the window
+ */
+bool WindowColumn::aggregate(uint64_t time,
+			     EvaluationType::EVAL_TYPE type,
+			     long& intValue,
+			     double& doubleValue) const
+{
+	size_t end = upper_bound(m_times.begin() + m_head, m_times.end(), time) - m_times.begin();
+	if (end == m_head)
+	{
+		return false;
+	}
+
+	if (m_integer)
+	{
+		const long* values = m_ints.data();
+		long value = values[m_head];
+		for (size_t i = m_head + 1; i < end; i++)
+		{
+			if (type == EvaluationType::Minimum)
+			{
+				value = values[i] < value ? values[i] : value;
+			}
+			else if (type == EvaluationType::Maximum)
+			{
+				value = values[i] > value ? values[i] : value;
+			}
+			else
+			{
+				value += values[i];
+			}
+		}
+		intValue = value;
+	}
+	else
+	{
+		const double* values = m_doubles.data();
+		double value = values[m_head];
+		for (size_t i = m_head + 1; i < end; i++)
+		{
+			if (type == EvaluationType::Minimum)
+			{
+				value = values[i] < value ? values[i] : value;
+			}
+			else if (type == EvaluationType::Maximum)
+			{
+				value = values[i] > value ? values[i] : value;
+			}
+			else
+			{
+				value += values[i];
+			}
+		}
+		doubleValue = value;
+	}
+
+	return true;
+}
+
+/**
+ * Append the numeric datapoints of readings
+ *
+ * The store is not valid after out of order readings
+ * and not numeric or changing type datapoints.
+ *
+ * @param    readings	The readings to append
+ */
+void WindowColumns::append(const vector<Reading *>& readings)
+{
+	for (auto r = readings.begin();
+		  r != readings.end() && m_valid;
+		  ++r)
+	{
+		uint64_t time = userTime(*r);
+		if (!m_times.empty() && time < m_times.back())
+		{
+			this->invalidate();
+			return;
+		}
+		m_times.push_back(time);
+
+		// The first reading starts the current window
+		if (m_intervalUs && !m_windowOpen)
+		{
+			m_windowOpen = true;
+			m_windowEnd = time + m_intervalUs;
+			m_windowReadings = 0;
+		}
+		bool window = m_windowOpen && time <= m_windowEnd;
+		if (window)
+		{
+			m_windowReadings++;
+		}
+
+		vector<Datapoint *>& data = (*r)->getReadingData();
+		for (auto d = data.begin(); d != data.end(); ++d)
+		{
+			DatapointValue& value = (*d)->getData();
+			bool integer = value.getType() == DatapointValue::T_INTEGER;
+			if (!integer &&
+			    value.getType() != DatapointValue::T_FLOAT)
+			{
+				this->invalidate();
+				return;
+			}
+
+			auto c = m_columns.find((*d)->getName());
+			if (c == m_columns.end())
+			{
+				c = m_columns.insert(make_pair((*d)->getName(),
+							       WindowColumn(integer))).first;
+			}
+			else if ((*c).second.isInteger() != integer)
+			{
+				this->invalidate();
+				return;
+			}
+
+			if (integer)
+			{
+				(*c).second.append(time, (long)value.toInt(), window);
+			}
+			else
+			{
+				(*c).second.append(time, value.toDouble(), window);
+			}
+		}
+	}
+}
+
+/**
+ * Remove the readings not newer than a given time
+ *
+ * The next window starts at the oldest remaining reading.
+ *
+ * @param    time	The time in microseconds
+ */
+void WindowColumns::trim(uint64_t time)
+{
+	m_head = upper_bound(m_times.begin() + m_head, m_times.end(), time) - m_times.begin();
+	if (m_head > m_times.size() / 2)
+	{
+		// Compact storage
+		m_times.erase(m_times.begin(), m_times.begin() + m_head);
+		m_head = 0;
+	}
+
+	for (auto c = m_columns.begin(); c != m_columns.end(); ++c)
+	{
+		(*c).second.trim(time);
+	}
+
+	this->openWindow();
+}
+
+/**
+ * Set the window interval and the current window aggregates
+ *
+ * @param    intervalUs	The window interval in microseconds,
+ *			0 for no running aggregates
+ */
+void WindowColumns::setInterval(uint64_t intervalUs)
+{
+	m_intervalUs = intervalUs;
+	this->openWindow();
+}
+
+/**
+ * Start the current window at the oldest reading
+ * and set its aggregates from the stored values
+ */
+void WindowColumns::openWindow()
+{
+	m_windowOpen = m_intervalUs && m_head < m_times.size();
+	m_windowEnd = m_windowOpen ? m_times[m_head] + m_intervalUs : 0;
+	m_windowReadings = 0;
+	if (m_windowOpen)
+	{
+		m_windowReadings = upper_bound(m_times.begin() + m_head,
+					       m_times.end(),
+					       m_windowEnd) - (m_times.begin() + m_head);
+	}
+
+	for (auto c = m_columns.begin(); c != m_columns.end(); ++c)
+	{
+		if (m_windowOpen)
+		{
+			(*c).second.openWindow(m_windowEnd);
+		}
+		else
+		{
+			(*c).second.resetWindow();
+		}
+	}
+}
+
+/**
+ * Remove all data, the store is valid again.
+ * The window interval is kept.
+ */
+void WindowColumns::clear()
+{
+	m_times.clear();
+	m_head = 0;
+	m_columns.clear();
+	m_valid = true;
+	m_windowOpen = false;
+	m_windowEnd = 0;
+	m_windowReadings = 0;
+}
+
+/**
+ * Remove all data, the store is not valid until cleared
+ */
+void WindowColumns::invalidate()
+{
+	this->clear();
+	m_valid = false;
+}
+
+/**
+ * Aggregate the readings not newer than a given time
+ *
+ * Output values are those of the aggregation of Reading objects:
+ * Min/Max values in the datapoint type and averages of
+ * the datapoint values over the number of readings.
+ * The current window aggregates are used when the time is its end,
+ * values are scanned otherwise.
+ *
+ * @param    time	The window end time in microseconds
+ * @param    type	Minimum, Maximum or Average evaluation
+ * @param    result	Output map with data
+ *			map[dataPointName] = value
+ */
+void WindowColumns::aggregate(uint64_t time,
+			      EvaluationType::EVAL_TYPE type,
+			      map<string, string>& result) const
+{
+	bool running = m_windowOpen && time == m_windowEnd;
+	size_t readings = running ? m_windowReadings :
+			  upper_bound(m_times.begin() + m_head, m_times.end(), time) -
+			  (m_times.begin() + m_head);
+
+	for (auto c = m_columns.begin(); c != m_columns.end(); ++c)
+	{
+		long intValue = 0;
+		double doubleValue = 0;
+		if (running ?
+		    !(*c).second.getWindow(type, intValue, doubleValue) :
+		    !(*c).second.aggregate(time, type, intValue, doubleValue))
+		{
+			continue;
+		}
+
+		bool integer = (*c).second.isInteger();
+		if (type == EvaluationType::Average)
+		{
+			result[(*c).first] = to_string((integer ? intValue : doubleValue) /
+						       (double)readings);
+		}
+		else if (integer)
+		{
+			DatapointValue value(intValue);
+			result[(*c).first] = value.toString();
+		}
+		else
+		{
+			DatapointValue value(doubleValue);
+			result[(*c).first] = value.toString();
+		}
+	}
+}
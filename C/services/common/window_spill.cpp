@@ -0,0 +1,562 @@
+/*
+ * FogLAMP notification window spill files.
+ *
+ * Copyright (c) 2020 Dianomic Systems
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Massimiliano Pinto
+ */
+#include <window_spill.h>
+#include <logger.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <algorithm>
+
+using namespace std;
+
+string WindowSpill::m_directory = "/tmp";
+mutex WindowSpill::m_directoryMutex;
+atomic<unsigned long> WindowSpill::m_totalBytes(0);
+
+/**
+ * Get the user timestamp of a reading
+ *
+ * @param    reading	The reading
+ * @return		User timestamp in microseconds
+ */
+static inline uint64_t userTime(Reading* reading)
+{
+	struct timeval tv;
+	reading->getUserTimestamp(&tv);
+	return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/**
+ * Check whether a datapoint value can be stored in a spill file
+ *
+ * @param    value	The datapoint value
+ * @return		True for integer and float values
+ */
+static inline bool isNumeric(DatapointValue& value)
+{
+	return value.getType() == DatapointValue::T_INTEGER ||
+	       value.getType() == DatapointValue::T_FLOAT;
+}
+
+/**
+ * WindowSpillSegment constructor
+ */
+WindowSpillSegment::WindowSpillSegment() : m_base(NULL),
+					   m_mappedBytes(0),
+					   m_recordSize(0),
+					   m_capacity(0),
+					   m_records(0),
+					   m_head(0)
+{
+}
+
+/**
+ * WindowSpillSegment destructor
+ *
+ * Unmap the file, its storage is released
+ */
+WindowSpillSegment::~WindowSpillSegment()
+{
+	if (m_base)
+	{
+		munmap(m_base, m_mappedBytes);
+	}
+	for (auto d = m_datapoints.begin(); d != m_datapoints.end(); ++d)
+	{
+		delete *d;
+	}
+}
+
+/**
+ * Create and map a spill file for the datapoints of a reading
+ *
+ * @param    directory	The directory of the spill file
+ * @param    reading	The reading with the segment datapoints
+ * @return		True on success, false otherwise
+ */
+bool WindowSpillSegment::create(const string& directory,
+				Reading* reading)
+{
+	// Datapoint names and types
+	size_t namesSize = 0;
+	vector<Datapoint *>& data = reading->getReadingData();
+	for (auto d = data.begin(); d != data.end(); ++d)
+	{
+		DatapointValue& value = (*d)->getData();
+		bool integer = value.getType() == DatapointValue::T_INTEGER;
+		m_names.push_back((*d)->getName());
+		m_integer.push_back(integer);
+		namesSize += m_names.back().size() + 2;
+
+		DatapointValue initial = integer ? DatapointValue(0L) : DatapointValue(0.0);
+		m_datapoints.push_back(new Datapoint(m_names.back(), initial));
+	}
+	if (sizeof(SpillHeader) + namesSize > SPILL_HEADER_BYTES)
+	{
+		Logger::getLogger()->error("Datapoint names of asset %s do not fit "
+					   "in a spill file header",
+					   reading->getAssetName().c_str());
+		return false;
+	}
+
+	m_recordSize = (1 + m_names.size()) * sizeof(uint64_t);
+	m_capacity = (SPILL_SEGMENT_BYTES - SPILL_HEADER_BYTES) / m_recordSize;
+	m_mappedBytes = SPILL_HEADER_BYTES + m_capacity * m_recordSize;
+
+	string path = directory + "/notification_spill_XXXXXX";
+	vector<char> name(path.begin(), path.end());
+	name.push_back('\0');
+	int fd = mkstemp(name.data());
+	if (fd < 0)
+	{
+		Logger::getLogger()->error("Cannot create spill file %s: %s",
+					   path.c_str(),
+					   strerror(errno));
+		return false;
+	}
+	// The file is removed when unmapped
+	unlink(name.data());
+
+	if (ftruncate(fd, m_mappedBytes) != 0)
+	{
+		Logger::getLogger()->error("Cannot allocate spill file %s: %s",
+					   name.data(),
+					   strerror(errno));
+		close(fd);
+		return false;
+	}
+
+	void* base = mmap(NULL,
+			  m_mappedBytes,
+			  PROT_READ | PROT_WRITE,
+			  MAP_SHARED,
+			  fd,
+			  0);
+	close(fd);
+	if (base == MAP_FAILED)
+	{
+		Logger::getLogger()->error("Cannot map spill file %s: %s",
+					   name.data(),
+					   strerror(errno));
+		return false;
+	}
+	m_base = (char *)base;
+	// Records are written and read sequentially
+	madvise(m_base, m_mappedBytes, MADV_SEQUENTIAL);
+
+	SpillHeader* header = (SpillHeader *)m_base;
+	header->magic = SPILL_MAGIC;
+	header->version = SPILL_VERSION;
+	header->datapoints = m_names.size();
+	header->recordSize = m_recordSize;
+	header->records = 0;
+	char* names = m_base + sizeof(SpillHeader);
+	for (size_t i = 0; i < m_names.size(); i++)
+	{
+		*names++ = m_integer[i] ? 'i' : 'd';
+		memcpy(names, m_names[i].c_str(), m_names[i].size() + 1);
+		names += m_names[i].size() + 1;
+	}
+
+	return true;
+}
+
+/**
+ * Check whether a reading has the datapoints of the segment
+ *
+ * Datapoints may be in a different order:
+ * the segment column of each datapoint is returned.
+ *
+ * @param    reading	The reading
+ * @param    columns	Output segment column of each reading datapoint
+ * @return		True if names and types match
+ */
+bool WindowSpillSegment::matches(Reading* reading,
+				 vector<size_t>& columns) const
+{
+	vector<Datapoint *>& data = reading->getReadingData();
+	if (data.size() != m_names.size())
+	{
+		return false;
+	}
+	columns.resize(data.size());
+	for (size_t i = 0; i < data.size(); i++)
+	{
+		// Same order is the common case
+		size_t column = i;
+		if (data[i]->getName().compare(m_names[column]) != 0)
+		{
+			column = find(m_names.begin(), m_names.end(), data[i]->getName()) - m_names.begin();
+			if (column == m_names.size())
+			{
+				return false;
+			}
+		}
+
+		DatapointValue& value = data[i]->getData();
+		if ((value.getType() == DatapointValue::T_INTEGER) != m_integer[column])
+		{
+			return false;
+		}
+		columns[i] = column;
+	}
+	return true;
+}
+
+/**
+ * Append a reading record
+ *
+ * The caller checks the segment is not full
+ * and the reading matches its datapoints.
+ *
+ * @param    reading	The reading
+ * @param    time	The reading user timestamp in microseconds
+ * @param    columns	The segment column of each reading datapoint
+ */
+void WindowSpillSegment::append(Reading* reading,
+				uint64_t time,
+				const vector<size_t>& columns)
+{
+	uint64_t* record = getRecord(m_records);
+	record[0] = time;
+
+	vector<Datapoint *>& data = reading->getReadingData();
+	for (size_t i = 0; i < data.size(); i++)
+	{
+		DatapointValue& value = data[i]->getData();
+		size_t column = columns[i];
+		if (m_integer[column])
+		{
+			int64_t v = value.toInt();
+			memcpy(&record[column + 1], &v, sizeof(v));
+		}
+		else
+		{
+			double v = value.toDouble();
+			memcpy(&record[column + 1], &v, sizeof(v));
+		}
+	}
+
+	m_records++;
+	((SpillHeader *)m_base)->records = m_records;
+}
+
+/**
+ * Remove the newest records
+ *
+ * @param    records	The number of records to keep
+ */
+void WindowSpillSegment::truncate(size_t records)
+{
+	m_records = records;
+	((SpillHeader *)m_base)->records = m_records;
+}
+
+/**
+ * Pass the datapoints of the records not newer than
+ * a given time to a callback, oldest first
+ *
+ * @param    time	The time in microseconds
+ * @param    callback	Function called with the datapoints of each record
+ * @return		True if a newer record has been found
+ */
+bool WindowSpillSegment::read(uint64_t time,
+			      const function<void(const vector<Datapoint *>&)>& callback)
+{
+	for (size_t r = m_head; r < m_records; r++)
+	{
+		uint64_t* record = getRecord(r);
+		if (record[0] > time)
+		{
+			return true;
+		}
+
+		for (size_t i = 0; i < m_datapoints.size(); i++)
+		{
+			if (m_integer[i])
+			{
+				int64_t v;
+				memcpy(&v, &record[i + 1], sizeof(v));
+				m_datapoints[i]->getData().setValue((long)v);
+			}
+			else
+			{
+				double v;
+				memcpy(&v, &record[i + 1], sizeof(v));
+				m_datapoints[i]->getData().setValue(v);
+			}
+		}
+		callback(m_datapoints);
+	}
+	return false;
+}
+
+/**
+ * Remove the records not newer than a given time
+ *
+ * @param    time	The time in microseconds
+ */
+void WindowSpillSegment::trim(uint64_t time)
+{
+	while (m_head < m_records && getTime(m_head) <= time)
+	{
+		m_head++;
+	}
+}
+
+/**
+ * WindowSpill destructor
+ */
+WindowSpill::~WindowSpill()
+{
+	this->clear();
+}
+
+/**
+ * Set the directory of the spill files
+ *
+ * @param    directory	The directory
+ */
+void WindowSpill::setDirectory(const string& directory)
+{
+	lock_guard<mutex> guard(m_directoryMutex);
+	m_directory = directory;
+}
+
+/**
+ * Check whether readings can be appended:
+ * numeric datapoints only, in user timestamp order
+ * and not older than the spilled readings
+ *
+ * @param    readings	The readings
+ * @return		True if the readings can be appended
+ */
+bool WindowSpill::spillable(const vector<Reading *>& readings) const
+{
+	uint64_t last = this->empty() ? 0 : this->getLastTime();
+	for (auto r = readings.begin(); r != readings.end(); ++r)
+	{
+		uint64_t time = userTime(*r);
+		if (time < last)
+		{
+			return false;
+		}
+		last = time;
+
+		vector<Datapoint *>& data = (*r)->getReadingData();
+		for (auto d = data.begin(); d != data.end(); ++d)
+		{
+			if (!isNumeric((*d)->getData()))
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/**
+ * Append readings to the spill files
+ *
+ * A spill file is created when there is none or the newest is full.
+ * Nothing is appended if any of the readings cannot be spilled,
+ * has other datapoints than the newest spill file
+ * or a spill file cannot be created.
+ *
+ * @param    readings	The readings, oldest first
+ * @return		True if all the readings have been appended
+ */
+bool WindowSpill::append(const vector<Reading *>& readings)
+{
+	if (!this->spillable(readings))
+	{
+		return false;
+	}
+
+	// Current state, restored on failure
+	size_t segments = m_segments.size();
+	size_t records = segments ? m_segments.back()->getRecords() : 0;
+
+	string directory;
+	{
+		lock_guard<mutex> guard(m_directoryMutex);
+		directory = m_directory;
+	}
+
+	vector<size_t> columns;
+	for (auto r = readings.begin(); r != readings.end(); ++r)
+	{
+		if (m_segments.empty() ||
+		    m_segments.back()->isFull())
+		{
+			WindowSpillSegment* segment = new WindowSpillSegment();
+			if (!segment->create(directory, *r))
+			{
+				delete segment;
+				this->restore(segments, records);
+				return false;
+			}
+			m_segments.push_back(segment);
+			m_totalBytes += segment->getMappedBytes();
+		}
+		if (!m_segments.back()->matches(*r, columns))
+		{
+			// Datapoints changed: readings are kept in memory
+			// until the spilled readings are trimmed
+			Logger::getLogger()->debug("Readings of asset %s with other datapoints "
+						   "than the spilled readings are not spilled",
+						   (*r)->getAssetName().c_str());
+			this->restore(segments, records);
+			return false;
+		}
+		m_segments.back()->append(*r, userTime(*r), columns);
+	}
+	return true;
+}
+
+/**
+ * Remove the records appended after a given state of the spill files
+ *
+ * @param    segments	The number of spill files to keep
+ * @param    records	The number of records of the newest spill file to keep
+ */
+void WindowSpill::restore(size_t segments, size_t records)
+{
+	while (m_segments.size() > segments)
+	{
+		this->removeSegment(false);
+	}
+	if (segments)
+	{
+		m_segments.back()->truncate(records);
+	}
+}
+
+/**
+ * Pass the datapoints of the spilled readings not newer than
+ * a given time to a callback, oldest first
+ *
+ * @param    time	The time in microseconds
+ * @param    callback	Function called with the datapoints of each reading
+ */
+void WindowSpill::read(uint64_t time,
+		       const function<void(const vector<Datapoint *>&)>& callback) const
+{
+	for (auto s = m_segments.begin(); s != m_segments.end(); ++s)
+	{
+		if ((*s)->read(time, callback))
+		{
+			break;
+		}
+	}
+}
+
+/**
+ * Remove the spilled readings not newer than a given time
+ *
+ * @param    time	The time in microseconds
+ */
+void WindowSpill::trim(uint64_t time)
+{
+	while (!m_segments.empty())
+	{
+		WindowSpillSegment* segment = m_segments.front();
+		segment->trim(time);
+		if (!segment->empty())
+		{
+			break;
+		}
+		this->removeSegment(true);
+	}
+}
+
+/**
+ * Remove all the spilled readings
+ */
+void WindowSpill::clear()
+{
+	while (!m_segments.empty())
+	{
+		this->removeSegment(true);
+	}
+}
+
+/**
+ * Remove the oldest or the newest spill file
+ *
+ * @param    oldest	True for the oldest file
+ */
+void WindowSpill::removeSegment(bool oldest)
+{
+	WindowSpillSegment* segment = oldest ? m_segments.front() : m_segments.back();
+	if (oldest)
+	{
+		m_segments.pop_front();
+	}
+	else
+	{
+		m_segments.pop_back();
+	}
+	m_totalBytes -= segment->getMappedBytes();
+	delete segment;
+}
+
+/**
+ * Get the user timestamp of the oldest spilled reading
+ *
+ * @return	Time in microseconds
+ */
+uint64_t WindowSpill::getFirstTime() const
+{
+	return m_segments.front()->getFirstTime();
+}
+
+/**
+ * Get the user timestamp of the newest spilled reading
+ *
+ * @return	Time in microseconds
+ */
+uint64_t WindowSpill::getLastTime() const
+{
+	return m_segments.back()->getLastTime();
+}
+
+/**
+ * Get the number of spilled readings
+ *
+ * @return	The number of readings
+ */
+unsigned long WindowSpill::getReadings() const
+{
+	unsigned long readings = 0;
+	for (auto s = m_segments.begin(); s != m_segments.end(); ++s)
+	{
+		readings += (*s)->getReadings();
+	}
+	return readings;
+}
+
+/**
+ * Get the size of the spilled records
+ *
+ * @return	The size in bytes
+ */
+unsigned long WindowSpill::getBytes() const
+{
+	unsigned long bytes = 0;
+	for (auto s = m_segments.begin(); s != m_segments.end(); ++s)
+	{
+		bytes += (*s)->getBytes();
+	}
+	return bytes;
+}
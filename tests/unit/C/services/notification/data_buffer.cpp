@@ -0,0 +1,465 @@
+#include <gtest/gtest.h>
+#include "notification_queue.h"
+#include <vector>
+#include <map>
+#include <deque>
+#include <chrono>
+
+using namespace std;
+
+/**
+ * Sliding windows of buffered data: append one element
+ * and trim the oldest one, for window sizes of 10k and 100k elements.
+ *
+ * Trimming the front of the window is constant time,
+ * this would take minutes with vector erase: the time of
+ * one slide doesn't grow with the window size.
+ */
+TEST(NotificationService, DataBufferWindow)
+{
+	SYMBOL_ID rule = SymbolTable::getInstance()->intern("rule");
+	SYMBOL_ID asset = SymbolTable::getInstance()->intern("asset");
+	vector<unsigned long> windows = { 10000, 100000 };
+	vector<Reading *> none;
+	shared_ptr<const SharedReadings> readings(new SharedReadings(none));
+	vector<double> slideNs;
+
+	for (auto w = windows.begin(); w != windows.end(); ++w)
+	{
+		NotificationDataBuffer buffer;
+
+		for (unsigned long i = 0; i < *w; i++)
+		{
+			buffer.append(asset, new NotificationDataElement(rule, asset, readings));
+		}
+		NotificationDataElement* newest = buffer.getData(asset).back();
+
+		// Slide until the newest element is the oldest one
+		auto start = chrono::steady_clock::now();
+		for (unsigned long i = 0; i < *w - 1; i++)
+		{
+			buffer.append(asset, new NotificationDataElement(rule, asset, readings));
+			ASSERT_EQ(buffer.keep(asset, *w), 1UL);
+		}
+		auto ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+		slideNs.push_back((double)ns / (*w - 1));
+		RecordProperty("slideNs_" + to_string(*w), (int)slideNs.back());
+
+		ASSERT_EQ(buffer.getData(asset).size(), *w);
+		ASSERT_EQ(buffer.getData(asset).front(), newest);
+		ASSERT_EQ(buffer.keep(asset, 0), *w);
+		ASSERT_TRUE(buffer.getData(asset).empty());
+	}
+
+	// Ten times the window size, less than four times the slide time
+	ASSERT_LT(slideNs[1], slideNs[0] * 4);
+}
+
+/**
+ * Late data is buffered in first reading time order
+ */
+TEST(NotificationService, DataBufferOrder)
+{
+	SYMBOL_ID rule = SymbolTable::getInstance()->intern("rule");
+	SYMBOL_ID asset = SymbolTable::getInstance()->intern("asset");
+	NotificationDataBuffer buffer;
+	vector<long> seconds = { 1000, 1002, 1001, 1003, 999 };
+
+	for (auto s = seconds.begin(); s != seconds.end(); ++s)
+	{
+		DatapointValue value(*s);
+		Reading* reading = new Reading("asset", new Datapoint("value", value));
+		struct timeval tv = { *s, 0 };
+		reading->setUserTimestamp(tv);
+		vector<Reading *> values = { reading };
+		shared_ptr<const SharedReadings> readings(new SharedReadings(values));
+		buffer.append(asset, new NotificationDataElement(rule, asset, readings));
+	}
+
+	RULE_BUFFER_DATA& data = buffer.getData(asset);
+	ASSERT_EQ(data.size(), seconds.size());
+	for (unsigned long i = 0; i < data.size(); i++)
+	{
+		ASSERT_EQ(data[i]->getFirstTime(), (999 + i) * 1000000ULL);
+	}
+	ASSERT_EQ(buffer.getLastTime(asset), 1003 * 1000000ULL);
+
+	buffer.keep(asset, 0);
+	ASSERT_EQ(buffer.getLastTime(asset), 0ULL);
+}
+
+/**
+ * Sliding a window of buffered data reuses the pooled elements:
+ * after the window is filled there are no more heap allocations.
+ * The slide time is recorded with the time of heap allocations
+ * of the same size.
+ */
+TEST(NotificationService, DataBufferPool)
+{
+	SYMBOL_ID rule = SymbolTable::getInstance()->intern("rule");
+	SYMBOL_ID asset = SymbolTable::getInstance()->intern("asset");
+	SlabPool& pool = NotificationDataElement::getPool();
+	unsigned long window = 10000;
+	vector<Reading *> none;
+	shared_ptr<const SharedReadings> readings(new SharedReadings(none));
+	NotificationDataBuffer buffer;
+	unsigned long used = pool.getUsed();
+
+	for (unsigned long i = 0; i < window; i++)
+	{
+		buffer.append(asset, new NotificationDataElement(rule, asset, readings));
+	}
+	unsigned long slabs = pool.getSlabs();
+	unsigned long allocations = pool.getAllocations();
+
+	auto start = chrono::steady_clock::now();
+	for (unsigned long i = 0; i < 10 * window; i++)
+	{
+		buffer.append(asset, new NotificationDataElement(rule, asset, readings));
+		buffer.keep(asset, window);
+	}
+	auto pooledUs = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+
+	ASSERT_EQ(pool.getAllocations() - allocations, 10 * window);
+	ASSERT_EQ(pool.getSlabs(), slabs);
+	ASSERT_EQ(pool.getUsed() - used, window);
+
+	// The same slide with one heap allocation per element
+	deque<void *> heap;
+	for (unsigned long i = 0; i < window; i++)
+	{
+		heap.push_back(::operator new(sizeof(NotificationDataElement)));
+	}
+	start = chrono::steady_clock::now();
+	for (unsigned long i = 0; i < 10 * window; i++)
+	{
+		heap.push_back(::operator new(sizeof(NotificationDataElement)));
+		::operator delete(heap.front());
+		heap.pop_front();
+	}
+	auto heapUs = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+	for (auto h = heap.begin(); h != heap.end(); ++h)
+	{
+		::operator delete(*h);
+	}
+
+	RecordProperty("pooledHeapAllocations", (int)(pool.getSlabs() - slabs));
+	RecordProperty("heapAllocations", (int)(10 * window));
+	RecordProperty("pooledSlideUs", (int)pooledUs);
+	RecordProperty("heapSlideUs", (int)heapUs);
+
+	buffer.keep(asset, 0);
+	ASSERT_EQ(pool.getUsed(), used);
+}
+
+/**
+ * Reading counting its deletions
+ */
+class CountedReading : public Reading
+{
+	public:
+		CountedReading(const string& asset, Datapoint* value) :
+			Reading(asset, value) {};
+		~CountedReading() { m_deleted++; };
+		static unsigned long	m_deleted;
+};
+
+unsigned long CountedReading::m_deleted = 0;
+
+/**
+ * Buffered data above the memory budget is evicted:
+ * the oldest data is dropped or the older data is downsampled.
+ */
+TEST(NotificationService, DataBufferBudget)
+{
+	SYMBOL_ID rule = SymbolTable::getInstance()->intern("rule");
+	SYMBOL_ID asset = SymbolTable::getInstance()->intern("asset");
+	NotificationDataBuffer dropOldest;
+	NotificationDataBuffer downsample;
+	NotificationDataElement* oldest = NULL;
+	NotificationDataElement* newest = NULL;
+	unsigned long size = 0;
+	CountedReading::m_deleted = 0;
+
+	for (long i = 0; i < 100; i++)
+	{
+		DatapointValue value(i);
+		vector<Reading *> values = { new CountedReading("asset", new Datapoint("value", value)) };
+		shared_ptr<const SharedReadings> readings(new SharedReadings(values));
+
+		NotificationDataElement* data = new NotificationDataElement(rule, asset, readings);
+		size = data->getSize();
+		dropOldest.append(asset, data);
+		data = new NotificationDataElement(rule, asset, readings);
+		downsample.append(asset, data);
+		if (!oldest)
+		{
+			oldest = data;
+		}
+		newest = data;
+
+		unsigned long evictedReadings;
+		unsigned long evictedBytes;
+		ASSERT_TRUE(dropOldest.evict(10 * size,
+					     0,
+					     size,
+					     E_BUFFER_EVICTION::EvictDropOldest,
+					     evictedReadings,
+					     evictedBytes));
+		ASSERT_TRUE(downsample.evict(10 * size,
+					     0,
+					     size,
+					     E_BUFFER_EVICTION::EvictDownsample,
+					     evictedReadings,
+					     evictedBytes));
+		ASSERT_EQ(evictedBytes, evictedReadings * size);
+	}
+
+	// The newest data is kept
+	ASSERT_EQ(dropOldest.getData(asset).size(), 10UL);
+	ASSERT_EQ(dropOldest.getAssetBytes(asset), 10 * size);
+
+	// The oldest and the newest data are kept
+	ASSERT_LE(downsample.getBytes(), 10 * size);
+	ASSERT_EQ(downsample.getData(asset).front(), oldest);
+	ASSERT_EQ(downsample.getData(asset).back(), newest);
+
+	dropOldest.keep(asset, 0);
+	downsample.keep(asset, 0);
+	ASSERT_EQ(dropOldest.getBytes(), 0UL);
+	ASSERT_EQ(downsample.getBytes(), 0UL);
+
+	// Readings shared by both buffers are deleted once
+	ASSERT_EQ(CountedReading::m_deleted, 100UL);
+}
+
+/**
+ * Window aggregates of numeric datapoints from the columns:
+ * only the readings not newer than the window end are aggregated.
+ */
+TEST(NotificationService, WindowColumns)
+{
+	WindowColumns columns;
+	vector<Reading *> readings;
+
+	for (long i = 0; i < 10; i++)
+	{
+		DatapointValue value(i);
+		Reading* reading = new Reading("asset", new Datapoint("value", value));
+		struct timeval tv = { 1000 + i, 0 };
+		reading->setUserTimestamp(tv);
+		readings.push_back(reading);
+	}
+	columns.append(readings);
+	ASSERT_TRUE(columns.isValid());
+
+	map<string, string> minimum;
+	map<string, string> maximum;
+	map<string, string> average;
+	columns.aggregate(1004000000, EvaluationType::Minimum, minimum);
+	columns.aggregate(1004000000, EvaluationType::Maximum, maximum);
+	columns.aggregate(1004000000, EvaluationType::Average, average);
+	ASSERT_EQ(minimum["value"], "0");
+	ASSERT_EQ(maximum["value"], "4");
+	ASSERT_EQ(average["value"], to_string(2.0));
+
+	// Next window
+	columns.trim(1004000000);
+	columns.aggregate(1009000000, EvaluationType::Minimum, minimum);
+	ASSERT_EQ(minimum["value"], "5");
+
+	// Running aggregates of 4 seconds windows give the same values
+	WindowColumns running;
+	running.setInterval(4000000);
+	running.append(readings);
+	map<string, string> runningAverage;
+	running.aggregate(1004000000, EvaluationType::Average, runningAverage);
+	ASSERT_EQ(runningAverage["value"], average["value"]);
+	running.trim(1004000000);
+	running.aggregate(1009000000, EvaluationType::Maximum, maximum);
+	ASSERT_EQ(maximum["value"], "9");
+
+	// Out of order readings are not stored
+	columns.append(readings);
+	ASSERT_FALSE(columns.isValid());
+
+	for (auto r = readings.begin(); r != readings.end(); ++r)
+	{
+		delete *r;
+	}
+}
+
+/**
+ * Buffered data above the spill size is moved into spill files:
+ * spilled readings give the same aggregates with less memory.
+ * Memory use and aggregation time of both cases are recorded.
+ */
+TEST(NotificationService, DataBufferSpill)
+{
+	SYMBOL_ID rule = SymbolTable::getInstance()->intern("rule");
+	SYMBOL_ID asset = SymbolTable::getInstance()->intern("asset");
+	NotificationDataBuffer buffer;
+	unsigned long elements = 1000;
+	unsigned long perElement = 100;
+
+	for (unsigned long i = 0; i < elements; i++)
+	{
+		vector<Reading *> values;
+		for (unsigned long j = 0; j < perElement; j++)
+		{
+			DatapointValue value((double)(i * perElement + j));
+			Reading* reading = new Reading("asset", new Datapoint("value", value));
+			struct timeval tv = { (time_t)(1000 + i), (suseconds_t)(j * 1000) };
+			reading->setUserTimestamp(tv);
+			values.push_back(reading);
+		}
+		shared_ptr<const SharedReadings> readings(new SharedReadings(values));
+		buffer.append(asset, new NotificationDataElement(rule, asset, readings));
+	}
+
+	// In memory aggregation
+	unsigned long inMemoryBytes = buffer.getAssetBytes(asset);
+	auto start = chrono::steady_clock::now();
+	double inMemorySum = 0;
+	RULE_BUFFER_DATA& data = buffer.getData(asset);
+	for (auto e = data.begin(); e != data.end(); ++e)
+	{
+		const vector<Reading *>& readings = (*e)->getData()->getAllReadings();
+		for (auto r = readings.begin(); r != readings.end(); ++r)
+		{
+			inMemorySum += (*r)->getReadingData()[0]->getData().toDouble();
+		}
+	}
+	auto inMemoryUs = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+
+	// All but the newest element are spilled
+	ASSERT_EQ(buffer.spill(asset, 0), (elements - 1) * perElement);
+	ASSERT_EQ(data.size(), 1UL);
+	WindowSpill* spill = buffer.getSpill(asset);
+	ASSERT_TRUE(spill != NULL);
+	ASSERT_EQ(spill->getReadings(), (elements - 1) * perElement);
+	ASSERT_LT(buffer.getAssetBytes(asset) + spill->getBytes(), inMemoryBytes / 2);
+	// Timestamp and value of each spilled reading
+	ASSERT_EQ(spill->getBytes(), spill->getReadings() * 2 * sizeof(uint64_t));
+
+	start = chrono::steady_clock::now();
+	double spilledSum = 0;
+	spill->read(UINT64_MAX, [&](const vector<Datapoint *>& values)
+	{
+		spilledSum += values[0]->getData().toDouble();
+	});
+	const vector<Reading *>& readings = data.front()->getData()->getAllReadings();
+	for (auto r = readings.begin(); r != readings.end(); ++r)
+	{
+		spilledSum += (*r)->getReadingData()[0]->getData().toDouble();
+	}
+	auto spilledUs = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+
+	ASSERT_EQ(spilledSum, inMemorySum);
+	RecordProperty("inMemoryBytes", (int)inMemoryBytes);
+	RecordProperty("spilledBytes", (int)spill->getBytes());
+	RecordProperty("inMemoryUs", (int)inMemoryUs);
+	RecordProperty("spilledUs", (int)spilledUs);
+	RecordProperty("inMemoryBytesPerReading", (int)(inMemoryBytes / (elements * perElement)));
+	RecordProperty("spilledBytesPerReading", (int)(spill->getBytes() / spill->getReadings()));
+
+	// Trimmed spill files are removed
+	spill->trim(1500 * 1000000ULL);
+	ASSERT_EQ(spill->getFirstTime(), 1500 * 1000000ULL + 1000);
+	buffer.trimSpill(asset, UINT64_MAX);
+	buffer.keep(asset, 0);
+	ASSERT_TRUE(buffer.getSpill(asset) == NULL);
+	ASSERT_EQ(WindowSpill::getTotalBytes(), 0UL);
+}
+
+/**
+ * Reading with float datapoints: the value of a datapoint
+ * is the position of its name in the alphabet
+ *
+ * @param    names	The datapoint names
+ * @param    time	The user timestamp seconds
+ * @return		The new reading
+ */
+static Reading* layoutReading(const vector<string>& names, time_t time)
+{
+	vector<Datapoint *> values;
+	for (auto n = names.begin(); n != names.end(); ++n)
+	{
+		DatapointValue value((double)((*n)[0] - 'a' + 1));
+		values.push_back(new Datapoint(*n, value));
+	}
+	Reading* reading = new Reading("asset", values);
+	struct timeval tv = { time, 0 };
+	reading->setUserTimestamp(tv);
+	return reading;
+}
+
+/**
+ * Readings with datapoints in another order share the spill file,
+ * readings with other datapoints are not spilled:
+ * no spill file is created for them.
+ */
+TEST(NotificationService, DataBufferSpillLayout)
+{
+	WindowSpill spill;
+	unsigned long totalBytes = WindowSpill::getTotalBytes();
+	vector<Reading *> readings;
+	readings.push_back(layoutReading({ "a", "b" }, 1));
+	readings.push_back(layoutReading({ "b", "a" }, 2));
+	readings.push_back(layoutReading({ "a" }, 3));
+	readings.push_back(layoutReading({ "a", "b", "c" }, 4));
+
+	ASSERT_TRUE(spill.append(vector<Reading *>(1, readings[0])));
+	unsigned long segmentBytes = WindowSpill::getTotalBytes() - totalBytes;
+	ASSERT_GT(segmentBytes, 0UL);
+	ASSERT_TRUE(spill.append(vector<Reading *>(1, readings[1])));
+	ASSERT_FALSE(spill.append(vector<Reading *>(1, readings[2])));
+	ASSERT_FALSE(spill.append(vector<Reading *>(1, readings[3])));
+	// Nothing is appended with a reading not spilled
+	ASSERT_FALSE(spill.append(vector<Reading *>(readings.begin() + 1, readings.begin() + 3)));
+	ASSERT_EQ(spill.getReadings(), 2UL);
+	ASSERT_EQ(WindowSpill::getTotalBytes() - totalBytes, segmentBytes);
+
+	// Values are read in the spill file datapoints order
+	unsigned long records = 0;
+	spill.read(UINT64_MAX, [&](const vector<Datapoint *>& values)
+	{
+		ASSERT_EQ(values.size(), 2UL);
+		ASSERT_EQ(values[0]->getName(), "a");
+		ASSERT_EQ(values[0]->getData().toDouble(), 1.0);
+		ASSERT_EQ(values[1]->getName(), "b");
+		ASSERT_EQ(values[1]->getData().toDouble(), 2.0);
+		records++;
+	});
+	ASSERT_EQ(records, 2UL);
+
+	// Other datapoints are spilled once the spilled readings are trimmed
+	spill.trim(UINT64_MAX);
+	ASSERT_TRUE(spill.empty());
+	ASSERT_TRUE(spill.append(vector<Reading *>(1, readings[2])));
+	spill.clear();
+	ASSERT_EQ(WindowSpill::getTotalBytes(), totalBytes);
+
+	for (auto r = readings.begin(); r != readings.end(); ++r)
+	{
+		delete *r;
+	}
+}
+
+/**
+ * Interned names get dense identifiers
+ */
+TEST(NotificationService, SymbolTable)
+{
+	SymbolTable* symbols = SymbolTable::getInstance();
+	SYMBOL_ID first = symbols->intern("symbol_1");
+	SYMBOL_ID second = symbols->intern("symbol_2");
+	SYMBOL_ID id;
+
+	ASSERT_EQ(second, first + 1);
+	ASSERT_EQ(symbols->intern("symbol_1"), first);
+	ASSERT_EQ(symbols->getName(second), "symbol_2");
+	ASSERT_TRUE(symbols->find("symbol_2", id));
+	ASSERT_EQ(id, second);
+	ASSERT_FALSE(symbols->find("symbol_3", id));
+}
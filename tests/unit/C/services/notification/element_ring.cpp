@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+#include "element_ring.h"
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Ring keeps order and rejects elements when full
+ */
+TEST(NotificationService, ElementRing)
+{
+	ElementRing ring(3);
+	NotificationQueueElement* element;
+	vector<long> values = { 1, 2, 3, 4 };
+
+	ASSERT_EQ(ring.getSize(), 4);
+	ASSERT_TRUE(ring.empty());
+	ASSERT_FALSE(ring.pop(element));
+
+	for (auto v = values.begin(); v != values.end(); ++v)
+	{
+		ASSERT_TRUE(ring.push((NotificationQueueElement *)*v));
+	}
+	ASSERT_FALSE(ring.push((NotificationQueueElement *)5));
+
+	for (auto v = values.begin(); v != values.end(); ++v)
+	{
+		ASSERT_TRUE(ring.pop(element));
+		ASSERT_EQ((long)element, *v);
+	}
+	ASSERT_TRUE(ring.empty());
+}
+
+/**
+ * Elements of each producer are read in order
+ */
+TEST(NotificationService, ElementRingProducers)
+{
+	ElementRing ring(64);
+	const long producers = 4;
+	const long count = 10000;
+	vector<thread *> threads;
+
+	for (long p = 0; p < producers; p++)
+	{
+		threads.push_back(new thread([&ring, p, count] {
+			for (long i = 1; i <= count; i++)
+			{
+				while (!ring.push((NotificationQueueElement *)(p * count + i)))
+				{
+					this_thread::yield();
+				}
+			}
+		}));
+	}
+
+	vector<long> last(producers, 0);
+	long read = 0;
+	bool ordered = true;
+	while (read < producers * count)
+	{
+		NotificationQueueElement* element;
+		if (ring.pop(element))
+		{
+			long value = (long)element - 1;
+			long p = value / count;
+			ordered = ordered && value % count + 1 > last[p];
+			last[p] = value % count + 1;
+			read++;
+		}
+	}
+
+	for (auto t = threads.begin(); t != threads.end(); ++t)
+	{
+		(*t)->join();
+		delete *t;
+	}
+
+	ASSERT_TRUE(ordered);
+	ASSERT_TRUE(ring.empty());
+}
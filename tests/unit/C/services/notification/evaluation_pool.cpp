@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+#include "evaluation_pool.h"
+#include <atomic>
+#include <stdexcept>
+
+using namespace std;
+
+/**
+ * All tasks of a batch are done when run() returns
+ */
+TEST(NotificationService, EvaluationPool)
+{
+EXPECT_EXIT({
+	EvaluationPool* pool = new EvaluationPool(4);
+
+	atomic<int> done(0);
+	bool ret = true;
+	for (int batch = 0; batch < 10 && ret; batch++)
+	{
+		vector<function<void()>> tasks;
+		for (int i = 0; i < 20; i++)
+		{
+			tasks.push_back([&done] { done++; });
+		}
+		pool->run(tasks);
+		ret = done == (batch + 1) * 20;
+	}
+
+	pool->stop();
+	delete pool;
+
+	exit(!(ret == true)); }, ::testing::ExitedWithCode(0), "");
+}
+
+/**
+ * Tasks are run by the caller without pool threads
+ */
+TEST(NotificationService, EvaluationPoolNoThreads)
+{
+EXPECT_EXIT({
+	EvaluationPool* pool = new EvaluationPool(0);
+
+	int done = 0;
+	vector<function<void()>> tasks;
+	for (int i = 0; i < 5; i++)
+	{
+		tasks.push_back([&done] { done++; });
+	}
+	pool->run(tasks);
+
+	bool ret = done == 5 && pool->getWorkers() == 0;
+	delete pool;
+
+	exit(!(ret == true)); }, ::testing::ExitedWithCode(0), "");
+}
+
+
+/**
+ * A throwing task does not block the batch
+ */
+TEST(NotificationService, EvaluationPoolThrowingTask)
+{
+EXPECT_EXIT({
+	EvaluationPool* pool = new EvaluationPool(4);
+
+	atomic<int> done(0);
+	vector<function<void()>> tasks;
+	for (int i = 0; i < 20; i++)
+	{
+		if (i % 5 == 0)
+		{
+			tasks.push_back([] { throw runtime_error("rule failure"); });
+		}
+		else
+		{
+			tasks.push_back([&done] { done++; });
+		}
+	}
+	pool->run(tasks);
+	pool->run(tasks);
+
+	bool ret = done == 32;
+	pool->stop();
+	delete pool;
+
+	exit(!(ret == true)); }, ::testing::ExitedWithCode(0), "");
+}
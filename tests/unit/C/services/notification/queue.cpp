@@ -2,6 +2,12 @@
 #include "notification_service.h"
 #include "notification_manager.h"
 #include "notification_queue.h"
+#include "queue_pipeline.h"
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <set>
 
 using namespace std;
 
@@ -30,3 +36,944 @@ EXPECT_EXIT({
 
 	exit(0); }, ::testing::ExitedWithCode(0), "");
 }
+
+/**
+ * Readings payload parsing errors
+ */
+TEST(NotificationService, QueueBadPayload)
+{
+EXPECT_EXIT({
+	string myName = "myName";
+
+	NotificationApi* api = new NotificationApi(0, 1);
+	api->setCallBackURL();
+
+	NotificationQueue* queue = new NotificationQueue(myName);
+	bool ret = api->queueNotification("FOOBAR", "{\"readings\" : [ 1, 2 ]}") == false &&
+		   api->queueNotification("FOOBAR", "{\"readings\" : ") == false &&
+		   api->queueNotification("FOOBAR", "{\"rows\" : []}") == true;
+
+	api->stop();
+        queue->stop();
+
+	delete queue;
+	delete api;
+
+	exit(!(ret == true)); }, ::testing::ExitedWithCode(0), "");
+}
+
+/**
+ * JSON readings of asset FOOBAR with string and numeric datapoints
+ *
+ * @param    count	The number of readings
+ * @return		The readings payload
+ */
+static string readingsPayload(long count)
+{
+	string payload = "{ \"readings\" : [ ";
+	for (long i = 0; i < count; i++)
+	{
+		string v = to_string(i);
+		if (i)
+		{
+			payload += ", ";
+		}
+		payload += "{ \"id\" : " + v + ", \"asset_code\" : \"FOOBAR\", "
+			"\"read_key\" : \"f1cfff7a-3769-4f47-9ded-" + v + "\", "
+			"\"reading\" : { \"temperature\" : " + v + ".5, \"humidity\" : " + v + ", "
+			"\"location\" : \"building \\\"north\\\" floor " + v + "\" }, "
+			"\"user_ts\" : \"2019-01-01 10:00:00.000000+00:00\", "
+			"\"ts\" : \"2019-01-01 10:00:00.000000+00:00\" }";
+	}
+	payload += " ] }";
+	return payload;
+}
+
+/**
+ * Readings parsed in place in the callback buffer, compared
+ * with the ReadingSet parsing of a copy used before
+ */
+TEST(NotificationService, QueueParseInPlace)
+{
+EXPECT_EXIT({
+	QueuePipeline pipeline;
+	NotificationApi* api = pipeline.getApi();
+	NotificationQueue* queue = pipeline.getQueue();
+	string payload = readingsPayload(2000);
+	int rounds = 20;
+	bool ret = true;
+
+	// Copy parsing
+	auto start = chrono::steady_clock::now();
+	for (int i = 0; i < rounds; i++)
+	{
+		ReadingSet* readings = new ReadingSet(payload);
+		ret = queue->addElement(new NotificationQueueElement("FOOBAR", readings)) && ret;
+	}
+	auto copyUs = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+
+	// In place parsing, of request buffers
+	vector<string> buffers(rounds, payload);
+	start = chrono::steady_clock::now();
+	for (int i = 0; i < rounds; i++)
+	{
+		ret = api->queueNotification("FOOBAR", &buffers[i][0]) && ret;
+	}
+	auto inPlaceUs = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+
+	// Strings have been terminated and unescaped in the buffer
+	ret = ret && buffers[0] != payload;
+
+	cerr << "Copy parsing: " << copyUs << " us, "
+	     << "in place parsing: " << inPlaceUs << " us" << endl;
+	ret = ret && inPlaceUs * 10 < copyUs * 11;
+
+	exit(!(ret == true)); }, ::testing::ExitedWithCode(0), "");
+}
+
+// Header with one reading: "FOOBAR", no timestamps,
+// one integer datapoint "dp" with value 7
+static char data[] = { 'F', 'L', 'R', 'B', 1, 1, 0, 0, 0,
+			      6, 0, 'F', 'O', 'O', 'B', 'A', 'R',
+			      0, 0, 0, 0, 0, 0, 0, 0,
+			      0, 0, 0, 0, 0, 0, 0, 0,
+			      1, 0,
+			      2, 0, 'd', 'p', 0,
+			      7, 0, 0, 0, 0, 0, 0, 0 };
+static char bad[] = { 'F', 'L', 'R', 'B', 2, 0, 0, 0, 0 };
+
+/**
+ * Binary readings payload decoding
+ */
+TEST(NotificationService, QueueBinaryPayload)
+{
+EXPECT_EXIT({
+	string myName = "myName";
+
+	NotificationApi* api = new NotificationApi(0, 1);
+	api->setCallBackURL();
+
+	NotificationQueue* queue = new NotificationQueue(myName);
+
+	bool ret = api->queueNotification("FOOBAR", data, sizeof(data), true) == true &&
+		   api->queueNotification("FOOBAR", data, sizeof(data) - 1, true) == false &&
+		   api->queueNotification("FOOBAR", bad, sizeof(bad), true) == false;
+
+	api->stop();
+        queue->stop();
+
+	delete queue;
+	delete api;
+
+	exit(!(ret == true)); }, ::testing::ExitedWithCode(0), "");
+}
+
+/**
+ * Per asset ordered handoff of concurrent callbacks
+ */
+TEST(NotificationService, QueueHandoffOrder)
+{
+	AssetHandoff handoff;
+	vector<string> assets(1, "FOOBAR");
+	vector<unsigned long> first;
+	vector<unsigned long> second;
+	vector<string> others(1, "OTHER");
+	vector<unsigned long> other;
+
+	handoff.enter(assets, first);
+	handoff.enter(assets, second);
+	handoff.enter(others, other);
+
+	atomic<bool> done(false);
+	thread t([&] {
+		handoff.wait(assets, second);
+		done = true;
+		handoff.leave(assets);
+	});
+
+	// Other asset names don't wait
+	handoff.wait(others, other);
+	handoff.leave(others);
+
+	sleep(1);
+	ASSERT_FALSE(done);
+
+	handoff.wait(assets, first);
+	handoff.leave(assets);
+
+	t.join();
+	ASSERT_TRUE(done);
+}
+
+/**
+ * Asset names spread evenly over the queue shards
+ *
+ * @param    numShards	The number of queue shards
+ * @param    perShard	The number of assets of each shard
+ * @return		The asset names, numShards * perShard
+ */
+static vector<string> shardAssets(unsigned long numShards,
+				  unsigned long perShard)
+{
+	vector<string> assets;
+	vector<unsigned long> counts(numShards, 0);
+	for (unsigned long i = 0; assets.size() < numShards * perShard; i++)
+	{
+		string assetName = "asset_" + to_string(i);
+		// Same mapping as the queue shards
+		unsigned long shard = std::hash<string>()(assetName) % numShards;
+		if (counts[shard] < perShard)
+		{
+			counts[shard]++;
+			assets.push_back(assetName);
+		}
+	}
+	return assets;
+}
+
+/**
+ * Add one notification per asset, with a recording rule
+ *
+ * @param    pipeline	The pipeline to add notifications to
+ * @param    assets	The asset names
+ * @return		The rule plugins, one per asset
+ */
+static vector<RecordingRule *> addAssetNotifications(QueuePipeline& pipeline,
+						     const vector<string>& assets)
+{
+	vector<RecordingRule *> plugins;
+	for (auto a = assets.begin(); a != assets.end(); ++a)
+	{
+		RecordingRule* plugin = new RecordingRule("Recording",
+							  "{ \"triggers\" : [ { \"asset\" : \"" + *a + "\" } ] }");
+		pipeline.addNotification("notify_" + *a, plugin, pipelineType());
+		plugins.push_back(plugin);
+	}
+	return plugins;
+}
+
+/**
+ * Data of each asset is processed in order by the worker of its shard
+ */
+TEST(NotificationService, QueueWorkers)
+{
+EXPECT_EXIT({
+	unsigned long numWorkers = 4;
+	long perAsset = 20;
+	QueuePipeline pipeline(numWorkers);
+	vector<string> assets = shardAssets(numWorkers, 2);
+	vector<RecordingRule *> plugins = addAssetNotifications(pipeline, assets);
+
+	NotificationQueue* queue = pipeline.getQueue();
+	time_t now = time(NULL);
+
+	bool ret = true;
+	for (long i = 0; i < perAsset; i++)
+	{
+		for (auto a = assets.begin(); a != assets.end(); ++a)
+		{
+			ret = queue->addElement(pipelineElement(*a, i, now)) && ret;
+		}
+	}
+
+	// Worker thread of each shard, none yet
+	vector<thread::id> shardThreads(numWorkers);
+	set<thread::id> threads;
+	for (size_t i = 0; i < assets.size() && ret; i++)
+	{
+		ret = plugins[i]->waitEvaluations(perAsset);
+
+		// All data, in the order it was added
+		vector<long> values = evaluatedValues(plugins[i]->getEvaluated());
+		for (long v = 0; v < perAsset && ret; v++)
+		{
+			ret = values.size() == (size_t)perAsset && values[v] == v;
+		}
+		if (!ret)
+		{
+			cerr << "Data of " << assets[i] << " has not been evaluated in order" << endl;
+			break;
+		}
+
+		// By the same worker, the one of the asset shard
+		vector<thread::id> evalThreads = plugins[i]->getThreads();
+		unsigned long shard = std::hash<string>()(assets[i]) % numWorkers;
+		if (shardThreads[shard] == thread::id())
+		{
+			shardThreads[shard] = evalThreads[0];
+			threads.insert(evalThreads[0]);
+		}
+		ret = count(evalThreads.begin(),
+			    evalThreads.end(),
+			    shardThreads[shard]) == perAsset;
+		if (!ret)
+		{
+			cerr << "Data of " << assets[i] << " has not been evaluated by its shard worker" << endl;
+		}
+	}
+	// One worker per shard
+	ret = ret && threads.size() == numWorkers;
+
+	exit(!(ret == true)); }, ::testing::ExitedWithCode(0), "");
+}
+
+/**
+ * Time to evaluate data of assets spread over the queue shards
+ *
+ * @param    numWorkers	The number of queue workers
+ * @param    assets	The asset names
+ * @param    perAsset	The number of readings of each asset
+ * @param    evalCostUs	The time spent by each evaluation
+ * @return		The elapsed milliseconds, -1 if not all data is evaluated
+ */
+static long workersElapsedMs(unsigned long numWorkers,
+			     const vector<string>& assets,
+			     long perAsset,
+			     unsigned long evalCostUs)
+{
+	QueuePipeline pipeline(numWorkers);
+	vector<RecordingRule *> plugins = addAssetNotifications(pipeline, assets);
+	for (auto p = plugins.begin(); p != plugins.end(); ++p)
+	{
+		(*p)->setEvalCost(evalCostUs);
+	}
+
+	NotificationQueue* queue = pipeline.getQueue();
+	time_t now = time(NULL);
+	auto start = chrono::steady_clock::now();
+	for (long i = 0; i < perAsset; i++)
+	{
+		for (auto a = assets.begin(); a != assets.end(); ++a)
+		{
+			queue->addElement(pipelineElement(*a, i, now));
+		}
+	}
+	for (auto p = plugins.begin(); p != plugins.end(); ++p)
+	{
+		if (!(*p)->waitEvaluations(perAsset, 30))
+		{
+			return -1;
+		}
+	}
+	return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Data of assets in different shards is evaluated in parallel:
+ * four workers take well under the time of one.
+ */
+TEST(NotificationService, QueueWorkersScaling)
+{
+EXPECT_EXIT({
+	vector<string> assets = shardAssets(4, 2);
+	long oneWorkerMs = workersElapsedMs(1, assets, 50, 1000);
+	long fourWorkersMs = workersElapsedMs(4, assets, 50, 1000);
+
+	cerr << "1 worker: " << oneWorkerMs << " ms, "
+	     << "4 workers: " << fourWorkersMs << " ms" << endl;
+	bool ret = oneWorkerMs > 0 &&
+		   fourWorkersMs > 0 &&
+		   fourWorkersMs * 2 < oneWorkerMs;
+
+	exit(!(ret == true)); }, ::testing::ExitedWithCode(0), "");
+}
+
+/**
+ * Stale data policy configuration items
+ */
+TEST(NotificationService, QueueStaleConfig)
+{
+EXPECT_EXIT({
+	ManagementClient* managerClient = new ManagementClient("0.0.0.0", 0);
+	NotificationManager instances("myName", managerClient, NULL);
+
+	string items = "{ "
+		"\"enable\" : { \"description\" : \"Enabled\", \"type\" : \"boolean\", "
+			"\"default\" : \"true\", \"value\" : \"true\" }, "
+		"\"rule\" : { \"description\" : \"Rule\", \"type\" : \"string\", "
+			"\"default\" : \"Threshold\", \"value\" : \"Threshold\" }, "
+		"\"channel\" : { \"description\" : \"Channel\", \"type\" : \"string\", "
+			"\"default\" : \"email\", \"value\" : \"email\" }, "
+		"\"notification_type\" : { \"description\" : \"Type\", \"type\" : \"string\", "
+			"\"default\" : \"one shot\", \"value\" : \"one shot\" }, "
+		"\"stale_data\" : { \"description\" : \"Stale data\", \"type\" : \"string\", "
+			"\"default\" : \"keep\", \"value\" : \"drop\" }, "
+		"\"max_queue_age\" : { \"description\" : \"Queue age\", \"type\" : \"integer\", "
+			"\"default\" : \"0\", \"value\" : \"5\" }, "
+		"\"max_reading_age\" : { \"description\" : \"Reading age\", \"type\" : \"integer\", "
+			"\"default\" : \"0\", \"value\" : \"60\" } }";
+	ConfigCategory config("stale", items);
+
+	bool enabled;
+	string rule;
+	string delivery;
+	string text;
+	NOTIFICATION_TYPE type;
+	bool ret = instances.getConfigurationItems(config, enabled, rule, delivery, type, text) &&
+		   type.dropStale &&
+		   type.maxQueueAge == 5 &&
+		   type.maxReadingAge == 60;
+
+	// Data is kept by default
+	ConfigCategory keep("keep", items.replace(items.find("\"drop\""), 6, "\"keep\""));
+	ret = ret &&
+	      instances.getConfigurationItems(keep, enabled, rule, delivery, type, text) &&
+	      !type.dropStale;
+
+	delete managerClient;
+
+	exit(!(ret == true)); }, ::testing::ExitedWithCode(0), "");
+}
+
+/**
+ * Stale data queued for more than max_queue_age
+ * merged with fresh data of the same asset
+ */
+TEST(NotificationService, QueueStaleQueueAge)
+{
+EXPECT_EXIT({
+	QueuePipeline pipeline;
+	RecordingRule* plugin = new RecordingRule("Recording",
+						  "{ \"triggers\" : [ { \"asset\" : \"STALE\" } ] }");
+	NOTIFICATION_TYPE type = pipelineType();
+	type.dropStale = true;
+	type.maxQueueAge = 1;
+	pipeline.addNotification("stale", plugin, type);
+
+	NotificationQueue* queue = pipeline.getQueue();
+	time_t now = time(NULL);
+
+	// The worker holds the first data: next data queues up
+	plugin->hold();
+	queue->addElement(pipelineElement("STALE", 1, now));
+	bool ret = plugin->waitEvaluations(1);
+
+	// Stale data, then fresh data merged into it
+	queue->addElement(pipelineElement("STALE", 2, now));
+	sleep(3);
+	queue->addElement(pipelineElement("STALE", 3, now));
+	plugin->release();
+
+	ret = plugin->waitEvaluations(2) && ret;
+	// Allow the worker to complete
+	sleep(1);
+
+	vector<long> values = evaluatedValues(plugin->getEvaluated());
+	ret = ret &&
+	      values.size() == 2 &&
+	      values[0] == 1 &&
+	      values[1] == 3 &&
+	      pipeline.getManager().getStats().getDropped("STALE") == 1;
+	if (!ret)
+	{
+		cerr << "Fresh data merged with stale data has not been evaluated" << endl;
+	}
+
+	exit(!(ret == true)); }, ::testing::ExitedWithCode(0), "");
+}
+
+/**
+ * Readings older than max_reading_age,
+ * with the drop and keep stale data policies
+ */
+TEST(NotificationService, QueueStaleReadingAge)
+{
+EXPECT_EXIT({
+	QueuePipeline pipeline;
+	string triggers = "{ \"triggers\" : [ { \"asset\" : \"OLD\" } ] }";
+	RecordingRule* dropPlugin = new RecordingRule("Recording", triggers);
+	RecordingRule* keepPlugin = new RecordingRule("Recording", triggers);
+	NOTIFICATION_TYPE type = pipelineType();
+	type.maxReadingAge = 10;
+	pipeline.addNotification("keep", keepPlugin, type);
+	type.dropStale = true;
+	pipeline.addNotification("drop", dropPlugin, type);
+
+	NotificationQueue* queue = pipeline.getQueue();
+	time_t now = time(NULL);
+	queue->addElement(pipelineElement("OLD", 1, now - 100));
+	queue->addElement(pipelineElement("OLD", 2, now));
+
+	bool ret = dropPlugin->waitEvaluations(1) &&
+		   keepPlugin->waitEvaluations(2);
+	// Allow the worker to complete
+	sleep(1);
+
+	vector<long> dropped = evaluatedValues(dropPlugin->getEvaluated());
+	vector<long> kept = evaluatedValues(keepPlugin->getEvaluated());
+	ret = ret &&
+	      dropped.size() == 1 &&
+	      dropped[0] == 2 &&
+	      kept.size() == 2 &&
+	      pipeline.getManager().getStats().getDropped("OLD") == 1;
+	if (!ret)
+	{
+		cerr << "Readings older than max_reading_age are not dropped" << endl;
+	}
+
+	exit(!(ret == true)); }, ::testing::ExitedWithCode(0), "");
+}
+
+/**
+ * Backlogged data covering several windows and the last
+ * window of a quiet source
+ */
+TEST(NotificationService, QueueWindowBacklog)
+{
+EXPECT_EXIT({
+	QueuePipeline pipeline;
+	RecordingRule* plugin = new RecordingRule("Recording",
+						  "{ \"triggers\" : [ { \"asset\" : \"WINDOW\", \"Maximum\" : 1 } ] }");
+	pipeline.addNotification("window", plugin, pipelineType());
+
+	// One reading every 1.2 seconds: one window each
+	time_t now = time(NULL);
+	vector<Reading *> readings;
+	readings.push_back(pipelineReading("WINDOW", 1, now - 10, 0));
+	readings.push_back(pipelineReading("WINDOW", 2, now - 9, 200000));
+	readings.push_back(pipelineReading("WINDOW", 3, now - 8, 400000));
+	readings.push_back(pipelineReading("WINDOW", 4, now - 7, 600000));
+	pipeline.getQueue()->addElement(pipelineElement("WINDOW", readings));
+
+	// The newest reading completes the first three windows
+	bool ret = plugin->waitEvaluations(3) &&
+		   plugin->getEvaluated().size() == 3;
+	if (!ret)
+	{
+		cerr << "Backlogged windows have not been evaluated" << endl;
+	}
+
+	// The last window is complete when the source is quiet
+	ret = ret && plugin->waitEvaluations(4);
+	vector<long> values = evaluatedValues(plugin->getEvaluated());
+	ret = ret &&
+	      values.size() == 4 &&
+	      values[0] == 1 &&
+	      values[1] == 2 &&
+	      values[2] == 3 &&
+	      values[3] == 4;
+	if (!ret)
+	{
+		cerr << "The window of a quiet source has not been evaluated" << endl;
+	}
+
+	exit(!(ret == true)); }, ::testing::ExitedWithCode(0), "");
+}
+
+/**
+ * JSON readings of asset MASK with datapoints a, b and c
+ *
+ * @param    value	The value of all the datapoints
+ * @return		The readings payload
+ */
+static string maskPayload(long value)
+{
+	string v = to_string(value);
+	return "{ \"readings\" : [ { \"id\" : " + v + ", \"asset_code\" : \"MASK\", "
+		"\"read_key\" : \"f1cfff7a-3769-4f47-9ded-00000000000" + v + "\", "
+		"\"reading\" : { \"a\" : " + v + ", \"b\" : " + v + ", \"c\" : " + v + " }, "
+		"\"user_ts\" : \"2019-01-01 10:00:0" + v + ".000000+00:00\", "
+		"\"ts\" : \"2019-01-01 10:00:0" + v + ".000000+00:00\" } ] }";
+}
+
+/**
+ * Datapoints kept when readings are received: datapoints of disabled
+ * notifications are kept, data received before a notification
+ * subscribed is not passed to it without its datapoints
+ */
+TEST(NotificationService, QueueDatapointsMask)
+{
+EXPECT_EXIT({
+	QueuePipeline pipeline;
+	RecordingRule* aPlugin = new RecordingRule("Recording",
+						   "{ \"triggers\" : [ { \"asset\" : \"MASK\", \"datapoints\" : [ \"a\" ] } ] }");
+	RecordingRule* bPlugin = new RecordingRule("Recording",
+						   "{ \"triggers\" : [ { \"asset\" : \"MASK\", \"datapoints\" : [ \"b\" ] } ] }");
+	RecordingRule* cPlugin = new RecordingRule("Recording",
+						   "{ \"triggers\" : [ { \"asset\" : \"MASK\", \"datapoints\" : [ \"c\" ] } ] }");
+	pipeline.addNotification("a", aPlugin, pipelineType());
+	pipeline.addNotification("b", bPlugin, pipelineType())->disable();
+
+	vector<string> mask;
+	pipeline.getSubscriptions().getDatapointsMask("MASK", mask);
+	sort(mask.begin(), mask.end());
+	bool ret = mask.size() == 2 && mask[0] == "a" && mask[1] == "b";
+	if (!ret)
+	{
+		cerr << "Datapoints of disabled notifications are not kept" << endl;
+	}
+
+	// The worker holds the first data: next data queues up
+	NotificationApi* api = pipeline.getApi();
+	aPlugin->hold();
+	ret = api->queueNotification("MASK", maskPayload(1)) && ret;
+	ret = aPlugin->waitEvaluations(1) && ret;
+
+	// Data received before and after a new subscription
+	ret = api->queueNotification("MASK", maskPayload(2)) && ret;
+	pipeline.addNotification("c", cPlugin, pipelineType());
+	ret = api->queueNotification("MASK", maskPayload(3)) && ret;
+	aPlugin->release();
+
+	ret = aPlugin->waitEvaluations(3) &&
+	      cPlugin->waitEvaluations(1) &&
+	      ret;
+	// Allow the worker to complete
+	sleep(1);
+
+	vector<string> evaluated = cPlugin->getEvaluated();
+	ret = ret &&
+	      evaluated.size() == 1 &&
+	      evaluated[0].find("\"c\" : 3") != string::npos &&
+	      bPlugin->getEvaluated().empty();
+	if (!ret)
+	{
+		cerr << "Data without the needed datapoints has been evaluated" << endl;
+	}
+
+	exit(!(ret == true)); }, ::testing::ExitedWithCode(0), "");
+}
+
+/**
+ * Check the HTTP status of a response
+ *
+ * @param    response	The HTTP response
+ * @param    status	The expected status code, e.g. "200"
+ * @return		True if the response has the status code
+ */
+static bool hasStatus(shared_ptr<HttpClient::Response> response,
+		      const string& status)
+{
+	return response->status_code.compare(0, status.size(), status) == 0;
+}
+
+/**
+ * Reading callbacks of assets without enabled notifications
+ * are acknowledged and dropped before parsing
+ */
+TEST(NotificationService, QueueCallbackDiscarded)
+{
+EXPECT_EXIT({
+	QueuePipeline pipeline;
+	RecordingRule* plugin = new RecordingRule("Recording",
+						  "{ \"triggers\" : [ { \"asset\" : \"KEEP\" } ] }");
+	pipeline.addNotification("keep", plugin, pipelineType());
+	bool ret = pipeline.startApi();
+	const NotificationStats& stats = pipeline.getManager().getStats();
+
+	// Invalid readings: they are not parsed
+	shared_ptr<HttpClient::Response> response;
+	response = pipeline.post("/notification/reading/asset/DROP",
+				 "{ \"readings\" : [ 1, 2 ] }");
+	ret = ret &&
+	      hasStatus(response, "200") &&
+	      response->content.string().find("data discarded") != string::npos &&
+	      stats.discarded == 1;
+
+	response = pipeline.post("/notification/reading/asset/KEEP",
+				 pipelinePayload(vector<string>(1, pipelineJSONReading("KEEP", 2, 2))));
+	ret = ret &&
+	      hasStatus(response, "200") &&
+	      response->content.string().find("data queued") != string::npos &&
+	      plugin->waitEvaluations(1) &&
+	      stats.discarded == 1;
+
+	vector<long> values = evaluatedValues(plugin->getEvaluated());
+	ret = ret && values.size() == 1 && values[0] == 2;
+	if (!ret)
+	{
+		cerr << "Callback of an asset without notifications has not been discarded" << endl;
+	}
+
+	exit(!(ret == true)); }, ::testing::ExitedWithCode(0), "");
+}
+
+/**
+ * Multi asset callback: readings of subscribed assets are queued,
+ * readings of other assets are discarded
+ */
+TEST(NotificationService, QueueBatchCallback)
+{
+EXPECT_EXIT({
+	QueuePipeline pipeline;
+	RecordingRule* plugin = new RecordingRule("Recording",
+						  "{ \"triggers\" : [ { \"asset\" : \"KEEP\" } ] }");
+	pipeline.addNotification("keep", plugin, pipelineType());
+	bool ret = pipeline.startApi();
+
+	vector<string> readings;
+	readings.push_back(pipelineJSONReading("KEEP", 1, 1));
+	readings.push_back(pipelineJSONReading("DROP", 2, 2));
+	readings.push_back(pipelineJSONReading("KEEP", 3, 3));
+	shared_ptr<HttpClient::Response> response;
+	response = pipeline.post("/notification/reading", pipelinePayload(readings));
+	string content = response->content.string();
+	ret = ret &&
+	      hasStatus(response, "200") &&
+	      content.find("\"queued\" : 1") != string::npos &&
+	      content.find("\"discarded\" : 1") != string::npos &&
+	      plugin->waitEvaluations(2);
+
+	// Allow the worker to complete
+	sleep(1);
+	vector<long> values = evaluatedValues(plugin->getEvaluated());
+	ret = ret && values.size() == 2 && values[0] == 1 && values[1] == 3;
+
+	// Bad readings data
+	response = pipeline.post("/notification/reading", "{ \"readings\" : [ 1, 2 ] }");
+	ret = ret && hasStatus(response, "400");
+	if (!ret)
+	{
+		cerr << "Multi asset callback readings have not been split" << endl;
+	}
+
+	exit(!(ret == true)); }, ::testing::ExitedWithCode(0), "");
+}
+
+/**
+ * Callbacks are rejected with 503 and Retry-After
+ * while the queue is at its high-water mark
+ */
+TEST(NotificationService, QueueOverload)
+{
+EXPECT_EXIT({
+	QueuePipeline pipeline;
+	RecordingRule* plugin = new RecordingRule("Recording",
+						  "{ \"triggers\" : [ { \"asset\" : \"KEEP\" } ] }");
+	pipeline.addNotification("keep", plugin, pipelineType());
+	bool ret = pipeline.startApi();
+	const NotificationStats& stats = pipeline.getManager().getStats();
+	string path = "/notification/reading/asset/KEEP";
+
+	// One queued reading at most
+	pipeline.getQueue()->setLimits(1, 0);
+
+	// The worker holds the first data: next data queues up
+	plugin->hold();
+	shared_ptr<HttpClient::Response> response;
+	response = pipeline.post(path, pipelinePayload(vector<string>(1, pipelineJSONReading("KEEP", 1, 1))));
+	ret = ret && hasStatus(response, "200") && plugin->waitEvaluations(1);
+	response = pipeline.post(path, pipelinePayload(vector<string>(1, pipelineJSONReading("KEEP", 2, 2))));
+	ret = ret && hasStatus(response, "200");
+
+	// Queue is full
+	response = pipeline.post(path, pipelinePayload(vector<string>(1, pipelineJSONReading("KEEP", 3, 3))));
+	auto retryAfter = response->header.find("Retry-After");
+	ret = ret &&
+	      hasStatus(response, "503") &&
+	      retryAfter != response->header.end() &&
+	      (*retryAfter).second == to_string(RETRY_AFTER_SECONDS) &&
+	      response->content.string().find("\"retryable\" : true") != string::npos &&
+	      stats.rejected == 1;
+	response = pipeline.post("/notification/reading",
+				 pipelinePayload(vector<string>(1, pipelineJSONReading("KEEP", 4, 4))));
+	ret = ret && hasStatus(response, "503") && stats.rejected == 2;
+
+	// Queued data is still processed, and new data accepted
+	plugin->release();
+	ret = plugin->waitEvaluations(2) && ret;
+	// Allow the worker to complete
+	sleep(1);
+	response = pipeline.post(path, pipelinePayload(vector<string>(1, pipelineJSONReading("KEEP", 5, 5))));
+	ret = ret && hasStatus(response, "200") && plugin->waitEvaluations(3);
+
+	vector<long> values = evaluatedValues(plugin->getEvaluated());
+	ret = ret &&
+	      values.size() == 3 &&
+	      values[0] == 1 &&
+	      values[1] == 2 &&
+	      values[2] == 5;
+	if (!ret)
+	{
+		cerr << "Callbacks have not been rejected with the queue full" << endl;
+	}
+
+	exit(!(ret == true)); }, ::testing::ExitedWithCode(0), "");
+}
+
+/**
+ * Multi asset callbacks add data in the callback order:
+ * a short callback waits for a long one received before it
+ */
+TEST(NotificationService, QueueBatchOrder)
+{
+EXPECT_EXIT({
+	QueuePipeline pipeline;
+	RecordingRule* plugin = new RecordingRule("Recording",
+						  "{ \"triggers\" : [ { \"asset\" : \"ORDER\" } ] }");
+	pipeline.addNotification("order", plugin, pipelineType());
+	NotificationApi* api = pipeline.getApi();
+	long count = 50000;
+
+	vector<string> readings;
+	for (long i = 0; i < count; i++)
+	{
+		readings.push_back(pipelineJSONReading("ORDER", i, i));
+	}
+	string first = pipelinePayload(readings);
+	string second = pipelinePayload(vector<string>(1, pipelineJSONReading("ORDER", count, 30000000)));
+
+	atomic<bool> firstRet(false);
+	thread t([&] {
+		unsigned long queued;
+		unsigned long discarded;
+		firstRet = api->queueNotifications(&first[0], first.size(), false, queued, discarded);
+	});
+	// The second callback is parsed while the first one is
+	usleep(10000);
+	unsigned long queued;
+	unsigned long discarded;
+	bool ret = api->queueNotifications(&second[0], second.size(), false, queued, discarded);
+	t.join();
+	ret = ret && firstRet && plugin->waitEvaluations(count + 1, 60);
+
+	// Allow the worker to complete
+	sleep(1);
+	vector<long> values = evaluatedValues(plugin->getEvaluated());
+	ret = ret && values.size() == (size_t)count + 1;
+	for (long i = 0; i <= count && ret; i++)
+	{
+		ret = values[i] == i;
+	}
+	if (!ret)
+	{
+		cerr << "Multi asset callbacks data has not been queued in order" << endl;
+	}
+
+	exit(!(ret == true)); }, ::testing::ExitedWithCode(0), "");
+}
+
+/**
+ * Data of an asset queued while the worker is busy is merged
+ * into one batch and evaluated in reading timestamp order
+ */
+TEST(NotificationService, QueueCoalescing)
+{
+EXPECT_EXIT({
+	QueuePipeline pipeline;
+	RecordingRule* plugin = new RecordingRule("Recording",
+						  "{ \"triggers\" : [ { \"asset\" : \"MERGE\" } ] }");
+	RecordingRule* otherPlugin = new RecordingRule("Recording",
+						       "{ \"triggers\" : [ { \"asset\" : \"OTHER\" } ] }");
+	pipeline.addNotification("merge", plugin, pipelineType());
+	pipeline.addNotification("other", otherPlugin, pipelineType());
+	const NotificationStats& stats = pipeline.getManager().getStats();
+
+	NotificationQueue* queue = pipeline.getQueue();
+	time_t now = time(NULL);
+
+	// The worker holds the first data: next data queues up
+	plugin->hold();
+	queue->addElement(pipelineElement("MERGE", 1, now));
+	bool ret = plugin->waitEvaluations(1);
+
+	// Received out of timestamp order, other assets are not merged
+	queue->addElement(pipelineElement("MERGE", 5, now));
+	queue->addElement(pipelineElement("MERGE", 3, now));
+	queue->addElement(pipelineElement("OTHER", 6, now));
+	queue->addElement(pipelineElement("MERGE", 4, now));
+	queue->addElement(pipelineElement("MERGE", 2, now));
+	plugin->release();
+
+	ret = plugin->waitEvaluations(5) && otherPlugin->waitEvaluations(1) && ret;
+	// Allow the worker to complete
+	sleep(1);
+
+	vector<long> values = evaluatedValues(plugin->getEvaluated());
+	ret = ret && values.size() == 5;
+	for (long i = 0; i < 5 && ret; i++)
+	{
+		ret = values[i] == i + 1;
+	}
+	if (!ret)
+	{
+		cerr << "Merged data has not been evaluated in timestamp order" << endl;
+	}
+
+	// Six elements in three batches: 1, 5 + 3 + 4 + 2 and 6
+	ret = ret &&
+	      stats.processedElements == 6 &&
+	      stats.processedBatches == 3;
+	if (!ret)
+	{
+		cerr << "Coalescing ratio is not 2" << endl;
+	}
+
+	exit(!(ret == true)); }, ::testing::ExitedWithCode(0), "");
+}
+
+/**
+ * High priority data is served first, low priority data
+ * is served after being skipped QUEUE_LANE_MAX_SKIPS times
+ */
+TEST(NotificationService, QueueLaneSkips)
+{
+EXPECT_EXIT({
+	QueuePipeline pipeline;
+	const NotificationStats& stats = pipeline.getManager().getStats();
+	RecordingRule* gate = new RecordingRule("Recording",
+						"{ \"triggers\" : [ { \"asset\" : \"GATE\" } ] }");
+	pipeline.addNotification("gate", gate, pipelineType());
+
+	NOTIFICATION_TYPE lowType = pipelineType();
+	lowType.priority = E_NOTIFICATION_PRIORITY::PriorityLow;
+	RecordingRule* low = new RecordingRule("Recording",
+					       "{ \"triggers\" : [ { \"asset\" : \"LOW\" } ] }");
+	pipeline.addNotification("low", low, lowType);
+
+	// One asset per element: data of an asset is merged
+	NOTIFICATION_TYPE highType = pipelineType();
+	highType.priority = E_NOTIFICATION_PRIORITY::PriorityHigh;
+	int highAssets = 3 * QUEUE_LANE_MAX_SKIPS;
+	vector<RecordingRule *> high;
+	for (int i = 0; i < highAssets; i++)
+	{
+		string assetName = "HIGH_" + to_string(i);
+		high.push_back(new RecordingRule("Recording",
+						 "{ \"triggers\" : [ { \"asset\" : \"" + assetName + "\" } ] }"));
+		pipeline.addNotification("high_" + to_string(i), high.back(), highType);
+	}
+
+	NotificationQueue* queue = pipeline.getQueue();
+	time_t now = time(NULL);
+
+	// The worker holds the gate data: next data queues up
+	gate->hold();
+	queue->addElement(pipelineElement("GATE", 1, now));
+	bool ret = gate->waitEvaluations(1);
+	queue->addElement(pipelineElement("LOW", 1, now));
+	for (int i = 0; i < highAssets; i++)
+	{
+		queue->addElement(pipelineElement("HIGH_" + to_string(i), 1, now));
+	}
+	gate->release();
+
+	ret = low->waitEvaluations(1) && ret;
+	for (int i = 0; i < highAssets && ret; i++)
+	{
+		ret = high[i]->waitEvaluations(1);
+	}
+
+	// High priority data evaluated before the low priority data
+	unsigned long lowSequence = low->getSequence()[0];
+	int before = 0;
+	for (int i = 0; i < highAssets && ret; i++)
+	{
+		if (high[i]->getSequence()[0] < lowSequence)
+		{
+			before++;
+		}
+	}
+	ret = ret &&
+	      before == QUEUE_LANE_MAX_SKIPS &&
+	      stats.laneElements[E_NOTIFICATION_PRIORITY::PriorityHigh] == (unsigned long)highAssets &&
+	      stats.laneElements[E_NOTIFICATION_PRIORITY::PriorityNormal] == 1 &&
+	      stats.laneElements[E_NOTIFICATION_PRIORITY::PriorityLow] == 1;
+	if (!ret)
+	{
+		cerr << "Low priority data has been evaluated after "
+		     << before << " high priority data" << endl;
+	}
+
+	exit(!(ret == true)); }, ::testing::ExitedWithCode(0), "");
+}
@@ -0,0 +1,365 @@
+#ifndef _QUEUE_PIPELINE_H
+#define _QUEUE_PIPELINE_H
+/*
+ * Notification pipeline objects for the queue unit tests
+ */
+
+#include "notification_service.h"
+#include "notification_manager.h"
+#include "notification_subscription.h"
+#include "notification_queue.h"
+#include "notification_api.h"
+#include <client_http.hpp>
+#include <condition_variable>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <cstdlib>
+#include <cstdio>
+#include <unistd.h>
+
+/**
+ * Rule plugin recording the data passed to plugin_eval
+ *
+ * Evaluations can be held: the evaluating queue worker waits,
+ * so that new data queues up meanwhile.
+ * The thread calling plugin_eval is recorded, with the order
+ * of the evaluation among the evaluations of all the rules.
+ */
+class RecordingRule : public RulePlugin
+{
+	public:
+		RecordingRule(const std::string& name,
+			      const std::string& triggers) :
+			      RulePlugin(name, NULL),
+			      m_triggers(triggers),
+			      m_held(false),
+			      m_evalCostUs(0),
+			      m_deleted(NULL)
+		{
+		};
+		~RecordingRule()
+		{
+			if (m_deleted)
+			{
+				*m_deleted = true;
+			}
+		};
+		std::string	triggers() { return m_triggers; };
+		std::string	reason() const { return "{ \"reason\": \"cleared\" }"; };
+		void		shutdown() {};
+		bool		eval(const std::string& assetValues)
+		{
+			if (m_evalCostUs)
+			{
+				usleep(m_evalCostUs);
+			}
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_evaluated.push_back(assetValues);
+			m_threads.push_back(std::this_thread::get_id());
+			m_sequence.push_back(evaluations()++);
+			m_cv.notify_all();
+			m_cv.wait(lock, [this] { return !m_held; });
+			return false;
+		};
+		void		hold()
+		{
+			std::lock_guard<std::mutex> guard(m_mutex);
+			m_held = true;
+		};
+		void		release()
+		{
+			std::lock_guard<std::mutex> guard(m_mutex);
+			m_held = false;
+			m_cv.notify_all();
+		};
+		// Wait for a number of evaluations, up to some seconds
+		bool		waitEvaluations(size_t count, int seconds = 5)
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			return m_cv.wait_for(lock,
+					     std::chrono::seconds(seconds),
+					     [this, count] { return m_evaluated.size() >= count; });
+		};
+		std::vector<std::string>
+				getEvaluated()
+		{
+			std::lock_guard<std::mutex> guard(m_mutex);
+			return m_evaluated;
+		};
+		std::vector<std::thread::id>
+				getThreads()
+		{
+			std::lock_guard<std::mutex> guard(m_mutex);
+			return m_threads;
+		};
+		std::vector<unsigned long>
+				getSequence()
+		{
+			std::lock_guard<std::mutex> guard(m_mutex);
+			return m_sequence;
+		};
+		// Evaluations of all the rules
+		static std::atomic<unsigned long>&
+				evaluations()
+		{
+			static std::atomic<unsigned long> count(0);
+			return count;
+		};
+		// Time spent by each evaluation
+		void		setEvalCost(unsigned long us) { m_evalCostUs = us; };
+		// Flag set when the plugin is deleted
+		void		setDeletedFlag(std::atomic<bool>* deleted) { m_deleted = deleted; };
+
+	private:
+		std::string	m_triggers;
+		bool		m_held;
+		unsigned long	m_evalCostUs;
+		std::atomic<bool>*
+				m_deleted;
+		std::vector<std::string>
+				m_evaluated;
+		std::vector<std::thread::id>
+				m_threads;
+		std::vector<unsigned long>
+				m_sequence;
+		std::mutex	m_mutex;
+		std::condition_variable
+				m_cv;
+};
+
+/**
+ * Get the value of datapoint "v" in each evaluated data
+ *
+ * @param    evaluated	The data passed to plugin_eval
+ * @return		The values, in evaluation order
+ */
+static inline std::vector<long> evaluatedValues(const std::vector<std::string>& evaluated)
+{
+	std::vector<long> values;
+	for (auto e = evaluated.begin(); e != evaluated.end(); ++e)
+	{
+		size_t pos = (*e).find("\"v\" : ");
+		if (pos != std::string::npos)
+		{
+			values.push_back(atol((*e).c_str() + pos + 6));
+		}
+	}
+	return values;
+}
+
+/**
+ * Notification type with default settings
+ *
+ * @return	The notification type
+ */
+static inline NOTIFICATION_TYPE pipelineType()
+{
+	NOTIFICATION_TYPE type;
+	type.type = E_NOTIFICATION_TYPE::Retriggered;
+	type.retriggerTime = DEFAULT_RETRIGGER_TIME;
+	type.dropStale = false;
+	type.maxQueueAge = DEFAULT_MAX_QUEUE_AGE;
+	type.maxReadingAge = DEFAULT_MAX_READING_AGE;
+	type.priority = E_NOTIFICATION_PRIORITY::PriorityNormal;
+	type.bufferMaxBytes = DEFAULT_BUFFER_MAX_BYTES;
+	type.bufferEviction = E_BUFFER_EVICTION::EvictDropOldest;
+	type.bufferSpillBytes = DEFAULT_BUFFER_SPILL_BYTES;
+	return type;
+}
+
+/**
+ * Reading with datapoint "v"
+ *
+ * @param    assetName	The asset name
+ * @param    value	The datapoint value
+ * @param    userTime	The reading user timestamp seconds
+ * @param    userTimeUs	The reading user timestamp microseconds
+ * @return		The new reading
+ */
+static inline Reading* pipelineReading(const std::string& assetName,
+				       long value,
+				       time_t userTime,
+				       long userTimeUs)
+{
+	DatapointValue dpv(value);
+	Reading* reading = new Reading(assetName, new Datapoint("v", dpv));
+	struct timeval tv;
+	tv.tv_sec = userTime;
+	tv.tv_usec = userTimeUs;
+	reading->setUserTimestamp(tv);
+	reading->setTimestamp(tv);
+	return reading;
+}
+
+/**
+ * Queue element with readings
+ *
+ * @param    assetName	The asset name
+ * @param    readings	The readings, now owned by the element
+ * @return		The new queue element
+ */
+static inline NotificationQueueElement* pipelineElement(const std::string& assetName,
+							const std::vector<Reading *>& readings)
+{
+	ReadingSet* readingSet = new ReadingSet();
+	readingSet->append(readings);
+	return new NotificationQueueElement(assetName, readingSet);
+}
+
+/**
+ * Queue element with one reading of datapoint "v"
+ *
+ * The value is the microseconds of the reading timestamps,
+ * so readings of one second have distinct timestamps.
+ *
+ * @param    assetName	The asset name
+ * @param    value	The datapoint value, below one million
+ * @param    userTime	The reading user timestamp seconds
+ * @return		The new queue element
+ */
+static inline NotificationQueueElement* pipelineElement(const std::string& assetName,
+							long value,
+							time_t userTime)
+{
+	return pipelineElement(assetName,
+			       std::vector<Reading *>(1, pipelineReading(assetName,
+									 value,
+									 userTime,
+									 value)));
+}
+
+/**
+ * JSON reading with datapoint "v", as sent by the storage service
+ *
+ * @param    assetName	The asset name
+ * @param    value	The datapoint value
+ * @param    timeUs	The microseconds of the reading timestamps
+ *			after 2019-01-01 10:00:00, below one minute
+ * @return		The JSON reading
+ */
+static inline std::string pipelineJSONReading(const std::string& assetName,
+					      long value,
+					      long timeUs)
+{
+	char ts[64];
+	snprintf(ts, sizeof(ts),
+		 "2019-01-01 10:00:%02ld.%06ld+00:00",
+		 timeUs / 1000000,
+		 timeUs % 1000000);
+	return "{ \"asset_code\" : \"" + assetName + "\", "
+		"\"read_key\" : \"f1cfff7a-3769-4f47-9ded-" + std::to_string(value) + "\", "
+		"\"reading\" : { \"v\" : " + std::to_string(value) + " }, "
+		"\"user_ts\" : \"" + std::string(ts) + "\", "
+		"\"ts\" : \"" + std::string(ts) + "\" }";
+}
+
+/**
+ * JSON readings payload of a reading callback
+ *
+ * @param    readings	The JSON readings
+ * @return		The readings payload
+ */
+static inline std::string pipelinePayload(const std::vector<std::string>& readings)
+{
+	std::string payload = "{ \"readings\" : [ ";
+	for (auto r = readings.begin(); r != readings.end(); ++r)
+	{
+		if (r != readings.begin())
+		{
+			payload += ", ";
+		}
+		payload += *r;
+	}
+	payload += " ] }";
+	return payload;
+}
+
+using HttpClient = SimpleWeb::Client<SimpleWeb::HTTP>;
+
+/**
+ * The notification service objects data goes through:
+ * API, instances, subscriptions and queue
+ */
+class QueuePipeline
+{
+	public:
+		QueuePipeline(unsigned long numWorkers = 1) :
+			m_client("0.0.0.0", 0),
+			m_manager("myName", &m_client, NULL),
+			m_storage("0.0.0.0", 0),
+			m_subscriptions("myName", m_storage),
+			m_started(false),
+			m_port(0)
+		{
+			m_api = new NotificationApi(0, 1);
+			m_api->setCallBackURL();
+			m_queue = new NotificationQueue("myName", numWorkers);
+		};
+		~QueuePipeline()
+		{
+			m_queue->stop();
+			delete m_queue;
+			m_api->stop();
+			if (m_started)
+			{
+				m_api->wait();
+			}
+			delete m_api;
+		};
+		// Add an enabled notification with a rule plugin
+		// and subscribe to the rule triggers
+		NotificationInstance*	addNotification(const std::string& name,
+							RulePlugin* plugin,
+							const NOTIFICATION_TYPE& type)
+		{
+			NotificationRule* rule = new NotificationRule("rule_" + name,
+								      name,
+								      plugin);
+			m_manager.addInstance(name, true, type, rule, NULL);
+			NotificationInstance* instance = m_manager.getNotificationInstance(name);
+			if (instance)
+			{
+				m_subscriptions.createSubscription(instance);
+			}
+			return instance;
+		};
+		// Start the API HTTP server
+		bool			startApi()
+		{
+			m_api->initResources();
+			m_api->start();
+			m_started = true;
+			// Allow the server to listen
+			sleep(1);
+			m_port = m_api->getListenerPort();
+			return m_port != 0;
+		};
+		// POST data to the API HTTP server
+		std::shared_ptr<HttpClient::Response>
+					post(const std::string& path,
+					     const std::string& content)
+		{
+			HttpClient client("127.0.0.1:" + std::to_string(m_port));
+			return client.request("POST", path, content);
+		};
+		NotificationManager&	getManager() { return m_manager; };
+		NotificationSubscription&
+					getSubscriptions() { return m_subscriptions; };
+		NotificationQueue*	getQueue() { return m_queue; };
+		NotificationApi*	getApi() { return m_api; };
+
+	private:
+		ManagementClient	m_client;
+		NotificationManager	m_manager;
+		StorageClient		m_storage;
+		NotificationSubscription
+					m_subscriptions;
+		NotificationApi*	m_api;
+		NotificationQueue*	m_queue;
+		bool			m_started;
+		unsigned short		m_port;
+};
+
+#endif
@@ -2,6 +2,7 @@
 #include "notification_service.h"
 #include "notification_manager.h"
 #include "notification_queue.h"
+#include "queue_pipeline.h"
 
 using namespace std;
 
@@ -39,3 +40,191 @@ EXPECT_EXIT({
 
 	exit(!(ret == true)); }, ::testing::ExitedWithCode(0), "");
 }
+
+/**
+ * A removed instance is deleted once no reader of the instances
+ * table can be using it: a table reader or a queue worker
+ * evaluating its rule
+ */
+TEST(NotificationService, RemoveInstanceEpoch)
+{
+EXPECT_EXIT({
+	QueuePipeline pipeline;
+	NotificationManager& manager = pipeline.getManager();
+	atomic<bool> deleted(false);
+	RecordingRule* plugin = new RecordingRule("Recording",
+						  "{ \"triggers\" : [ { \"asset\" : \"EPOCH\" } ] }");
+	plugin->setDeletedFlag(&deleted);
+	pipeline.addNotification("epoch", plugin, pipelineType());
+
+	// A reader of the instances table
+	unsigned long epoch = manager.addInstancesUser();
+	shared_ptr<const INSTANCES_TABLE> table = manager.getInstancesTable();
+	bool ret = table->count("epoch") == 1 &&
+		   manager.removeInstance("epoch") &&
+		   manager.getNotificationInstance("epoch") == NULL &&
+		   manager.getInstancesTable()->count("epoch") == 0 &&
+		   table->count("epoch") == 1 &&
+		   !deleted;
+	manager.removeInstancesUser(epoch);
+	ret = ret && deleted;
+	if (!ret)
+	{
+		cerr << "Removed instance has not been deleted after its reader" << endl;
+	}
+
+	// The queue worker evaluating a rule
+	atomic<bool> busyDeleted(false);
+	RecordingRule* busyPlugin = new RecordingRule("Recording",
+						      "{ \"triggers\" : [ { \"asset\" : \"BUSY\" } ] }");
+	busyPlugin->setDeletedFlag(&busyDeleted);
+	pipeline.addNotification("busy", busyPlugin, pipelineType());
+	busyPlugin->hold();
+	pipeline.getQueue()->addElement(pipelineElement("BUSY", 1, time(NULL)));
+	ret = busyPlugin->waitEvaluations(1) && ret;
+	ret = ret && manager.removeInstance("busy");
+
+	// The instance is in use until the evaluation completes
+	sleep(1);
+	ret = ret && !busyDeleted;
+	busyPlugin->release();
+	for (int i = 0; i < 50 && !busyDeleted; i++)
+	{
+		usleep(100000);
+	}
+	ret = ret && busyDeleted;
+	if (!ret)
+	{
+		cerr << "Removed instance has not been deleted after its evaluation" << endl;
+	}
+
+	exit(!(ret == true)); }, ::testing::ExitedWithCode(0), "");
+}
+
+/**
+ * Instances are looked up in published copies of the instances map:
+ * a copy is never modified, changes publish a new one
+ */
+TEST(NotificationService, RemoveInstanceTable)
+{
+EXPECT_EXIT({
+	QueuePipeline pipeline;
+	NotificationManager& manager = pipeline.getManager();
+	shared_ptr<const INSTANCES_TABLE> empty = manager.getInstancesTable();
+
+	pipeline.addNotification("first",
+				 new RecordingRule("Recording",
+						   "{ \"triggers\" : [ { \"asset\" : \"FIRST\" } ] }"),
+				 pipelineType());
+	shared_ptr<const INSTANCES_TABLE> added = manager.getInstancesTable();
+	bool ret = (!empty || empty->empty()) &&
+		   added->size() == 1 &&
+		   added->count("first") == 1 &&
+		   manager.getNotificationInstance("first") == added->at("first");
+
+	// Readers look up instances while they are added and removed
+	atomic<bool> done(false);
+	atomic<bool> consistent(true);
+	thread reader([&] {
+		while (!done)
+		{
+			unsigned long epoch = manager.addInstancesUser();
+			shared_ptr<const INSTANCES_TABLE> table = manager.getInstancesTable();
+			auto first = table->find("first");
+			if (first == table->end() ||
+			    (*first).second->getName() != "first")
+			{
+				consistent = false;
+			}
+			manager.removeInstancesUser(epoch);
+		}
+	});
+	for (int i = 0; i < 100; i++)
+	{
+		string name = "other_" + to_string(i);
+		pipeline.addNotification(name,
+					 new RecordingRule("Recording",
+							   "{ \"triggers\" : [ { \"asset\" : \"OTHER\" } ] }"),
+					 pipelineType());
+		ret = manager.removeInstance(name) && ret;
+	}
+	done = true;
+	reader.join();
+
+	// Earlier copies are unchanged
+	ret = ret &&
+	      consistent &&
+	      added->size() == 1 &&
+	      manager.getInstancesTable()->size() == 1;
+	if (!ret)
+	{
+		cerr << "Published instances table has been modified" << endl;
+	}
+
+	exit(!(ret == true)); }, ::testing::ExitedWithCode(0), "");
+}
+
+/**
+ * The subscription routes are rebuilt when subscriptions
+ * and instances change: assets appear and disappear
+ */
+TEST(NotificationService, RemoveSubscriptionRoutes)
+{
+EXPECT_EXIT({
+	QueuePipeline pipeline;
+	NotificationManager& manager = pipeline.getManager();
+	NotificationSubscription& subscriptions = pipeline.getSubscriptions();
+	shared_ptr<const SubscriptionRoutes> none = subscriptions.getRoutes();
+	unsigned long version = none ? none->version : 0;
+
+	RecordingRule* plugin = new RecordingRule("Recording",
+						  "{ \"triggers\" : [ { \"asset\" : \"ROUTE\" } ] }");
+	pipeline.addNotification("route", plugin, pipelineType());
+	shared_ptr<const SubscriptionRoutes> subscribed = subscriptions.getRoutes();
+	bool ret = subscribed->version > version &&
+		   subscribed->assets.count("ROUTE") == 1 &&
+		   subscribed->assets.at("ROUTE").size() == 1 &&
+		   subscribed->assets.at("ROUTE")[0].instance == manager.getNotificationInstance("route") &&
+		   subscribed->assets.at("ROUTE")[0].ruleName == "rule_route" &&
+		   subscriptions.hasActiveSubscription("ROUTE");
+
+	// Data goes through the new route
+	pipeline.getQueue()->addElement(pipelineElement("ROUTE", 1, time(NULL)));
+	ret = plugin->waitEvaluations(1) && ret;
+	if (!ret)
+	{
+		cerr << "Routes have not been rebuilt for a new subscription" << endl;
+	}
+
+	// Unsubscribe: the asset disappears, published tables are unchanged
+	subscriptions.removeSubscription("ROUTE", "rule_route");
+	shared_ptr<const SubscriptionRoutes> unsubscribed = subscriptions.getRoutes();
+	ret = ret &&
+	      unsubscribed->version > subscribed->version &&
+	      unsubscribed->assets.count("ROUTE") == 0 &&
+	      subscribed->assets.count("ROUTE") == 1 &&
+	      !subscriptions.hasActiveSubscription("ROUTE");
+	if (!ret)
+	{
+		cerr << "Routes have not been rebuilt for a removed subscription" << endl;
+	}
+
+	// Removed instances are not routed
+	pipeline.addNotification("gone",
+				 new RecordingRule("Recording",
+						   "{ \"triggers\" : [ { \"asset\" : \"GONE\" } ] }"),
+				 pipelineType());
+	ret = ret && subscriptions.hasActiveSubscription("GONE");
+	unsigned long added = subscriptions.getRoutes()->version;
+	ret = ret && manager.removeInstance("gone");
+	shared_ptr<const SubscriptionRoutes> removed = subscriptions.getRoutes();
+	ret = ret &&
+	      removed->version > added &&
+	      !subscriptions.hasActiveSubscription("GONE");
+	if (!ret)
+	{
+		cerr << "Routes have not been rebuilt for a removed instance" << endl;
+	}
+
+	exit(!(ret == true)); }, ::testing::ExitedWithCode(0), "");
+}